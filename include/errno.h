@@ -42,6 +42,8 @@ extern int errno;
 #define EDOM 33    /* Mathematics argument out of domain of function */
 #define ERANGE 34  /* Result too large */
 
+#define ETIMEDOUT 110 /* Connection timed out */
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,7 @@
 #ifndef INFO_KERNEL_BLOCK_H_
 #define INFO_KERNEL_BLOCK_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 
@@ -22,6 +23,10 @@ class Bio {
         : sector(sec), count(cnt), buf(buffer), rw(type), next(nullptr) {}
     ~Bio() = default;
 
+    // 由 bio slab cache 分配
+    static void *operator new(std::size_t size);
+    static void operator delete(void *ptr);
+
     std::uint64_t sector;
     std::uint32_t count;
     void *buf;
@@ -47,6 +52,10 @@ class Request {
         }
     }
 
+    // 由 request slab cache 分配
+    static void *operator new(std::size_t size);
+    static void operator delete(void *ptr);
+
     std::uint64_t sector;
     std::uint32_t count;
     void *buf;
@@ -2,14 +2,44 @@
 #define INFO_KERNEL_CPU_H_
 
 /* CR0 */
+#define CR0_WP (1 << 16) /* Supervisor writes honour read-only pages */
 #define CR0_PG (1 << 31)
 
+/* Page fault error code */
+#define PF_ERR_PRESENT (1 << 0)
+#define PF_ERR_WRITE (1 << 1)
+#define PF_ERR_USER (1 << 2)
+
 /* CR4 */
 #define CR4_PSE (1 << 4)
 #define CR4_PAE (1 << 5)
 #define CR4_PGE (1 << 7)
 #define CR4_OSFXSR (1 << 9)      /* OS supports FXSAVE/FXRSTOR */
 #define CR4_OSXMMEXCPT (1 << 10) /* OS supports SIMD FP exceptions */
+#define CR4_PCIDE (1 << 17)      /* Process-context identifiers */
+
+/* CR3 */
+#define CR3_NOFLUSH (1ULL << 63) /* Keep the TLB entries of the new PCID */
+#define PCID_MASK 0xfff
+
+/* MSR */
+#define MSR_APIC_BASE 0x1B
+#define MSR_TSC_DEADLINE 0x6E0
+#define MSR_EFER 0xC0000080
+#define MSR_GS_BASE 0xC0000101
+#define MSR_KERNEL_GS_BASE 0xC0000102
+
+#define EFER_LMA (1 << 10) /* 只读，长模式已激活 */
+
+#define MAX_CPUS 8
+
+// 多个 CPU 争用的锁和每 CPU 数据按缓存行对齐，避免伪共享
+#define CACHE_LINE_SIZE 64
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+
+/* CPUID.1:ECX */
+#define CPUID_PCID (1 << 17)
+#define CPUID_TSC_DEADLINE (1 << 24)
 
 /* Segment selector */
 #define SELECTOR_RPL (0)
@@ -62,6 +92,7 @@ struct Ptr {
 } __attribute__((packed));
 
 void Init();
+void Load();
 }  // namespace idt
 
 namespace gdt {
@@ -89,16 +120,22 @@ struct TssEntry {
     std::uint16_t iomap_base;
 } __attribute__((packed, aligned(16)));
 
-extern TssEntry *tss;
 void SetEntry(int index, std::uint64_t base, std::uint64_t limit,
               std::uint8_t access, std::uint8_t gran);
 void SetTss(int index, std::uint64_t tss_base, std::uint8_t access);
+TssEntry *NewTss(std::uint32_t cpu);
+void Load(std::uint32_t cpu);
 void Init();
 }  // namespace gdt
 
 // Stubs implemented in interrupt.S
 extern "C" void pit_stub();
 extern "C" void kbd_stub();
+extern "C" void ide_stub();
+extern "C" void apic_timer_stub();
+extern "C" void resched_ipi_stub();
+extern "C" void tlb_ipi_stub();
+extern "C" void spurious_stub();
 
 extern "C" void de_stub();
 extern "C" void debug_stub();
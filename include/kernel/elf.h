@@ -16,6 +16,11 @@ using Elf64_Off  = std::uint64_t;
 
 #define PT_LOAD 1
 
+// p_flags
+#define PF_X 0x1
+#define PF_W 0x2
+#define PF_R 0x4
+
 struct Elf64_Phdr {
     std::uint32_t p_type;    // 段类型
     std::uint32_t p_flags;   // 段标志
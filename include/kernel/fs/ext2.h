@@ -22,6 +22,7 @@
 #define EXT2_S_IFLNK 0xA000
 
 #define PARTITION_TYPE_LINUX 0x83
+#define PARTITION_TYPE_SWAP 0x82
 
 struct MBRPartitionEntry {
     std::uint8_t boot_indicator;
@@ -7,7 +7,9 @@
 
 namespace ide {
 
-#define IDE_TIMEOUT 1000
+#define IDE_TIMEOUT 1000     // ms
+#define IDE_SPIN_POLLS 1000  // 开始睡眠前连续读状态寄存器的次数
+#define IDE_POLL_MS 10       // 睡眠等中断时重读状态的间隔
 
 #define IDE_PRIMARY_IO 0x1F0
 #define IDE_SECONDARY_IO 0x170
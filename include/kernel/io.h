@@ -61,6 +61,29 @@ static inline std::uint64_t rdmsr(std::uint32_t msr) {
     return static_cast<std::uint64_t>(tmp0) << 32 | tmp1;
 }
 
+static inline std::uint64_t rdtsc() {
+    std::uint32_t lo, hi;
+    asm __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return static_cast<std::uint64_t>(hi) << 32 | lo;
+}
+
+// 关中断并返回之前的 RFLAGS，与 irq_restore 成对使用
+static inline std::uint64_t irq_save() {
+    std::uint64_t flags;
+    asm __volatile__("pushfq; popq %0; cli" : "=r"(flags)::"memory");
+    return flags;
+}
+
+static inline void irq_restore(std::uint64_t flags) {
+    if (flags & (1 << 9)) asm __volatile__("sti" ::: "memory");
+}
+
+static inline bool irq_enabled() {
+    std::uint64_t flags;
+    asm __volatile__("pushfq; popq %0" : "=r"(flags));
+    return (flags & (1 << 9)) != 0;
+}
+
 static inline void cpuid(std::uint32_t func, std::uint32_t &eax,
                          std::uint32_t &ebx, std::uint32_t &ecx,
                          std::uint32_t &edx) {
@@ -104,6 +127,18 @@ namespace timer {
 extern volatile std::uint64_t pit_ticks;
 void Init(std::uint32_t freq);
 std::uint64_t GetTicks();
+
+/* in kernel/tsc.cc */
+void InitClock();
+std::uint64_t Nanos();
+std::uint64_t Millis();
+std::uint64_t TscKhz();
+std::uint64_t NsToCycles(std::uint64_t ns);
+
+/* in kernel/apic_timer.cc */
+void InitLocal();
+void Program(std::uint64_t ns);
+void Stop();
 }  // namespace timer
 
 #endif  // INFO_KERNEL_IO_H_
@@ -4,6 +4,8 @@
 #include <cstdint>
 #include <cstring>
 
+#include "kernel/task.h"
+
 namespace keyboard {
 
 #define KBD_BUFFER_SIZE 128
@@ -51,6 +53,7 @@ class InputQueue {
     }
     void Insert(char c);
     bool Peek(char *c);
+    char Get();
     bool HasData();
     void ProcessScancode(std::uint8_t sc);
     char ScancodeToChar(std::uint8_t scancode, bool shift);
@@ -61,6 +64,7 @@ class InputQueue {
     std::uint64_t head;
     std::uint64_t tail;
     std::uint64_t count;
+    task::WaitQueue readers;  // 等待按键的任务
 };
 
 extern InputQueue kbd_buffer;
@@ -6,8 +6,76 @@
 
 #include "kernel/page.h"
 
+namespace block {
+class BlockDevice;
+}
+
+namespace task {
+struct Pcb;
+namespace ipc {
+struct Message;
+}
+}  // namespace task
+
+namespace vfs {
+class File;
+}
+
+#ifndef MM_BENCHMARK
+#define MM_BENCHMARK false
+#endif
+
+// 记录每次页分配的调用点，用于查找内存泄漏
+#ifndef MM_TRACK_ALLOC
+#define MM_TRACK_ALLOC false
+#endif
+
+// MapRange 选项
+#define MAP_LARGE (1 << 0)  // 对齐时使用 2MiB / 1GiB 大页
+
+// 页分配选项
+#define GFP_ZERO (1 << 0)  // 返回清零的页
+
 namespace mm {
 
+// vmalloc 区域：占用一个 PML4 项 (512GiB)，PDPT 在启动时建好，之后创建的
+// 地址空间复制内核半部时都能看到
+#define VMALLOC_BASE 0xffffc00000000000ULL
+#define VMALLOC_END 0xffffc08000000000ULL
+
+// 用户地址空间中 mmap 未指定地址时的搜索起点和上限
+#define MMAP_BASE 0x0000100000000000ULL
+#define USER_SPACE_END 0x0000800000000000ULL
+
+// 用户地址空间中的一段区域，页面在首次访问时才分配
+struct Vma {
+    std::uint64_t start, end;  // 页对齐的区间 [start, end)
+    std::uint64_t flags;       // 映射使用的 PTE 标志，0 表示不可访问
+    vfs::File *file;           // 后备文件 (持有引用)，空表示匿名区域
+    std::uint64_t offset;      // start 处对应的文件偏移
+    std::uint64_t file_size;   // 从 start 起由文件提供的字节数，其余填零
+
+    Vma *prev, *next;  // 按地址升序的链表
+    Vma *rb_left;
+    Vma *rb_right;
+    Vma *rb_parent;
+    bool rb_is_red;
+};
+
+// 进程的全部区域：红黑树按起始地址查找，链表用于顺序遍历
+struct VmaTree {
+    Vma *rb_root;
+    Vma *head;
+    std::uint64_t nr_vmas;
+};
+
+// CountUserSpace 的结果，单位为页
+struct UserSpaceStats {
+    std::uint64_t resident;  // 映射着的物理页
+    std::uint64_t swapped;   // 换出到交换区的页
+    std::uint64_t tables;    // 页表页，包括 PML4
+};
+
 int Service(int argc, char *argv[]);
 
 inline static std::uint64_t Vir2Phy(std::uint64_t virt) {
@@ -24,16 +92,128 @@ extern FrameMem frame;
 extern PTE *kernel_pml4;
 
 void Map(PTE *pml4, std::uint64_t virt_addr, std::uint64_t phys_addr,
-         std::uint64_t flags);
-void *Alloc(std::size_t size);
+         std::uint64_t flags, std::uint64_t page_size = PAGE_SIZE);
+void MapRange(PTE *pml4, std::uint64_t virt, std::uint64_t phys,
+              std::uint64_t size, std::uint64_t flags,
+              std::uint32_t map_flags = 0);
+void UnmapRange(PTE *pml4, std::uint64_t virt, std::uint64_t size);
+void ReleaseRange(PTE *pml4, std::uint64_t virt, std::uint64_t size);
+void ProtectRange(PTE *pml4, std::uint64_t virt, std::uint64_t size,
+                  std::uint64_t flags);
+void PopulateRange(PTE *pml4, std::uint64_t virt, std::uint64_t size,
+                   std::uint64_t flags);
+void SplitPages(void *addr, std::size_t n);
+void GetPage(std::uint64_t phys);
+void PutPage(std::uint64_t phys);
+PTE *CloneUserSpace(PTE *src);
+void FreeUserSpace(PTE *pml4);
+void CountUserSpace(PTE *pml4, UserSpaceStats *st);
+PTE *AllocTable();
+void FreeTable(PTE *table);
+bool HandleFault(std::uint64_t addr, std::uint64_t error_code);
+PTE *FindLeaf(PTE *pml4, std::uint64_t virt);
+std::uint64_t Translate(PTE *pml4, std::uint64_t virt);
+void Init();
+bool InitDeferred();
+void ShowZones();
+void SelfTest();
+void Benchmark();
+void *AllocOrder(std::uint32_t order);
+void *AllocPages(std::size_t n, std::uint32_t gfp = 0);
+void FreePages(void *addr, std::size_t n);
+void *Alloc(std::size_t size, std::uint32_t gfp = 0);
 void Free(void *addr);
+bool RefillZeroPool();
+Page *VirtToPage(const void *addr);
 void UpdateKernelPml4(PTE *user_pml4);
+std::uint64_t NrFree(std::uint32_t order);
+std::uint64_t NrUsed(std::uint32_t order);
+std::uint64_t NrTables();
+std::uint64_t NrZeroPool();
+std::uint64_t DeferredPages();
 
 std::uint64_t AnalyzePageTable(PTE *pml4, std::uint64_t virt_addr);
 }  // namespace page
-namespace slab {
+
+namespace vmalloc {
+/* in mm/vmalloc.cc */
 void Init();
-}
+void *Alloc(std::size_t size, std::uint32_t gfp = 0);
+void Free(void *addr);
+std::uint64_t NrPages();
+}  // namespace vmalloc
+
+namespace vma {
+/* in mm/vma.cc */
+Vma *Find(VmaTree *tree, std::uint64_t addr);
+Vma *Insert(VmaTree *tree, std::uint64_t start, std::uint64_t end,
+            std::uint64_t flags, vfs::File *file, std::uint64_t offset,
+            std::uint64_t file_size);
+bool Clone(VmaTree *dst, VmaTree *src);
+void Destroy(VmaTree *tree);
+std::uint64_t Mmap(VmaTree *tree, PTE *pml4, std::uint64_t addr,
+                   std::uint64_t len, int prot, int flags, vfs::File *file,
+                   std::uint64_t offset);
+int Munmap(VmaTree *tree, PTE *pml4, std::uint64_t addr, std::uint64_t len);
+int Mprotect(VmaTree *tree, PTE *pml4, std::uint64_t addr, std::uint64_t len,
+             int prot);
+bool HandleFault(std::uint64_t addr, std::uint64_t error_code);
+}  // namespace vma
+
+namespace swap {
+/* in mm/swap.cc */
+void Init(block::BlockDevice *dev);
+void LruAdd(void *page, task::Mem *mm, std::uint64_t virt, bool file = false);
+void LruDel(Page *page);
+void Forget(task::Mem *mm);
+void Dup(std::uint64_t entry);
+void Free(std::uint64_t entry);
+bool SwapIn(task::Mem *mm, PTE *pte, std::uint64_t virt, std::uint64_t flags);
+void *AllocPage(std::uint32_t gfp = 0);
+std::uint64_t Reclaim(std::uint64_t nr);
+void Wake();
+void Balance();
+std::uint64_t NrLru();
+std::uint64_t NrSlots();
+std::uint64_t NrFreeSlots();
+}  // namespace swap
+
+namespace track {
+/* in mm/track.cc, only built with MM_TRACK_ALLOC */
+// 一个调用点上尚未释放的分配
+struct Site {
+    std::uint64_t rip;    // 调用点，0 表示其余调用点的汇总
+    std::uint64_t pages;  // 页数
+    std::uint64_t count;  // 块数
+    std::uint64_t age;    // 最早一块至今的时钟节拍数
+};
+
+void Record(void *addr, std::size_t pages, std::uint64_t rip);
+void Forget(void *addr);
+bool GetSite(std::uint64_t index, Site *site);
+void Dump(std::uint64_t top);
+}  // namespace track
+
+namespace stat {
+/* in mm/stat.cc */
+void Attach(task::Mem *mm, task::Pcb *owner);
+void Detach(task::Mem *mm);
+void Query(task::ipc::Message *msg);
+}  // namespace stat
+
+namespace tlb {
+/* in mm/tlb.cc */
+void Init();
+bool PcidEnabled();
+void InitAp();
+void Switch(task::Mem *mm);
+void Invalidate(std::uint64_t *asid);
+void FlushLocal();
+void FlushAll();
+void ServePending();
+void Shootdown();
+void Benchmark();
+}  // namespace tlb
 }  // namespace mm
 
 #endif /* INFO_KERNEL_MM_H_ */
\ No newline at end of file
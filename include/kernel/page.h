@@ -11,6 +11,8 @@
 #define PTE_DIRTY (1 << 6)           // 脏页标志
 #define PTE_PAGE_SIZE (1 << 7)       // 页大小标志 (0: 4KB, 1: 2MB/1GB)
 #define PTE_GLOBAL (1 << 8)          // 全局页标志
+#define PTE_COW (1 << 9)             // 写时复制 (软件使用位)
+#define PTE_SWAP (1 << 10)           // 已换出，bit 12 起为交换槽号 (软件使用位)
 #define PTE_NO_EXECUTE (1ULL << 63)  // 不可执行标志
 
 // 物理内存页大小 (4KB)
@@ -18,9 +20,23 @@
 #define PAGE_SHIFT 12
 #define PAGE_MASK (~(PAGE_SIZE - 1))
 
+// 大页 (PDE / PDPTE 中置 PTE_PAGE_SIZE)
+#define PAGE_SIZE_2M 0x200000ULL
+#define PAGE_SIZE_1G 0x40000000ULL
+
+// CPUID 0x80000001 EDX: 支持 1GiB 页
+#define CPUID_EXT_PDPE1GB (1 << 26)
+
 // 物理页框状态
 #define PAGE_FREE 0
 #define PAGE_USED 1
+#define PAGE_SLAB (1 << 1)   // 页被 slab 分配器占用
+#define PAGE_BUDDY (1 << 2)  // 空闲块首页，挂在伙伴系统空闲链表上
+#define PAGE_LRU (1 << 3)    // 用户页，挂在回收用的 LRU 链表上
+#define PAGE_FILE (1 << 4)   // LRU 上的页内容来自文件，未写过时可直接丢弃
+
+// 伙伴系统最大阶数，最大块为 2^(MAX_ORDER-1) 页 (4MiB)
+#define MAX_ORDER 11
 
 /* page table entry */
 
@@ -68,6 +84,8 @@ extern char __rodata_end[];
 extern char __bss_start[];
 extern char __bss_end[];
 
+extern char __kernel_phys_end[];  // 内核映像在物理内存中的结束地址
+
 // 页表条目结构
 union PTE {
     std::uint64_t value;
@@ -88,24 +106,60 @@ union PTE {
     } __attribute__((packed));
 };
 
+namespace task {
+struct Mem;
+}
+
 struct Page {
-    std::uint64_t flag;
-    std::uint64_t vaddr;
-    std::uint32_t count;
+    std::uint32_t flag;
+    std::uint32_t count;  // 引用计数 (映射到多个地址空间时大于 1)
+    std::uint32_t size;   // 分配块的页数 (仅块首页有效)
+    std::uint32_t order;  // 伙伴块阶数 (仅块首页有效)
+    Page *prev;           // 空闲链表，已分配的用户页用作 LRU 链表
+    Page *next;
+    task::Mem *mapping;   // 映射该页的地址空间 (仅 LRU 上的页有效)
+    std::uint64_t index;  // 该页在 mapping 中的用户虚拟地址
+};
+
+struct FreeArea {
+    Page *head;
+    std::uint64_t nr_free;  // 该阶空闲块数
+};
+
+// 每个可用的 multiboot 内存区域对应一个 zone
+#define MAX_ZONES 16
+
+struct Zone {
+    std::uint64_t start_pfn;        // 第一个可用页框号
+    std::uint64_t total_pages;      // 可用页框数 (不含管理数组)
+    std::uint64_t free_pages;       // 空闲页框数
+    std::uint64_t boot_used;        // 引导阶段顺序分配掉的页数
+    std::uint64_t init_pages;       // 已初始化的页描述符数，其后的页尚未启用
+    Page *pages;                    // 页管理数组，位于区域起始处
+    FreeArea free_area[MAX_ORDER];  // 伙伴系统空闲链表
 };
 
 struct FrameMem {
-    std::uint64_t total_pages;   // 总页框数
-    std::uint64_t free_pages;    // 空闲页框数
-    std::uint64_t bitmap_size;   // 位图大小 (字节)
-    std::uint8_t *bitmap;        // 页框位图
-    Page *pages;                 // 页管理数组
-    std::uint64_t start_addr;    // 起始地址 (原始区域起始)
-    std::uint64_t start_usable;  // 可用物理起始地址（跳过位图和管理数组）
+    std::uint64_t total_pages;  // 所有 zone 的可用页框数
+    std::uint64_t free_pages;   // 所有 zone 的空闲页框数
+    std::uint32_t nr_zones;
+    Zone zones[MAX_ZONES];
+};
+
+// 引导阶段建立内核页表的统计
+struct BootMapStats {
+    std::uint64_t pages_4k;     // 使用的各尺寸页数
+    std::uint64_t pages_2m;
+    std::uint64_t pages_1g;
+    std::uint64_t table_pages;  // 分配的页表页数
+    std::uint64_t walks;        // 从 PML4 开始的页表遍历次数
+    std::uint64_t cycles;       // 建立映射耗费的 TSC 周期
+    bool gbpages;               // CPU 是否支持 1GiB 页
 };
 
 /* in kernel/boot/mm.cc */
 extern FrameMem pm;
+extern BootMapStats boot_map_stats;
 
 #endif
 
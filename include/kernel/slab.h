@@ -0,0 +1,91 @@
+#ifndef INFO_KERNEL_SLAB_H_
+#define INFO_KERNEL_SLAB_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "kernel/page.h"
+#include "kernel/task.h"
+
+#define SLAB_MIN_ALIGN 8
+#define SLAB_NAME_LEN 24
+
+// kmalloc 尺寸类别: 8 ~ 1024 字节，更大的请求直接交给页分配器
+#define KMALLOC_MIN_SHIFT 3
+#define KMALLOC_MAX_SHIFT 10
+#define KMALLOC_MAX_SIZE (1 << KMALLOC_MAX_SHIFT)
+
+namespace mm::slab {
+
+class Cache;
+
+// 每个 slab 占用一个物理页，描述符位于页首，对象紧随其后
+struct Slab {
+    Cache *cache;
+    Slab *prev;
+    Slab *next;
+    void *freelist;       // 空闲对象链表，链接指针见 Cache::free_off
+    std::uint32_t inuse;  // 已分配对象数
+    std::uint32_t total;  // 本 slab 可容纳对象数
+};
+
+class Cache {
+   public:
+    void Init(const char *name, std::size_t size, std::size_t align,
+              void (*ctor)(void *));
+
+    void *Alloc();
+    void Free(void *obj);
+    // 释放所有空 slab，返回释放的页数
+    std::uint64_t Shrink();
+
+    const char *Name() const { return name; }
+    std::size_t ObjectSize() const { return obj_size; }
+    std::uint64_t ActiveObjects() const { return nr_active; }
+    std::uint64_t TotalObjects() const { return nr_slabs * per_slab; }
+    std::uint64_t Slabs() const { return nr_slabs; }
+
+    Cache *next;  // 全局 cache 链表
+
+   private:
+    Slab *Grow();
+    void ListAdd(Slab **head, Slab *slab);
+    void ListDel(Slab **head, Slab *slab);
+    void **Link(void *obj) {
+        return reinterpret_cast<void **>(static_cast<std::uint8_t *>(obj) +
+                                         free_off);
+    }
+
+    char name[SLAB_NAME_LEN];
+    std::size_t obj_size;  // 对齐后的对象大小，含链接指针
+    std::size_t offset;    // 第一个对象在 slab 页内的偏移
+    // 空闲链表指针在对象内的偏移。有构造函数时放在对象之后，
+    // 构造好的内容在释放后保持不变
+    std::size_t free_off;
+    std::uint32_t per_slab;
+    void (*ctor)(void *);
+
+    Slab *partial;  // 部分使用
+    Slab *full;     // 全部使用
+    Slab *empty;    // 全部空闲
+
+    std::uint64_t nr_slabs;
+    std::uint64_t nr_active;
+
+    task::SpinLock lock;
+};
+
+void Init();
+
+// 创建/销毁具名对象缓存
+Cache *CreateCache(const char *name, std::size_t size, void (*ctor)(void *));
+void DestroyCache(Cache *cache);
+Cache *CacheList();
+
+// 通用分配接口 (kmalloc)，operator new/delete 通过这里分配
+void *Alloc(std::size_t size);
+void Free(void *ptr);
+
+}  // namespace mm::slab
+
+#endif /* INFO_KERNEL_SLAB_H_ */
@@ -0,0 +1,51 @@
+#ifndef INFO_KERNEL_SMP_H_
+#define INFO_KERNEL_SMP_H_
+
+// AP 启动代码被复制到的物理地址，SIPI 向量就是它的页号
+#define TRAMPOLINE_BASE 0x8000
+
+// 本地 APIC 寄存器
+#define LAPIC_ID 0x20
+#define LAPIC_TPR 0x80
+#define LAPIC_EOI 0xB0
+#define LAPIC_SVR 0xF0
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CUR 0x390
+#define LAPIC_TIMER_DIV 0x3E0
+
+#define SVR_ENABLE (1 << 8)
+#define LVT_MASKED (1 << 16)
+#define LVT_NMI (4 << 8)
+#define LVT_EXTINT (7 << 8)
+#define LVT_TSC_DEADLINE (2 << 17)
+
+// 本地 APIC 使用的中断向量
+#define VECTOR_TIMER 0x30    // 本 CPU 的 APIC 定时器
+#define VECTOR_RESCHED 0x31  // 目标 CPU 的运行队列中有任务被唤醒
+#define VECTOR_TLB 0x32      // 请求刷新 TLB
+#define VECTOR_SPURIOUS 0xff
+
+#ifndef ASM_FILE
+
+#include <cstdint>
+
+namespace smp {
+/* in kernel/smp.cc */
+void EarlyInit();
+void Init(const void *rsdp);
+bool Active();
+void SendIpi(std::uint32_t apic_id, std::uint8_t vector);
+void SendIpiOthers(std::uint8_t vector);
+void Eoi();
+std::uint32_t LapicRead(std::uint32_t reg);
+void LapicWrite(std::uint32_t reg, std::uint32_t val);
+}  // namespace smp
+
+#endif /* ASM_FILE */
+
+#endif  // INFO_KERNEL_SMP_H_
@@ -24,10 +24,10 @@ static size_t strlen(const char *s);
 
 namespace mm {
 void *Alloc();
-void Mapping(PTE *pml4, std::uint64_t virt_addr, std::uint64_t phys_addr,
-             std::uint64_t flags);
+void MappingRange(PTE *pml4, std::uint64_t virt, std::uint64_t phys,
+                  std::uint64_t size, std::uint64_t flags);
 void MappingKernel(PTE *pml4, multiboot_tag_elf_sections *elf_sections);
-void MappingIdentity(PTE *pml4, std::uint64_t size);
+void MappingIdentity(PTE *pml4, multiboot_tag_mmap *mmap_tag);
 
 void *memset(void *dest, int val, size_t len);
 void FrameInit(std::uint64_t start_addr, std::uint64_t end_addr);
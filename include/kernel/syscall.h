@@ -7,6 +7,7 @@ extern "C" {
 
 #define SYS_SEND 0
 #define SYS_RECEIVE 1
+#define SYS_FORK 2 /* 需要调用者的寄存器现场，不经过 IPC */
 
 /* IPC system calls */
 #define SYS_BLOCK 2
@@ -21,6 +22,9 @@ extern "C" {
 #define SYS_MM_WAITPID 0x4
 #define SYS_MM_MMAP 0x5
 #define SYS_MM_MUNMAP 0x6
+#define SYS_MM_MPROTECT 0x7
+#define SYS_MM_RECLAIM 0x8 /* 内核内部：空闲页低于水位，唤醒回收 */
+#define SYS_MM_MEMINFO 0x9 /* 内存统计，见 sys/meminfo.h */
 
 /* Block device */
 #define SYS_BLOCK_GET 0x10
@@ -36,6 +40,8 @@ extern "C" {
 #define SYS_FS_OPENDIR 0x27
 #define SYS_FS_READDIR 0x28
 #define SYS_FS_CLOSEDIR 0x29
+#define SYS_FS_PREAD 0x2a
+#define SYS_FS_PAGEIN 0x2b /* 内核内部：缺页时从区域的后备文件读一页 */
 
 /* Task */
 #define SYS_TASK_EXIT 0x30
@@ -43,10 +49,13 @@ extern "C" {
 #define SYS_TASK_EXECVE 0x32
 #define SYS_TASK_WAITPID 0x33
 #define SYS_TASK_YIELD 0x34
-#define SYS_TASK_SLEEP 0x35
+#define SYS_TASK_SLEEP 0x35 /* 直接陷入内核，rdi 为纳秒数 */
 #define SYS_TASK_GETPID 0x36
 #define SYS_TASK_GETPPID 0x37
 #define SYS_TASK_WAIT 0x38
+#define SYS_TASK_LOCKSTAT 0x39 /* 锁统计，见 sys/lockstat.h */
+#define SYS_FUTEX_WAIT 0x3a  /* 直接陷入内核，rdi 地址，rsi 期望值，r8 纳秒 */
+#define SYS_FUTEX_WAKE 0x3b  /* 直接陷入内核，rdi 地址，rsi 唤醒个数 */
 
 /* Character device */
 #define SYS_CHAR_PUTCHAR 0x40
@@ -1,5 +1,6 @@
 #ifndef INFO_KERNEL_TASK_H_
 #define INFO_KERNEL_TASK_H_
+#include <cstddef>
 #include <cstdint>
 
 #include "kernel/cpu.h"
@@ -17,16 +18,29 @@
 
 #define THREAD_NO_ARGS (1 << 2)
 #define THREAD_KERNEL (1 << 3)
+#define THREAD_IDLE (1 << 4)  // 每个 CPU 的 idle 任务，不参与负载均衡
 
 #define IDLE_NICE 19
 
+// cfs::Sched::Enqueue 的 flags，决定入队任务的 vruntime 如何安置
+#define ENQUEUE_WAKEUP (1 << 0)  // 从阻塞中被唤醒
+#define ENQUEUE_NEW (1 << 1)     // 新创建的任务
+
 #define SYSCTL_SCHED_LATENCY 20000000ULL
 #define SYSCTL_SCHED_MIN_GRANULARITY 4000000ULL
 #define SYSCTL_SCHED_WAKEUP_GRANULARITY 2000000ULL
 
+#define BALANCE_TICKS 10  // 周期性负载均衡的间隔 (时钟节拍)
+
+// 按名字统计自旋锁的获取次数、争用以及等待和持有的时间
+#ifndef LOCK_STAT
+#define LOCK_STAT false
+#endif
+
 namespace task {
 
 struct Pcb;
+struct Cpu;
 
 using pid_t = std::int64_t;
 enum State {
@@ -44,41 +58,38 @@ struct Registers {
     std::uint64_t rip, cs, rflags, rsp, ss;
 } __attribute__((packed));
 
-struct Mem {
-    PTE *pml4;
-
-    std::uint64_t text_start, text_end;
-    std::uint64_t data_start, data_end;
-    std::uint64_t rodata_start, rodata_end;
-    std::uint64_t bss_start, bss_end;
-    std::uint64_t heap_start, heap_end;
-    std::uint64_t stack_base;
-};
-
 struct Tcb {
     std::uint64_t rsp0, rip, rsp;
     std::uint16_t fs, gs;
     std::uint64_t cr2, trap_nr, error_code;
+
+    // 由 tcb slab cache 分配
+    static void *operator new(std::size_t size);
+    static void operator delete(void *ptr);
 };
 
 namespace thread {
 
 extern pid_t pid_counter;
 
-pid_t UserFork(void);
+pid_t UserFork(Registers *regs);
 
 std::int64_t Exec(Registers *regs);
 std::int64_t Exit(std::int64_t code);
 std::int64_t Kill(Pcb *proc, std::int64_t code);
+std::int64_t RequestExit(Pcb *proc, std::int64_t code);
 pid_t Fork(Registers *regs, std::uint64_t flags, std::uint64_t stack_size,
            int nice = 0);
 int Execve(const char *filename, const char *argv[], const char *envp[]);
 pid_t KernelThread(std::int64_t *func, const char *arg, std::int32_t nice,
                    std::uint64_t flags);
+void InitIdle(Cpu *cpu);
 void Init();
 
 }  // namespace thread
 
+struct LockClass;
+
 class SpinLock {
    public:
     SpinLock();
@@ -87,9 +98,76 @@ class SpinLock {
     void lock();
     void unlock();
     bool try_lock();
+    std::uint64_t lock_irqsave();
+    void unlock_irqrestore(std::uint64_t flags);
+
+    // 同名的锁合并统计，name 须一直有效
+#if LOCK_STAT == true
+    void SetName(const char *name);
+#else
+    void SetName(const char *name) { (void)name; }
+#endif
 
    private:
-    std::uint32_t state;
+    // 票号锁：next 是下一张发出的票，owner 是正在服务的票
+    union {
+        struct {
+            std::uint16_t owner;
+            std::uint16_t next;
+        } ticket;
+        std::uint32_t word;  // try_lock 一次比较两者
+    };
+#if LOCK_STAT == true
+    void StatAcquired(std::uint64_t start, bool contended);
+    void StatReleased();
+
+    LockClass *stat;      // 所属的统计项，为空时计入未命名的一项
+    std::uint64_t since;  // 本次获得锁的时刻 (TSC)
+#endif
+};
+
+// 等待队列中的一项，放在等待者自己的栈上
+struct WaitEntry {
+    WaitEntry()
+        : task(nullptr),
+          prev(nullptr),
+          next(nullptr),
+          exclusive(false),
+          queued(false) {}
+
+    Pcb *task;
+    WaitEntry *prev, *next;
+    bool exclusive;  // 独占等待者，每次唤醒只叫醒指定个数
+    bool queued;
+};
+
+// Tasks blocked until a condition holds. A waiter calls Prepare, checks
+// the condition and only then calls Schedule (or timer::ScheduleTimeout),
+// looping until the condition holds and calling Finish after it. A waker
+// makes the condition true before calling Wake, so no wakeup is lost in
+// between. Wake may be called from interrupt handlers.
+class WaitQueue {
+   public:
+    WaitQueue();
+    ~WaitQueue();
+
+    void Prepare(WaitEntry *entry, bool exclusive = false);
+    void Finish(WaitEntry *entry);
+    std::uint32_t Wake(std::uint32_t nr_exclusive);
+    std::uint32_t WakeOne() { return Wake(1); }
+    std::uint32_t WakeAll() { return Wake(0); }
+
+    // 不拿锁的检查，调用者自己保证与 Prepare 之间的先后
+    bool Empty() const {
+        return __atomic_load_n(&head, __ATOMIC_ACQUIRE) == nullptr;
+    }
+
+   private:
+    void Remove(WaitEntry *entry);
+
+    WaitEntry *head;
+    WaitEntry *tail;
+    SpinLock lock;
 };
 
 class Sem {
@@ -103,10 +181,29 @@ class Sem {
 
    private:
     std::int32_t value;
-    Pcb *wait_queue;
+    WaitQueue waiters;
     SpinLock lock;
 };
 
+// A sleeping lock for long critical sections in task context. A contender
+// spins while the owner is running on another CPU, since it will likely
+// let go soon, and otherwise sleeps until the lock is released. Zero
+// initialisation gives an unlocked mutex.
+class Mutex {
+   public:
+    Mutex();
+    ~Mutex();
+
+    void lock();
+    void unlock();
+    bool try_lock();
+    Pcb *Owner() const { return owner; }
+
+   private:
+    Pcb *owner;  // 持有者，为空表示未上锁
+    WaitQueue waiters;
+};
+
 namespace ipc {
 
 struct Message {
@@ -131,22 +228,37 @@ struct Pipe {
     std::uint64_t write_pos;
     std::uint64_t buffer_size;
     SpinLock lock;
-    Sem *readable;
-    Sem *writable;
+    WaitQueue readable;  // 等待数据的读者
+    WaitQueue writable;  // 等待空间的写者
     Pcb *reader;
     Pcb *writer;
     bool is_closed;
 };
 
 int Send(Message *msg);
+int Post(Message *msg);
 int Receive(Message *msg);
 std::int64_t PipeCreate(int pipefd[2]);
 std::int64_t PipeRead(int fd, void *buf, std::uint64_t size);
 std::int64_t PipeWrite(int fd, const void *buf, std::uint64_t size);
 void PipeClose(int fd);
+void Init();
 
 }  // namespace ipc
 
+namespace lockstat {
+/* in task/lockstat.cc */
+void Dump(std::uint32_t top);
+void Query(ipc::Message *msg);
+}  // namespace lockstat
+
+namespace futex {
+/* in task/futex.cc */
+std::int64_t Wait(std::uint64_t addr, std::uint32_t val,
+                  std::uint64_t timeout_ns);
+std::int64_t Wake(std::uint64_t addr, std::uint32_t nr);
+}  // namespace futex
+
 namespace cfs {
 
 const std::uint32_t PRIO_TO_WEIGHT[40] = {
@@ -168,13 +280,15 @@ const std::uint32_t PRIO_TO_INV_WEIGHT[40] = {
 struct Entity {
     Pcb *pcb;
     std::uint64_t vruntime;
-    std::uint64_t sum_exec_runtime;
+    std::uint64_t sum_exec_runtime;  // ns
+    std::uint64_t exec_start;        // 最近一次记账的时刻 (ns)
     std::uint64_t weight;
     std::uint64_t min_vruntime;
     Pcb *rb_left;
     Pcb *rb_right;
     Pcb *rb_parent;
     bool rb_is_red;
+    bool on_rq;  // 是否在某个运行队列的红黑树中
 };
 
 inline std::int32_t Weight2Nice(std::uint32_t weight) {
@@ -235,30 +349,82 @@ class Sched : public Rq {
     Sched() : current(nullptr), clock(0) {}
     ~Sched() {}
 
-    void Enqueue(Pcb *pcb);
+    bool Enqueue(Pcb *pcb, std::uint32_t flags = 0);
     void Dequeue(Pcb *pcb);
+    void PutPrev(Pcb *prev, bool preempt);
     Pcb *PickNextTask();
-    void UpdateClock(std::uint64_t delta);
-    void UpdateVruntimeCurrent(std::uint64_t delta);
+    void UpdateCurr();
     bool NeedsSchedule();
+    std::uint64_t SliceLeft();
+    bool PullFrom(Sched *src, std::uint32_t cpu);
 
     std::uint32_t NrRunning() { return nr_running; }
     Pcb *GetLeftmost() { return leftmost; }
 
-    task::SpinLock lock;
+    // 远端 CPU 唤醒和负载均衡都要拿这把锁，与本 CPU 常读的字段分开
+    task::SpinLock lock CACHE_ALIGNED;
 
    private:
     task::Pcb *FirstTask(void) { return leftmost; }
+    std::uint64_t Slice();
     void UpdateVruntime(task::Pcb *pcb, std::uint64_t delta);
-    void NormalizeVruntime(task::Pcb *pcb);
+    void UpdateCurrLocked();
+    void PlaceEntity(task::Pcb *pcb, std::uint32_t flags);
+    bool CheckPreemptWakeup(task::Pcb *pcb);
+    void EnqueueLocked(task::Pcb *pcb, std::uint32_t flags = 0);
+    void DequeueLocked(task::Pcb *pcb);
+    task::Pcb *FindMovable(task::Pcb *node);
+
+    task::Pcb *current;   // 本 CPU 上正在运行的任务
+    std::uint64_t clock;  // 最近一次记账的时刻 (ns)
+};
 
-    task::Pcb *current;
-    std::uint64_t clock;
+}  // namespace cfs
+
+// 每个 CPU 的私有数据，GS 基址指向本 CPU 的这一项
+struct CACHE_ALIGNED Cpu {
+    Cpu *self;     // 偏移 0，ThisCpu() 从 %gs:0 读出
+    Pcb *current;  // 偏移 8，CurrentProc() 从 %gs:8 读出
+    Pcb *idle;
+    std::uint32_t id;  // 逻辑编号，BSP 为 0
+    std::uint32_t apic_id;
+    bool online;
+    std::uint64_t next_balance;  // 下次周期性负载均衡的时间 (时钟节拍)
+    std::uint64_t tlb_req;       // 其他 CPU 请求刷新 TLB 的次数，mm::tlb 使用
+    std::uint64_t tlb_done;      // 已完成的请求，追上 tlb_req 时请求方才返回
+    gdt::TssEntry *tss;
+    cfs::Sched sched;
 };
 
-extern Sched sched;
+extern Cpu cpus[MAX_CPUS];
+extern std::uint32_t nr_cpus;
 
-}  // namespace cfs
+inline Cpu *ThisCpu() {
+    Cpu *cpu;
+    asm volatile("movq %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+// 单条指令读取，读取期间被迁移到别的 CPU 也不会取到别人的 current
+inline Pcb *CurrentProc() {
+    Pcb *pcb;
+    asm volatile("movq %%gs:8, %0" : "=r"(pcb));
+    return pcb;
+}
+
+struct Mem {
+    PTE *pml4;
+    std::uint64_t asid;  // PCID 及其分配代数，由 mm::tlb 管理
+    mm::VmaTree vmas;    // 用户地址空间的全部区域
+
+    Pcb *owner;        // 所属进程，由 mm::stat 登记
+    Mem *prev, *next;  // 所有用户地址空间的链表，供统计遍历
+
+    std::uint32_t cpu;  // 最近一次加载这张页表的 CPU，由 mm::tlb 管理
+
+    // 修改用户页表项时持有：回收者可能在别的 CPU 上换出这个地址空间的页
+    SpinLock lock;
+};
 
 struct Pcb {
     pid_t pid;
@@ -275,32 +441,55 @@ struct Pcb {
 
     std::uint64_t tty;
 
-    std::uint64_t time_used;
+    std::uint64_t time_used;  // 本时间片内已运行的时间 (ns)
     std::int64_t exit_code;
 
     vfs::FileDescriptorTable files;
 
     // CFS
     cfs::Entity se;
+    std::uint32_t cpu;           // 所在运行队列的 CPU
+    bool on_cpu;                 // 正在某个 CPU 上运行，或其上下文尚未保存完
+    bool need_resched;           // 应尽快让出 CPU，在中断和系统调用返回前检查
+    std::int32_t preempt_count;  // 持有的自旋锁个数，非 0 时时钟中断不抢占
+    bool kill_pending;           // 已被结束，返回用户态前自己退出
 };
 
-extern Pcb *current_proc;
-extern Pcb *idle;
 extern SpinLock run_queue_lock;
 extern Pcb *run_queue_head;
 
+// 持有自旋锁、关着中断或身为 idle 任务时不能睡眠
+inline bool MaySleep() {
+    Pcb *current = CurrentProc();
+    return current != nullptr && !(current->flags & THREAD_IDLE) &&
+           current->preempt_count == 0 && irq_enabled();
+}
+
+// 等待者把自己标记为 Blocked 之后、调度走之前调用：被结束的任务不再睡眠。
+// RequestExit 先置标志再看状态，栅栏保证两边至少有一方看到对方
+inline bool KillPending(Pcb *task) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&task->kill_pending, __ATOMIC_RELAXED);
+}
+
 void Schedule();
+void Wakeup(Pcb *pcb);
+void WakeupNew(Pcb *pcb);
+void Tick();
+void Idle();
 int Service(int argc, char *argv[]);
 
-inline void SwitchTable(Pcb *next) {
-    __asm__ __volatile__("movq	%0,	%%cr3	\n\t" ::"r"(
-                             mm::Vir2Phy((std::uint64_t)next->mm.pml4))
-                         : "memory");
-}
+namespace cfs {
+bool Balance(Cpu *cpu);
+}  // namespace cfs
+
+inline void SwitchTable(Pcb *next) { mm::tlb::Switch(&next->mm); }
 
 }  // namespace task
 
+extern "C" void preempt_check_c(void);
 extern "C" void ret_syscall(void);
+extern "C" void ret_from_fork(void);
 extern "C" void enter_syscall(void);
 extern "C" void kernel_thread_entry(void);
 extern "C" void __switch_to(task::Pcb *prev, task::Pcb *next);
@@ -323,7 +512,7 @@ int SysInit(int argc, char *argv[]);
             : "=m"(prev->thread->rsp), "=m"(prev->thread->rip)           \
             : "m"(next->thread->rsp), "m"(next->thread->rip), "D"(prev), \
               "S"(next)                                                  \
-            : "memory");                                                 \
+            : "memory", "rbx", "r12", "r13", "r14", "r15");              \
     } while (false)
 
 #endif  // INFO_KERNEL_TASK_H_
@@ -0,0 +1,33 @@
+#ifndef INFO_KERNEL_TIMER_H_
+#define INFO_KERNEL_TIMER_H_
+
+#include <cstdint>
+
+#define TIMER_NEVER (~0ULL)  // Arm 的参数，以及没有待到期定时器时的到期时刻
+
+namespace timer {
+
+// 时间轮上的一个定时器，由使用者分配，回调在中断上下文中运行
+struct Timer {
+    Timer *prev, *next;     // 所在槽位的链表
+    Timer **slot;           // 所在槽位的表头，为空表示不在时间轮上
+    std::uint64_t expires;  // 到期时刻 (ms，自启动起)
+    void (*func)(Timer *timer);
+    void *data;
+    std::uint32_t cpu;  // 所在时间轮的 CPU
+};
+
+/* in kernel/timer_wheel.cc */
+void Setup(Timer *timer, void (*func)(Timer *timer), void *data);
+void Add(Timer *timer, std::uint64_t expires);
+bool Del(Timer *timer);
+void Run();
+void Arm(std::uint64_t ns);
+std::uint64_t ScheduleTimeout(std::uint64_t ms);
+void Sleep(std::uint64_t ms);
+
+inline bool Pending(const Timer *timer) { return timer->slot != nullptr; }
+
+}  // namespace timer
+
+#endif  // INFO_KERNEL_TIMER_H_
@@ -85,12 +85,13 @@ class Console {
 
         TTYState() {
             screen_buffer = reinterpret_cast<std::uint32_t *>(
-                mm::page::Alloc(video::width * video::height * video::size));
+                mm::vmalloc::Alloc(video::width * video::height *
+                                   video::size));
         }
 
         ~TTYState() {
             if (screen_buffer) {
-                mm::page::Free(screen_buffer);
+                mm::vmalloc::Free(screen_buffer);
                 screen_buffer = nullptr;
             }
         }
@@ -55,6 +55,11 @@ class File {
     std::uint64_t position;  // Current file position
     MountFs *mount;          // Mount point of this file
     void *private_data;      // File system-specific file data
+    std::uint32_t refs;      // fds and regions using it, see Hold/Close
+
+    // Allocated from the "file" slab cache
+    static void *operator new(std::size_t size);
+    static void operator delete(void *ptr);
 };
 
 #define MAX_FD 64
@@ -83,6 +88,7 @@ class FileDescriptorTable {
     int Free(int fd);
     File *Get(int fd);
     int SetFlags(int fd, std::uint32_t flags);
+    void HoldAll();
 };
 
 int FdAlloc(File *file, std::uint32_t flags);
@@ -112,8 +118,10 @@ int Mount(const char *device, const char *path, const char *fs_type,
           std::uint32_t flags);
 int Umount(const char *path);
 File *Open(const char *path, std::uint32_t flags);
+File *Hold(File *file);
 int Close(File *file);
 ssize_t Read(File *file, void *buf, std::size_t count);
+ssize_t ReadAt(File *file, void *buf, std::size_t count, std::uint64_t offset);
 ssize_t Write(File *file, const void *buf, std::size_t count);
 ssize_t Seek(File *file, std::int64_t offset, int whence);
 
@@ -0,0 +1,50 @@
+/**
+ * @file pthread.h
+ * @brief Mutexes and condition variables built on futexes
+ * @author Kumosya, 2025-2026
+ **/
+
+#ifndef _PTHREAD_H
+#define _PTHREAD_H
+
+#include <stdint.h>
+
+/* C++ compatibility */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 没有争用时加锁和解锁都只是一条原子指令，不进内核 */
+typedef struct {
+    volatile uint32_t state; /* 0 未上锁，1 已上锁，2 已上锁且可能有等待者 */
+} pthread_mutex_t;
+
+typedef struct {
+    volatile uint32_t seq;     /* 每次 signal/broadcast 加一 */
+    volatile uint32_t waiters; /* 正在等待的个数，为 0 时 signal 不进内核 */
+} pthread_cond_t;
+
+typedef int pthread_mutexattr_t;
+typedef int pthread_condattr_t;
+
+#define PTHREAD_MUTEX_INITIALIZER {0}
+#define PTHREAD_COND_INITIALIZER {0, 0}
+
+int pthread_mutex_init(pthread_mutex_t *mutex,
+                       const pthread_mutexattr_t *attr);
+int pthread_mutex_destroy(pthread_mutex_t *mutex);
+int pthread_mutex_lock(pthread_mutex_t *mutex);
+int pthread_mutex_trylock(pthread_mutex_t *mutex);
+int pthread_mutex_unlock(pthread_mutex_t *mutex);
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr);
+int pthread_cond_destroy(pthread_cond_t *cond);
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int pthread_cond_signal(pthread_cond_t *cond);
+int pthread_cond_broadcast(pthread_cond_t *cond);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PTHREAD_H */
@@ -0,0 +1,31 @@
+/**
+ * @file futex.h
+ * @brief Wait on and wake a 32-bit word in user memory
+ * @author Kumosya, 2025-2026
+ **/
+
+#ifndef _SYS_FUTEX_H
+#define _SYS_FUTEX_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* C++ compatibility */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* *addr 仍等于 val 时睡眠，直到被 futex_wake 唤醒或经过 timeout
+   (为空表示不限)。被唤醒返回 0；否则返回 -1，errno 为 EAGAIN、
+   ETIMEDOUT、EFAULT 或 EINVAL */
+int futex_wait(volatile uint32_t *addr, uint32_t val,
+               const struct timespec *timeout);
+
+/* 唤醒最多 n 个在 addr 上等待的任务，返回唤醒的个数 */
+int futex_wake(volatile uint32_t *addr, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYS_FUTEX_H */
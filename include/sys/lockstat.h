@@ -0,0 +1,39 @@
+/**
+ * @file lockstat.h
+ * @brief Spinlock contention statistics reported by the task service
+ * @author Kumosya, 2025-2026
+ **/
+
+#ifndef _SYS_LOCKSTAT_H
+#define _SYS_LOCKSTAT_H
+
+#include <stdint.h>
+
+/* C++ compatibility */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOCKSTAT_NAME_LEN 24
+#define LOCKSTAT_DUMP -1 /* 把整张表打印到内核控制台 (默认是串口) */
+
+/* 同名锁的累计值，时间单位都是 TSC 周期；内核以 LOCK_STAT=true 编译时才有 */
+struct lockstat_class {
+    char name[LOCKSTAT_NAME_LEN];
+    uint64_t acquired;
+    uint64_t contended;  /* 需要等待才获得的次数 */
+    uint64_t wait_total; /* 等待锁的总时间 */
+    uint64_t wait_max;
+    uint64_t hold_total; /* 持有锁的总时间 */
+    uint64_t hold_max;
+    uint64_t tsc_khz; /* 换算时间用的 TSC 频率 */
+};
+
+/* 按等待总时间从多到少取第 index 项写入 buf，返回 0；超出范围时返回 -1 */
+int lockstat(long index, struct lockstat_class *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYS_LOCKSTAT_H */
@@ -0,0 +1,81 @@
+/**
+ * @file meminfo.h
+ * @brief Memory statistics reported by the memory management service
+ * @author Kumosya, 2025-2026
+ **/
+
+#ifndef _SYS_MEMINFO_H
+#define _SYS_MEMINFO_H
+
+#include <stdint.h>
+
+/* C++ compatibility */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* meminfo() 查询的类别，index 的含义随类别不同 */
+#define MEMINFO_SUMMARY 0 /* 全局计数，index 不用 */
+#define MEMINFO_ORDER 1   /* 伙伴系统第 index 阶 */
+#define MEMINFO_SLAB 2    /* 第 index 个 slab cache */
+#define MEMINFO_PROC 3    /* 第 index 个用户地址空间，-1 表示调用者自己 */
+#define MEMINFO_SITE 4    /* 占用最多的第 index 个分配调用点 */
+
+#define MEMINFO_NAME_LEN 24
+
+/* 以下计数的单位都是 4KiB 页 */
+struct meminfo {
+    uint64_t total_pages;    /* 可用物理页 */
+    uint64_t free_pages;     /* 伙伴系统中的空闲页 */
+    uint64_t deferred_pages; /* 描述符尚未初始化的页 */
+    uint64_t table_pages;    /* 页表 */
+    uint64_t slab_pages;     /* slab cache */
+    uint64_t vmalloc_pages;  /* vmalloc 区域 */
+    uint64_t zero_pages;     /* 预清零页池 */
+    uint64_t lru_pages;      /* 可回收的用户页 */
+    uint64_t swap_pages;     /* 交换区容量 */
+    uint64_t swap_free;      /* 交换区空闲 */
+    uint64_t nr_orders;      /* 伙伴系统阶数 */
+    uint64_t frag_index;     /* 最高阶的碎片指数，千分比 */
+};
+
+struct meminfo_order {
+    uint64_t order;
+    uint64_t free_blocks; /* 该阶空闲块数 */
+    uint64_t used_pages;  /* 按该阶分配出去的页 */
+    uint64_t frag_index;  /* 无法满足该阶请求的空闲页比例，千分比 */
+};
+
+struct meminfo_slab {
+    char name[MEMINFO_NAME_LEN];
+    uint64_t object_size;
+    uint64_t active_objects;
+    uint64_t total_objects;
+    uint64_t slabs; /* 每个 slab 占一页 */
+};
+
+struct meminfo_proc {
+    int64_t pid;
+    uint64_t rss;         /* 驻留的页 */
+    uint64_t swapped;     /* 换出的页 */
+    uint64_t table_pages; /* 页表，包括 PML4 */
+    uint64_t vm_pages;    /* 所有区域的总大小 */
+    uint64_t nr_vmas;
+};
+
+/* 内核以 MM_TRACK_ALLOC=true 编译时才有数据 */
+struct meminfo_site {
+    uint64_t rip;    /* 内核中的调用点，0 表示其余调用点的汇总 */
+    uint64_t pages;  /* 尚未释放的页 */
+    uint64_t blocks; /* 尚未释放的分配次数 */
+    uint64_t age_ms; /* 最早一次分配至今的毫秒数 */
+};
+
+/* 结果写入 buf，返回 0；index 超出范围时返回 -1 */
+int meminfo(int what, long index, void *buf, unsigned long len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYS_MEMINFO_H */
@@ -0,0 +1,36 @@
+#ifndef _SYS_MMAN_H
+#define _SYS_MMAN_H
+
+#include <sys/types.h>
+
+/* C++ compatibility */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Protection flags */
+#define PROT_NONE 0x0  /* 不可访问 */
+#define PROT_READ 0x1  /* 可读 */
+#define PROT_WRITE 0x2 /* 可写 */
+#define PROT_EXEC 0x4  /* 可执行 */
+
+/* Mapping flags */
+#define MAP_SHARED 0x01    /* 共享映射 (目前按私有映射处理) */
+#define MAP_PRIVATE 0x02   /* 私有映射，fork 后写时复制 */
+#define MAP_FIXED 0x10     /* 必须映射到指定地址 */
+#define MAP_ANONYMOUS 0x20 /* 匿名映射，内容全零 */
+#define MAP_ANON MAP_ANONYMOUS
+
+#define MAP_FAILED ((void *)-1)
+
+/* Function declarations */
+void *mmap(void *addr, size_t length, int prot, int flags, int fd,
+           off_t offset);
+int munmap(void *addr, size_t length);
+int mprotect(void *addr, size_t length, int prot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYS_MMAN_H */
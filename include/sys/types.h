@@ -24,7 +24,7 @@ typedef int ino_t;
 typedef int nlink_t;
 typedef int blksize_t;
 typedef int blkcnt_t;
-typedef int time_t;
+typedef long time_t;
 typedef int clock_t;
 typedef unsigned int useconds_t;
 typedef int suseconds_t;
@@ -2,6 +2,7 @@
 #define LIBC_TIME_H
 
 #include <stddef.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -9,7 +10,10 @@ extern "C" {
 
 /* Types */
 
-typedef long time_t;
+struct timespec {
+    time_t tv_sec; /* seconds */
+    long tv_nsec;  /* nanoseconds [0, 999999999] */
+};
 
 struct tm {
     int tm_sec;   /* seconds after the minute [0-60] */
@@ -34,6 +38,7 @@ struct tm *gmtime(const time_t *timer);
 struct tm *localtime(const time_t *timer);
 size_t strftime(char *s, size_t maxsize, const char *format,
                 const struct tm *timeptr);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 
 #ifdef __cplusplus
 }
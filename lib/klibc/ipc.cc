@@ -60,6 +60,20 @@ extern "C" ssize_t read(int file, void *buf, std::uint64_t size) {
     return msg.num[0];
 }
 
+extern "C" ssize_t pread(int file, void *buf, std::uint64_t size,
+                         off_t offset) {
+    task::ipc::Message msg;
+    msg.dst_pid = 3;
+    msg.type    = SYS_FS_PREAD;
+    msg.num[0]  = file;
+    msg.num[1]  = reinterpret_cast<std::uint64_t>(buf);
+    msg.num[2]  = size;
+    msg.num[3]  = offset;
+    task::ipc::Send(&msg);
+    task::ipc::Receive(&msg);
+    return msg.num[0];
+}
+
 extern "C" off_t lseek(int file, off_t offset, int whence) {
     task::ipc::Message msg;
     msg.dst_pid = 3;
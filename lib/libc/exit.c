@@ -3,13 +3,21 @@
 
 #include <kernel/syscall.h>
 
+/* 直接陷入内核标记自己，内核在返回用户态前让进程退出，不会回到这里 */
 void _exit(int status) {
-    MESSAGE msg;
-    msg.num[0]  = status;
-    msgSend(SYS_TASK, SYS_TASK_EXIT, &msg);
+    __asm__ __volatile__(
+        "leaq	1f(%%rip),	%%rdx	\n"
+        "movq	%%rsp,	%%rcx		\n"
+        "sysenter			\n"
+        "1:	\n"
+        :
+        : "a"(SYS_TASK_EXIT), "D"((uint64_t)status)
+        : "rcx", "rdx", "memory");
+    for (;;) {
+    }
 }
 
 void exit(int status) {
     _exit(status);
     return;
-}
\ No newline at end of file
+}
@@ -23,6 +23,17 @@ ssize_t read(int fd, void *buf, size_t count) {
     return (ssize_t)msg.num[0];
 }
 
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    MESSAGE msg;
+    msg.num[0]  = fd;
+    msg.num[1]  = (uint64_t)buf;
+    msg.num[2]  = count;
+    msg.num[3]  = offset;
+    msgSend(SYS_FS, SYS_FS_PREAD, &msg);
+    msgRecv(NULL, SYS_FS_PREAD, &msg);
+    return (ssize_t)msg.num[0];
+}
+
 ssize_t write(int fd, const void *buf, size_t count) {
     MESSAGE msg;
     msg.num[0]  = fd;
@@ -0,0 +1,18 @@
+#include <unistd.h>
+
+#include <kernel/syscall.h>
+
+/* fork 直接陷入内核，子进程从同一返回点以 0 返回 */
+pid_t fork(void) {
+    long ret;
+    __asm__ __volatile__(
+        "leaq	__fork_ret(%%rip),	%%rdx	\n"
+        "movq	%%rsp,	%%rcx		\n"
+        "sysenter			\n"
+        "__fork_ret:	\n"
+        : "=a"(ret)
+        : "a"(SYS_FORK)
+        : "rcx", "rdx", "memory");
+
+    return ret;
+}
@@ -0,0 +1,52 @@
+#include <sys/futex.h>
+
+#include <errno.h>
+#include <kernel/syscall.h>
+
+#define FUTEX_FOREVER (~0ULL) /* 内核的 TIMER_NEVER，不限时 */
+
+/* 等待和唤醒都在调用者自己的上下文中进行，不经过 IPC */
+static int64_t futex_call(uint64_t op, uint64_t addr, uint64_t arg,
+                          uint64_t ns) {
+    int64_t ret;
+    __asm__ __volatile__(
+        "movq	%4,	%%r8		\n"
+        "leaq	1f(%%rip),	%%rdx	\n"
+        "movq	%%rsp,	%%rcx		\n"
+        "sysenter			\n"
+        "1:	\n"
+        : "=a"(ret)
+        : "a"(op), "D"(addr), "S"(arg), "r"(ns)
+        : "rcx", "rdx", "r8", "memory");
+
+    return ret;
+}
+
+int futex_wait(volatile uint32_t *addr, uint32_t val,
+               const struct timespec *timeout) {
+    uint64_t ns = FUTEX_FOREVER;
+    if (timeout != NULL) {
+        if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 ||
+            timeout->tv_nsec >= 1000000000) {
+            errno = EINVAL;
+            return -1;
+        }
+        ns = (uint64_t)timeout->tv_sec * 1000000000 + timeout->tv_nsec;
+    }
+
+    int64_t ret = futex_call(SYS_FUTEX_WAIT, (uint64_t)addr, val, ns);
+    if (ret < 0) {
+        errno = (int)-ret;
+        return -1;
+    }
+    return 0;
+}
+
+int futex_wake(volatile uint32_t *addr, int n) {
+    int64_t ret = futex_call(SYS_FUTEX_WAKE, (uint64_t)addr, n, 0);
+    if (ret < 0) {
+        errno = (int)-ret;
+        return -1;
+    }
+    return (int)ret;
+}
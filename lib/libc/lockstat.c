@@ -0,0 +1,15 @@
+#include <sys/lockstat.h>
+
+#include <kernel/syscall.h>
+#include <string.h>
+
+int lockstat(long index, struct lockstat_class *buf) {
+    MESSAGE msg;
+    msg.num[0] = index;
+    msgSend(SYS_TASK, SYS_TASK_LOCKSTAT, &msg);
+    msgRecv(NULL, SYS_TASK_LOCKSTAT, &msg);
+    if ((int64_t)msg.num[0] != 0) return -1;
+
+    if (buf != NULL) memcpy(buf, &msg.num[1], sizeof(*buf));
+    return 0;
+}
@@ -0,0 +1,19 @@
+#include <sys/meminfo.h>
+
+#include <kernel/syscall.h>
+#include <string.h>
+
+int meminfo(int what, long index, void *buf, unsigned long len) {
+    MESSAGE msg;
+    msg.num[0] = what;
+    msg.num[1] = index;
+    msgSend(SYS_MM, SYS_MM_MEMINFO, &msg);
+    msgRecv(NULL, SYS_MM_MEMINFO, &msg);
+    if ((int64_t)msg.num[0] != 0) return -1;
+
+    if (len > sizeof(msg) - sizeof(msg.num[0])) {
+        len = sizeof(msg) - sizeof(msg.num[0]);
+    }
+    memcpy(buf, &msg.num[1], len);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include <sys/mman.h>
+
+#include <kernel/syscall.h>
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd,
+           off_t offset) {
+    MESSAGE msg;
+    msg.num[0] = (uint64_t)addr;
+    msg.num[1] = length;
+    msg.num[2] = prot;
+    msg.num[3] = flags;
+    msg.num[4] = fd;
+    msg.num[5] = offset;
+    msgSend(SYS_MM, SYS_MM_MMAP, &msg);
+    msgRecv(NULL, SYS_MM_MMAP, &msg);
+    return (void *)msg.num[0];
+}
+
+int munmap(void *addr, size_t length) {
+    MESSAGE msg;
+    msg.num[0] = (uint64_t)addr;
+    msg.num[1] = length;
+    msgSend(SYS_MM, SYS_MM_MUNMAP, &msg);
+    msgRecv(NULL, SYS_MM_MUNMAP, &msg);
+    return (int)msg.num[0];
+}
+
+int mprotect(void *addr, size_t length, int prot) {
+    MESSAGE msg;
+    msg.num[0] = (uint64_t)addr;
+    msg.num[1] = length;
+    msg.num[2] = prot;
+    msgSend(SYS_MM, SYS_MM_MPROTECT, &msg);
+    msgRecv(NULL, SYS_MM_MPROTECT, &msg);
+    return (int)msg.num[0];
+}
@@ -0,0 +1,93 @@
+#include <pthread.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/futex.h>
+
+int pthread_mutex_init(pthread_mutex_t *mutex,
+                       const pthread_mutexattr_t *attr) {
+    (void)attr;
+    mutex->state = 0;
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex) {
+    return mutex->state != 0 ? EBUSY : 0;
+}
+
+/* 0 -> 1 成功就拿到了锁；否则把状态改成 2 再睡，解锁者看到 2 才进内核唤醒 */
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    uint32_t c = 0;
+    if (__atomic_compare_exchange_n(&mutex->state, &c, 1, 0, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    if (c != 2) c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+    while (c != 0) {
+        futex_wait(&mutex->state, 2, NULL);
+        c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+    }
+    return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+    uint32_t c = 0;
+    if (__atomic_compare_exchange_n(&mutex->state, &c, 1, 0, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    return EBUSY;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+    if (__atomic_exchange_n(&mutex->state, 0, __ATOMIC_RELEASE) == 2) {
+        futex_wake(&mutex->state, 1);
+    }
+    return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr) {
+    (void)attr;
+    cond->seq     = 0;
+    cond->waiters = 0;
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond) {
+    return cond->waiters != 0 ? EBUSY : 0;
+}
+
+/* 解锁前记下 seq：之后的 signal 会改变它，futex_wait 就不会睡下去 */
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    uint32_t seq = __atomic_load_n(&cond->seq, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cond->waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(mutex);
+
+    futex_wait(&cond->seq, seq, NULL);
+    __atomic_fetch_sub(&cond->waiters, 1, __ATOMIC_RELAXED);
+
+    /* 醒来时可能还有别的等待者，按有争用的方式重新加锁，解锁时才会唤醒它们 */
+    uint32_t c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+    while (c != 0) {
+        futex_wait(&mutex->state, 2, NULL);
+        c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+    }
+    return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t *cond) {
+    __atomic_fetch_add(&cond->seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cond->waiters, __ATOMIC_SEQ_CST) != 0) {
+        futex_wake(&cond->seq, 1);
+    }
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond) {
+    __atomic_fetch_add(&cond->seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cond->waiters, __ATOMIC_SEQ_CST) != 0) {
+        futex_wake(&cond->seq, INT_MAX);
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <kernel/syscall.h>
+
+/* 睡眠直接陷入内核，由调用者自己阻塞；返回未睡完的纳秒数 */
+static uint64_t sleep_ns(uint64_t ns) {
+    uint64_t ret;
+    __asm__ __volatile__(
+        "leaq	1f(%%rip),	%%rdx	\n"
+        "movq	%%rsp,	%%rcx		\n"
+        "sysenter			\n"
+        "1:	\n"
+        : "=a"(ret)
+        : "a"(SYS_TASK_SLEEP), "D"(ns)
+        : "rcx", "rdx", "memory");
+
+    return ret;
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+    if (req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint64_t left = sleep_ns((uint64_t)req->tv_sec * 1000000000 + req->tv_nsec);
+    if (rem != NULL) {
+        rem->tv_sec  = left / 1000000000;
+        rem->tv_nsec = left % 1000000000;
+    }
+    return 0;
+}
+
+unsigned int sleep(unsigned int seconds) {
+    uint64_t left = sleep_ns((uint64_t)seconds * 1000000000);
+    return (left + 999999999) / 1000000000;
+}
+
+int usleep(useconds_t useconds) {
+    sleep_ns((uint64_t)useconds * 1000);
+    return 0;
+}
@@ -6,6 +6,7 @@
 
 #include "kernel/ide.h"
 #include "kernel/io.h"
+#include "kernel/slab.h"
 #include "kernel/syscall.h"
 #include "kernel/task.h"
 #include "kernel/tty.h"
@@ -15,10 +16,30 @@ namespace block {
 
 BlockDevice *device_list = nullptr;
 
+static mm::slab::Cache *bio_cache     = nullptr;
+static mm::slab::Cache *request_cache = nullptr;
+
+void *Bio::operator new(std::size_t size) {
+    if (bio_cache == nullptr) return mm::slab::Alloc(size);
+    return bio_cache->Alloc();
+}
+
+void Bio::operator delete(void *ptr) { mm::slab::Free(ptr); }
+
+void *Request::operator new(std::size_t size) {
+    if (request_cache == nullptr) return mm::slab::Alloc(size);
+    return request_cache->Alloc();
+}
+
+void Request::operator delete(void *ptr) { mm::slab::Free(ptr); }
+
 int Service(int argc, char *argv[]) {
     device_list = nullptr;
     bool reply;
 
+    bio_cache     = mm::slab::CreateCache("bio", sizeof(Bio), nullptr);
+    request_cache = mm::slab::CreateCache("request", sizeof(Request), nullptr);
+
     ide::Init();
 
     task::ipc::Message msg;
@@ -40,7 +61,7 @@ int Service(int argc, char *argv[]) {
             }
             if (reply) {
                 msg.dst_pid = msg.sender->pid;
-                msg.sender  = task::current_proc;
+                msg.sender  = task::CurrentProc();
                 task::ipc::Send(&msg);
             }
         }
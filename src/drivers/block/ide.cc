@@ -8,6 +8,7 @@
 #include "kernel/block.h"
 #include "kernel/io.h"
 #include "kernel/task.h"
+#include "kernel/timer.h"
 #include "kernel/tty.h"
 
 namespace ide {
@@ -25,40 +26,55 @@ class IDEDeviceController {
     block::IDEBlockDevice *ide_dev;
 };
 
-static task::SpinLock ide_lock;
+static task::Mutex ide_lock;     // 控制器同一时刻只执行一条命令
+static task::WaitQueue ide_irq;  // 等待驱动器中断的任务
 static IDEDeviceController *devices[4];
 static int device_count = 0;
 
-static void WaitReady(std::uint16_t io_base) {
-    int t = timer::GetTicks();
-    while ((timer::GetTicks() - t) * 1000 / TIMER_FREQUENCY < IDE_TIMEOUT) {
-        std::uint8_t status = inb(io_base + IDE_STATUS);
-        if (!(status & IDE_STATUS_BSY) && (status & IDE_STATUS_DRDY)) {
-            return;
+// Wait until the bits in mask of the status register read as want, for
+// at most IDE_TIMEOUT ms. The first IDE_SPIN_POLLS reads are back to back,
+// since a drive is usually quick; after that a caller that may sleep
+// blocks until the drive interrupts, rechecking every IDE_POLL_MS in case
+// the change raises no interrupt. Returns false on timeout.
+static bool WaitStatus(std::uint16_t io_base, std::uint8_t mask,
+                       std::uint8_t want) {
+    std::uint64_t deadline = timer::Millis() + IDE_TIMEOUT;
+    task::WaitEntry wait;
+    bool ready = false;
+
+    for (int polls = 0;; polls++) {
+        if ((inb(io_base + IDE_STATUS) & mask) == want) {
+            ready = true;
+            break;
+        }
+        std::uint64_t now = timer::Millis();
+        if (now >= deadline) break;
+
+        if (polls < IDE_SPIN_POLLS || !task::MaySleep()) {
+            asm volatile("pause");
+            continue;
+        }
+        // 入队后再读一次状态，其间到来的中断不会被错过
+        ide_irq.Prepare(&wait);
+        if ((inb(io_base + IDE_STATUS) & mask) != want) {
+            std::uint64_t left = deadline - now;
+            timer::ScheduleTimeout(left < IDE_POLL_MS ? left : IDE_POLL_MS);
         }
     }
+    ide_irq.Finish(&wait);
+    return ready;
+}
+
+static void WaitReady(std::uint16_t io_base) {
+    WaitStatus(io_base, IDE_STATUS_BSY | IDE_STATUS_DRDY, IDE_STATUS_DRDY);
 }
 
 static void WaitDrq(std::uint16_t io_base) {
-    int t = timer::GetTicks();
-    while ((timer::GetTicks() - t) * 1000 / TIMER_FREQUENCY < IDE_TIMEOUT) {
-        std::uint8_t status = inb(io_base + IDE_STATUS);
-        if (status & IDE_STATUS_DRQ) {
-            return;
-        }
-        // task::ipc::Send(&msg);
-    }
+    WaitStatus(io_base, IDE_STATUS_DRQ, IDE_STATUS_DRQ);
 }
 
 static void WaitNotBusy(std::uint16_t io_base) {
-    int t = timer::GetTicks();
-    while ((timer::GetTicks() - t) * 1000 / TIMER_FREQUENCY < IDE_TIMEOUT) {
-        std::uint8_t status = inb(io_base + IDE_STATUS);
-        if (!(status & IDE_STATUS_BSY)) {
-            return;
-        }
-        // task::ipc::Send(&msg);
-    }
+    WaitStatus(io_base, IDE_STATUS_BSY, 0);
 }
 
 static int Identify(std::uint16_t io_base, std::uint8_t drive,
@@ -172,9 +188,8 @@ int IDEDeviceWrite(block::IDEBlockDevice *dev, std::uint16_t io_base,
     return 0;
 }
 
+// 只在启动时运行；Identify 自己持有 ide_lock，这里不能再加锁
 static void DetectDevices(std::uint16_t io_base, std::uint8_t irq) {
-    ide_lock.lock();
-
     for (std::uint8_t drive = 0; drive < 2; drive++) {
         std::uint16_t identify_data[256];
         int ret = Identify(io_base, drive, identify_data);
@@ -212,12 +227,25 @@ static void DetectDevices(std::uint16_t io_base, std::uint8_t irq) {
             //            device_name, sectors);
         }
     }
-    ide_lock.unlock();
 }
 
 void Init() {
+    pic::UnmaskIrq(2);  // 从片级联
+    pic::UnmaskIrq(14);
+    pic::UnmaskIrq(15);
+
     DetectDevices(IDE_PRIMARY_IO, 14);
     DetectDevices(IDE_SECONDARY_IO, 15);
 }
 
 }  // namespace ide
+
+// Shared by both channels: reading the status registers acknowledges the
+// drives, and the waiters look at their own channel again.
+extern "C" void ide_handler_c() {
+    inb(IDE_PRIMARY_IO + IDE_STATUS);
+    inb(IDE_SECONDARY_IO + IDE_STATUS);
+    outb(PIC2_CMD, 0x20);
+    outb(PIC1_CMD, 0x20);
+    ide::ide_irq.WakeAll();
+}
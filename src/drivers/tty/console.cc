@@ -10,7 +10,8 @@
 
 namespace tty {
 
-task::SpinLock tty_lock;
+// 绘制像素时一直持有，只在任务上下文中使用
+task::Mutex tty_lock;
 
 int Service(int argc, char *argv[]) {
     Console con;
@@ -45,17 +46,13 @@ int Service(int argc, char *argv[]) {
                     reply = false;
                     break;
                 case SYS_CHAR_GETCHAR:
-                    while (true) {
-                        status = keyboard::kbd_buffer.Peek(&c);
-                        if (status) {
-                            msg.dst_pid = msg.sender->pid;
-                            msg.sender  = task::current_proc;
-                            msg.type    = 0;
-                            msg.num[0]  = c;
-                            msg.num[1]  = status;
-                            break;
-                        }
-                    }
+                    c           = keyboard::kbd_buffer.Get();
+                    status      = true;
+                    msg.dst_pid = msg.sender->pid;
+                    msg.sender  = task::CurrentProc();
+                    msg.type    = 0;
+                    msg.num[0]  = c;
+                    msg.num[1]  = status;
                     break;
                 default:
                     tty::Panic("Unknown message type: %d\n", msg.type);
@@ -71,15 +68,41 @@ int Service(int argc, char *argv[]) {
 
 static Console *g_console = nullptr;
 
+static task::WaitQueue switch_wait;
+static int pending_tty;  // 键盘中断请求切换到的终端，0 表示没有
+
+// 在键盘中断中调用。重绘整屏太慢，也不能在中断里拿 tty_lock，交给
+// SwitchThread 去做
 void TTYSwitchCallbackImpl(int tty_num) {
-    if (g_console) {
-        g_console->SwitchTTY(tty_num);
+    __atomic_store_n(&pending_tty, tty_num, __ATOMIC_RELEASE);
+    switch_wait.WakeOne();
+}
+
+// Carry out the terminal switches requested by the keyboard interrupt.
+static int SwitchThread(int argc, char *argv[]) {
+    task::WaitEntry wait;
+
+    while (true) {
+        switch_wait.Prepare(&wait);
+        int tty_num = __atomic_exchange_n(&pending_tty, 0, __ATOMIC_ACQUIRE);
+        if (tty_num == 0) {
+            task::Schedule();
+            continue;
+        }
+        switch_wait.Finish(&wait);
+
+        if (g_console) {
+            g_console->SwitchTTY(tty_num);
+        }
     }
+    return 0;
 }
 
 void Console::Init() {
     tty_lock.lock();
     g_console = this;
+    task::thread::KernelThread(reinterpret_cast<std::int64_t *>(SwitchThread),
+                               "tty-switch", -5, 0);
     keyboard::SetTTYSwitchCallback(TTYSwitchCallbackImpl);
     if (video::type == FRAMEBUFFER_TYPE_RGB) {
         for (int t = 0; t < NUM_TTYS; t++) {
@@ -98,8 +121,10 @@ void Console::SetFont(FontData *font) { fontdata_ = font; }
 
 void Console::SwitchTTY(int tty_num) {
     tty_lock.lock();
-    if (tty_num < 1 || tty_num > NUM_TTYS) return;
-    if (tty_num == current_tty_) return;
+    if (tty_num < 1 || tty_num > NUM_TTYS || tty_num == current_tty_) {
+        tty_lock.unlock();
+        return;
+    }
 
     ttys_[current_tty_ - 1].need_redraw = true;
     current_tty_                        = tty_num;
@@ -136,7 +161,10 @@ void Console::PutChar(int tty_num, char c, std::uint32_t color) {
     TTYState &tty     = ttys_[n];
     std::uint32_t *fb = (std::uint32_t *)FRAMEBUFFER_BASE;
 
-    if (!tty.screen_buffer || !fontdata_) return;
+    if (!tty.screen_buffer || !fontdata_) {
+        tty_lock.unlock();
+        return;
+    }
 
     if (tty.xpos >= video::width) {
         tty.xpos = 0;
@@ -27,7 +27,7 @@ void SetTTYSwitchCallback(TTYSwitchCallback callback) {
 }
 
 InputQueue kbd_buffer;
-task::SpinLock kbd_lock;
+task::SpinLock kbd_lock CACHE_ALIGNED;
 
 void InputQueue::ProcessScancode(std::uint8_t sc) {
     bool release      = (sc & 0x80) != 0;
@@ -120,23 +120,27 @@ char InputQueue::ScancodeToChar(std::uint8_t scancode, bool shift) {
     return c;
 }
 
+// 在键盘中断中调用
 void InputQueue::Insert(char c) {
-    // kbd_lock.lock();
+    kbd_lock.lock();
 
-    if (count < KBD_BUFFER_SIZE - 1) {
+    bool inserted = count < KBD_BUFFER_SIZE - 1;
+    if (inserted) {
         buffer[tail] = c;
         tail         = (tail + 1) % KBD_BUFFER_SIZE;
         count++;
     }
 
-    // kbd_lock.unlock();
+    kbd_lock.unlock();
+
+    if (inserted) readers.WakeOne();
 }
 
 bool InputQueue::Peek(char *c) {
-    kbd_lock.lock();
+    std::uint64_t flags = kbd_lock.lock_irqsave();
 
     if (count == 0) {
-        kbd_lock.unlock();
+        kbd_lock.unlock_irqrestore(flags);
         return false;
     }
 
@@ -144,11 +148,26 @@ bool InputQueue::Peek(char *c) {
     head = (head + 1) % KBD_BUFFER_SIZE;
     count--;
 
-    kbd_lock.unlock();
+    kbd_lock.unlock_irqrestore(flags);
 
     return true;
 }
 
+// Take the next character, blocking until a key is pressed.
+char InputQueue::Get() {
+    task::WaitEntry wait;
+    char c;
+
+    while (true) {
+        readers.Prepare(&wait, true);
+        if (Peek(&c)) break;
+        task::Schedule();
+    }
+    readers.Finish(&wait);
+
+    return c;
+}
+
 bool InputQueue::HasData() {
     bool result;
     // kbd_lock.lock();
@@ -176,6 +195,7 @@ std::uint64_t InputQueue::ReadBuffer(void *buf, std::uint64_t size) {
 }
 
 void Init() {
+    kbd_lock.SetName("keyboard");
     kbd_buffer.Init();
     pic::UnmaskIrq(1);
 }
@@ -41,12 +41,10 @@ void Init(std::uint8_t *addr) {
             size = sizeof(std::uint16_t);
         }
 
-        for (int addr = 0; addr < height * width * size; addr += PAGE_SIZE) {
-            mm::page::Map(
-                mm::page::kernel_pml4, (std::uint64_t)(FRAMEBUFFER_BASE + addr),
-                (std::uint64_t)(buf_tag->common.framebuffer_addr + addr),
-                PTE_PRESENT | PTE_WRITABLE);
-        }
+        mm::page::MapRange(mm::page::kernel_pml4, FRAMEBUFFER_BASE,
+                           buf_tag->common.framebuffer_addr,
+                           height * width * size,
+                           PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL, MAP_LARGE);
     } else {
         // Fallback to default VGA text mode address and size
         type   = FRAMEBUFFER_TYPE_EGA_TEXT;
@@ -54,11 +52,9 @@ void Init(std::uint8_t *addr) {
         height = VIDEO_HEIGHT;
         width  = VIDEO_WIDTH;
 
-        for (int addr = 0; addr < height * width * size; addr += PAGE_SIZE) {
-            mm::page::Map(
-                mm::page::kernel_pml4, (std::uint64_t)(FRAMEBUFFER_BASE + addr),
-                (std::uint64_t)(VIDEO_ADDR + addr), PTE_PRESENT | PTE_WRITABLE);
-        }
+        mm::page::MapRange(mm::page::kernel_pml4, FRAMEBUFFER_BASE,
+                           VIDEO_ADDR, height * width * size,
+                           PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL);
     }
 
     /*if (type == FRAMEBUFFER_TYPE_RGB) {
@@ -97,9 +97,8 @@ std::uint32_t AllocBlock(block::BlockDevice *dev, Ext2SuperBlock *sb,
 
                 std::uint32_t block = start_block + block_in_group;
                 std::uint8_t *zero_buf =
-                    (std::uint8_t *)mm::page::Alloc(block_size);
+                    (std::uint8_t *)mm::page::Alloc(block_size, GFP_ZERO);
                 if (zero_buf) {
-                    memset(zero_buf, 0, block_size);
                     WriteBlock(dev, sb, block, zero_buf, ext2_lba);
                     mm::page::Free(zero_buf);
                 }
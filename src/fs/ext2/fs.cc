@@ -6,6 +6,7 @@
 #include "kernel/block.h"
 #include "kernel/fs/ext2.h"
 #include "kernel/mm.h"
+#include "kernel/slab.h"
 #include "kernel/tty.h"
 #include "kernel/vfs.h"
 
@@ -21,8 +22,20 @@ struct Ext2MountData {
 struct Ext2FileData {
     std::uint32_t inode_num;
     Ext2Inode inode;
+
+    static void *operator new(std::size_t size);
+    static void operator delete(void *ptr);
 };
 
+static mm::slab::Cache *ext2_file_cache = nullptr;
+
+void *Ext2FileData::operator new(std::size_t size) {
+    if (ext2_file_cache == nullptr) return mm::slab::Alloc(size);
+    return ext2_file_cache->Alloc();
+}
+
+void Ext2FileData::operator delete(void *ptr) { mm::slab::Free(ptr); }
+
 MountFs *Ext2Mount(FileSystem *fs, const char *device, const char *path,
                    std::uint32_t flags) {
     std::uint32_t partition_num = 0;
@@ -464,6 +477,9 @@ int Ext2Stat(MountFs *mount, const char *path, void *statbuf) {
 }
 
 void RegisterFileSystems() {
+    ext2_file_cache =
+        mm::slab::CreateCache("ext2_file", sizeof(Ext2FileData), nullptr);
+
     FileSystem *ext2_fs =
         reinterpret_cast<FileSystem *>(mm::page::Alloc(sizeof(FileSystem)));
     if (ext2_fs) {
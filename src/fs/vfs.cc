@@ -7,6 +7,7 @@
 
 #include "kernel/block.h"
 #include "kernel/fs/ext2.h"
+#include "kernel/slab.h"
 #include "kernel/syscall.h"
 #include "kernel/task.h"
 #include "kernel/tty.h"
@@ -16,6 +17,15 @@ namespace vfs {
 FileSystem *registered_filesystems = nullptr;
 MountFs *mount_points              = nullptr;
 
+static mm::slab::Cache *file_cache = nullptr;
+
+void *File::operator new(std::size_t size) {
+    if (file_cache == nullptr) return mm::slab::Alloc(size);
+    return file_cache->Alloc();
+}
+
+void File::operator delete(void *ptr) { mm::slab::Free(ptr); }
+
 int FileDescriptorTable::Alloc(File *file, std::uint32_t flags) {
     for (std::uint32_t i = 5; i < MAX_FD; i++) {
         if (!fds[i].used) {
@@ -56,25 +66,34 @@ int FileDescriptorTable::SetFlags(int fd, std::uint32_t flags) {
     return 0;
 }
 
+// fork 复制了整张表，每个打开的文件多了一个使用者
+void FileDescriptorTable::HoldAll() {
+    for (std::uint32_t i = 0; i < MAX_FD; i++) {
+        if (fds[i].used) Hold(fds[i].file);
+    }
+}
+
 int FdAlloc(File *file, std::uint32_t flags) {
-    return task::current_proc->files.Alloc(file, flags);
+    return task::CurrentProc()->files.Alloc(file, flags);
 }
 
-int FdFree(int fd) { return task::current_proc->files.Free(fd); }
+int FdFree(int fd) { return task::CurrentProc()->files.Free(fd); }
 
-File *FdGet(int fd) { return task::current_proc->files.Get(fd); }
+File *FdGet(int fd) { return task::CurrentProc()->files.Get(fd); }
 
 int FdDup(int oldfd) {
     File *file = FdGet(oldfd);
     if (!file) {
         return -1;
     }
-    return FdAlloc(file, task::current_proc->files.fds[oldfd].flags);
+    int fd = FdAlloc(file, task::CurrentProc()->files.fds[oldfd].flags);
+    if (fd >= 0) Hold(file);
+    return fd;
 }
 
 int FdDup2(int oldfd, int newfd) {
     if (oldfd < 0 || oldfd >= MAX_FD ||
-        !task::current_proc->files.fds[oldfd].used) {
+        !task::CurrentProc()->files.fds[oldfd].used) {
         return -1;
     }
     if (newfd < 0 || newfd >= MAX_FD) {
@@ -83,16 +102,20 @@ int FdDup2(int oldfd, int newfd) {
     if (oldfd == newfd) {
         return newfd;
     }
-    task::current_proc->files.fds[newfd].used =
-        task::current_proc->files.fds[oldfd].used;
-    task::current_proc->files.fds[newfd].file =
-        task::current_proc->files.fds[oldfd].file;
-    task::current_proc->files.fds[newfd].flags =
-        task::current_proc->files.fds[oldfd].flags;
+    // newfd 原来打开的文件先关闭
+    task::CurrentProc()->files.Free(newfd);
+    Hold(task::CurrentProc()->files.fds[oldfd].file);
+    task::CurrentProc()->files.fds[newfd].used =
+        task::CurrentProc()->files.fds[oldfd].used;
+    task::CurrentProc()->files.fds[newfd].file =
+        task::CurrentProc()->files.fds[oldfd].file;
+    task::CurrentProc()->files.fds[newfd].flags =
+        task::CurrentProc()->files.fds[oldfd].flags;
     return newfd;
 }
 
 int Service(int argc, char *argv[]) {
+    file_cache = mm::slab::CreateCache("file", sizeof(File), nullptr);
     RegisterFileSystems();
 
     // Wait for block devices to initialize
@@ -165,6 +188,18 @@ int Service(int argc, char *argv[]) {
                     msg.num[0] = ret;
                     break;
                 }
+                case SYS_FS_PREAD: {
+                    int fd      = static_cast<int>(msg.num[0]);
+                    File *f     = msg.sender->files.Get(fd);
+                    ssize_t ret = -1;
+                    if (f) {
+                        ret = ReadAt(f, reinterpret_cast<void *>(msg.num[1]),
+                                     static_cast<std::uint64_t>(msg.num[2]),
+                                     static_cast<std::uint64_t>(msg.num[3]));
+                    }
+                    msg.num[0] = ret;
+                    break;
+                }
                 case SYS_FS_WRITE: {
                     int fd      = static_cast<int>(msg.num[0]);
                     File *f     = msg.sender->files.Get(fd);
@@ -200,6 +235,7 @@ int Service(int argc, char *argv[]) {
                     if (f) {
                         newfd = msg.sender->files.Alloc(
                             f, msg.sender->files.fds[oldfd].flags);
+                        if (newfd >= 0) Hold(f);
                     }
                     msg.num[0] = newfd;
                     break;
@@ -210,6 +246,24 @@ int Service(int argc, char *argv[]) {
                     msg.num[0] = FdDup2(oldfd, newfd);
                     break;
                 }
+                case SYS_FS_PAGEIN: {
+                    // 文件由区域持有，不经过请求方可以随意关闭的 fd
+                    mm::Vma *vma =
+                        mm::vma::Find(&msg.sender->mm.vmas, msg.num[0]);
+                    ssize_t ret = -1;
+                    if (vma && vma->file) {
+                        std::uint64_t off =
+                            (msg.num[0] & PAGE_MASK) - vma->start;
+                        std::uint64_t len = 0;
+                        if (off < vma->file_size) len = vma->file_size - off;
+                        if (len > PAGE_SIZE) len = PAGE_SIZE;
+                        ret = ReadAt(vma->file,
+                                     reinterpret_cast<void *>(msg.num[1]),
+                                     len, vma->offset + off);
+                    }
+                    msg.num[0] = ret;
+                    break;
+                }
                 case SYS_FS_OPENDIR:
                     // msg.num[0] = reinterpret_cast<uint64_t>(
                     //     Opendir(msg.s.str, msg.s.arg));
@@ -229,7 +283,7 @@ int Service(int argc, char *argv[]) {
             }
             if (reply) {
                 msg.dst_pid = msg.sender->pid;
-                msg.sender  = task::current_proc;
+                msg.sender  = task::CurrentProc();
                 task::ipc::Send(&msg);
             }
         }
@@ -367,14 +421,26 @@ File *Open(const char *path, std::uint32_t flags) {
     }
 
     file->mount = mount;
+    file->refs  = 1;
+
+    return file;
+}
 
+// Take another reference to an open file, for a second descriptor or a
+// memory region backed by it. Each one is dropped with Close.
+File *Hold(File *file) {
+    if (file) __atomic_fetch_add(&file->refs, 1, __ATOMIC_RELAXED);
     return file;
 }
 
+// Drop a reference; the file system only closes the file with the last.
 int Close(File *file) {
     if (!file) {
         return -1;
     }
+    if (__atomic_sub_fetch(&file->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return 0;
+    }
 
     MountFs *mount = file->mount;
     if (!mount || !mount->close) {
@@ -402,6 +468,20 @@ ssize_t Read(File *file, void *buf, std::size_t count) {
     return ret;
 }
 
+// Read at an explicit offset without moving the file position.
+ssize_t ReadAt(File *file, void *buf, std::size_t count, std::uint64_t offset) {
+    if (!file || !buf || count == 0) {
+        return -1;
+    }
+
+    MountFs *mount = file->mount;
+    if (!mount || !mount->read) {
+        return -2;
+    }
+
+    return mount->read(file, buf, count, offset);
+}
+
 ssize_t Write(File *file, const void *buf, std::size_t count) {
     if (!file || !buf || count == 0) {
         return -1;
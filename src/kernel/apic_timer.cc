@@ -0,0 +1,98 @@
+/**
+ * @file apic_timer.cc
+ * @brief Local APIC timer clock events
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+
+#include "kernel/cpu.h"
+#include "kernel/io.h"
+#include "kernel/smp.h"
+#include "kernel/task.h"
+#include "kernel/tty.h"
+
+namespace timer {
+
+#define CALIBRATE_MS 10
+#define TIMER_DIV_16 0x3
+#define NS_PER_MS 1000000ULL
+
+static std::uint64_t lapic_khz;  // APIC 定时器 16 分频后的频率，0 表示未启用
+static bool tsc_deadline;
+
+// Count APIC timer ticks over CALIBRATE_MS of the calibrated TSC.
+static void Calibrate() {
+    std::uint64_t flags = irq_save();
+
+    smp::LapicWrite(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    smp::LapicWrite(LAPIC_LVT_TIMER, LVT_MASKED);
+    smp::LapicWrite(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    std::uint64_t end = rdtsc() + TscKhz() * CALIBRATE_MS;
+    while (rdtsc() < end) {
+        asm volatile("pause");
+    }
+    std::uint32_t count = 0xFFFFFFFF - smp::LapicRead(LAPIC_TIMER_CUR);
+    smp::LapicWrite(LAPIC_TIMER_INIT, 0);
+
+    irq_restore(flags);
+    lapic_khz = count / CALIBRATE_MS;
+}
+
+// Set up the APIC timer of the calling CPU in one-shot or TSC-deadline
+// mode. The first call, on the BSP, calibrates the APIC timer and stops
+// the PIT, whose periodic tick the APIC timers replace.
+void InitLocal() {
+    if (lapic_khz == 0) {
+        std::uint32_t eax, ebx, ecx, edx;
+        cpuid(1, eax, ebx, ecx, edx);
+        tsc_deadline = (ecx & CPUID_TSC_DEADLINE) != 0;
+
+        Calibrate();
+        pic::MaskIrq(0);
+        tty::printk("Timer: APIC timer %d kHz, %s mode.\n", lapic_khz,
+                    tsc_deadline ? "TSC-deadline" : "one-shot");
+    }
+
+    smp::LapicWrite(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    if (tsc_deadline) {
+        smp::LapicWrite(LAPIC_LVT_TIMER, LVT_TSC_DEADLINE | VECTOR_TIMER);
+        // 写 LVT 与写 IA32_TSC_DEADLINE 之间需要串行化
+        asm volatile("mfence" ::: "memory");
+    } else {
+        smp::LapicWrite(LAPIC_LVT_TIMER, VECTOR_TIMER);
+    }
+
+    task::ThisCpu()->next_balance = GetTicks() + BALANCE_TICKS;
+    Program(TIMER_PERIOD * NS_PER_MS);
+}
+
+// Raise one timer interrupt on this CPU ns nanoseconds from now, replacing
+// any expiry programmed before.
+void Program(std::uint64_t ns) {
+    if (lapic_khz == 0) return;
+
+    if (tsc_deadline) {
+        wrmsr(MSR_TSC_DEADLINE, rdtsc() + NsToCycles(ns) + 1);
+        return;
+    }
+    std::uint64_t count = ns / NS_PER_MS * lapic_khz +
+                          ns % NS_PER_MS * lapic_khz / NS_PER_MS;
+    if (count > 0xFFFFFFFF) count = 0xFFFFFFFF;
+    if (count == 0) count = 1;
+    smp::LapicWrite(LAPIC_TIMER_INIT, count);
+}
+
+// Cancel the pending expiry so an idle CPU is left alone until an
+// interrupt or IPI wakes it.
+void Stop() {
+    if (lapic_khz == 0) return;
+
+    if (tsc_deadline) {
+        wrmsr(MSR_TSC_DEADLINE, 0);
+    } else {
+        smp::LapicWrite(LAPIC_TIMER_INIT, 0);
+    }
+}
+
+}  // namespace timer
@@ -1,124 +1,187 @@
 #include <cstdint>
 
+#include "kernel/io.h"
 #include "kernel/multiboot2.h"
 #include "kernel/page.h"
 #include "kernel/start.h"
 
 FrameMem pm;
+BootMapStats boot_map_stats;
+
+// head.S 中的引导 PDPT
+extern PTE boot_pdpt[] __asm__("pt");
 
 namespace boot::mm {
 
+// 引导页表最多能用 1GiB 页覆盖 512GiB 物理内存，更高处的内存暂不使用
+#define BOOT_MAP_LIMIT (512ULL << 30)
+
 static std::uint64_t Vir2Phy(std::uint64_t virt) {
     return virt - IDENTITY_BASE;
 }
 
 static std::uint64_t Phy2Vir(std::uint64_t phy) { return phy + IDENTITY_BASE; }
 
+// 物理内存中不能交给分配器的区间
+struct Range {
+    std::uint64_t start;
+    std::uint64_t end;
+};
+
+#define MAX_RESERVED 2
+static Range reserved[MAX_RESERVED];
+static int nr_reserved = 0;
+
+// 为 [start_addr, end_addr) 建立一个 zone，页管理数组放在区域起始处
 void frameInit(std::uint64_t start_addr, std::uint64_t end_addr) {
-    //			boot::printf("Frame init: 0x%lx - 0x%lx\n", start_addr,
-    // end_addr);
-    pm.start_addr             = start_addr;
-    std::uint64_t region_size = end_addr - start_addr;
-    std::uint64_t max_pages   = region_size / PAGE_SIZE;
-
-    // 位图和页管理数组需要占用一部分空间，先计算并保留
-    pm.bitmap_size                 = (max_pages + 7) / 8;  // bytes
-    std::uint64_t pages_array_size = max_pages * sizeof(Page);
-    std::uint64_t reserve_bytes    = pm.bitmap_size + pages_array_size;
-    std::uint64_t reserve_pages = (reserve_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    start_addr = PAGE_ALIGN(start_addr);
+    end_addr &= PAGE_MASK;
+    if (end_addr <= start_addr) return;
 
-    if (reserve_pages >= max_pages) {
-        boot::printf("Error: Not enough memory for allocator metadata.\n");
-        while (true);
+    if (pm.nr_zones >= MAX_ZONES) {
+        boot::printf(
+            "Warning: too many memory regions, 0x%lx - 0x%lx ignored.\n",
+            start_addr, end_addr);
+        return;
     }
 
-    std::uint64_t usable_pages = max_pages - reserve_pages;
-    pm.total_pages             = usable_pages;
-    pm.free_pages              = usable_pages;
-
-    // bitmap 放在区域起始，pages 数组紧随其后，实际可用物理内存从 reserve_pages
-    // * PAGE_SIZE 开始
-    pm.bitmap       = (std::uint8_t *)start_addr;
-    pm.pages        = (Page *)((std::uint8_t *)start_addr + pm.bitmap_size);
-    pm.start_usable = start_addr + reserve_pages * PAGE_SIZE;
-
-    // 初始化位图和页描述符
-    memset(pm.bitmap, 0x00, pm.bitmap_size);  // 0 表示空闲
-    for (std::uint64_t i = 0; i < pm.total_pages; ++i) {
-        pm.pages[i].flag  = PAGE_FREE;
-        pm.pages[i].vaddr = pm.start_usable + i * PAGE_SIZE;
-        pm.pages[i].count = 0;
+    std::uint64_t max_pages        = (end_addr - start_addr) / PAGE_SIZE;
+    std::uint64_t pages_array_size = max_pages * sizeof(Page);
+    std::uint64_t reserve_pages =
+        (pages_array_size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    // 区域太小，放不下管理数组后已无可用页
+    if (reserve_pages >= max_pages) return;
+
+    Zone &zone       = pm.zones[pm.nr_zones++];
+    zone.start_pfn   = start_addr / PAGE_SIZE + reserve_pages;
+    zone.total_pages = max_pages - reserve_pages;
+    zone.free_pages  = zone.total_pages;
+    zone.boot_used   = 0;
+    zone.init_pages  = 0;
+    zone.pages       = (Page *)start_addr;
+
+    pm.total_pages += zone.total_pages;
+    pm.free_pages += zone.total_pages;
+
+    // 页描述符不在这里逐个初始化：引导分配器只初始化它分出去的页，其余的
+    // 由 mm::page 在启动后分批初始化
+}
+
+// 扣除与保留区重叠的部分后，把剩余的区间交给 frameInit
+static void AddRegion(std::uint64_t start, std::uint64_t end, int r) {
+    for (; r < nr_reserved; r++) {
+        if (reserved[r].end <= start || reserved[r].start >= end) continue;
+        if (reserved[r].start > start) {
+            AddRegion(start, reserved[r].start, r + 1);
+        }
+        start = reserved[r].end;
+        if (start >= end) return;
     }
+    frameInit(start, end);
 }
 
+// 引导阶段只分配不释放，在每个 zone 内顺序分配即可
 void *Alloc() {
-    if (pm.free_pages == 0) {
-        boot::printf("Error: Out of memory!\n");
-        while (true);
-    }
+    for (std::uint32_t i = 0; i < pm.nr_zones; i++) {
+        Zone &zone = pm.zones[i];
+        if (zone.boot_used >= zone.total_pages) continue;
 
-    // 查找位图中第一个空闲位
-    for (std::uint64_t byte = 0; byte < pm.bitmap_size; ++byte) {
-        if (pm.bitmap[byte] != 0xFF) {
-            for (int bit = 0; bit < 8; ++bit) {
-                std::uint64_t idx = byte * 8 + bit;
-                if (idx >= pm.total_pages) break;
-                std::uint8_t mask = (1u << bit);
-                if (!(pm.bitmap[byte] & mask)) {
-                    // 标记为已使用
-                    pm.bitmap[byte] |= mask;
-                    pm.pages[idx].flag  = PAGE_USED;
-                    pm.pages[idx].count = 1;
-                    pm.free_pages--;
-                    std::uint64_t addr = pm.start_usable + idx * PAGE_SIZE;
-                    return (void *)addr;
-                }
-            }
-        }
+        Page *page = &zone.pages[zone.boot_used];
+        memset(page, 0, sizeof(Page));
+        page->flag  = PAGE_USED;
+        page->count = 1;
+        page->size  = 1;
+        zone.free_pages--;
+        pm.free_pages--;
+        zone.init_pages = zone.boot_used + 1;
+        return (void *)((zone.start_pfn + zone.boot_used++) * PAGE_SIZE);
     }
-    // should not reach here
-    boot::printf(
-        "Error: allocator failed to find free page although the free_pages > "
-        "0.\n");
+
+    boot::printf("Error: Out of memory!\n");
     while (true);
 }
 
-void mapping(PTE *pml4, std::uint64_t virt_addr, std::uint64_t phys_addr,
-             std::uint64_t flags) {
-    int pml4_idx = PML4_ENTRY(virt_addr);
-    int pdpt_idx = PDPT_ENTRY(virt_addr);
-    int pd_idx   = PD_ENTRY(virt_addr);
-    int pt_idx   = PT_ENTRY(virt_addr);
-
-    // PML4
-    if (!(pml4[pml4_idx].value & PTE_PRESENT)) {
-        PTE *pdpt = (PTE *)Alloc();
-        memset(pdpt, 0, PAGE_SIZE);
-        pml4[pml4_idx].value = ((std::uint64_t)pdpt & PAGE_MASK) | PTE_PRESENT |
-                               PTE_WRITABLE | flags;
-    }
+// 分配并清零一个页表页
+static PTE *AllocTable() {
+    PTE *table = (PTE *)Alloc();
+    memset(table, 0, PAGE_SIZE);
+    boot_map_stats.table_pages++;
+    return table;
+}
 
-    PTE *pdpt = (PTE *)(pml4[pml4_idx].value & PAGE_MASK);
-    // PDPT
-    if (!(pdpt[pdpt_idx].value & PTE_PRESENT)) {
-        PTE *pd = (PTE *)Alloc();
-        memset(pd, 0, PAGE_SIZE);
-        pdpt[pdpt_idx].value = ((std::uint64_t)pd & PAGE_MASK) | PTE_PRESENT |
-                               PTE_WRITABLE | flags;
-    }
-    PTE *pd = (PTE *)(pdpt[pdpt_idx].value & PAGE_MASK);
-
-    // PD
-    if (!(pd[pd_idx].value & PTE_PRESENT)) {
-        PTE *pt = (PTE *)Alloc();
-        memset(pt, 0, PAGE_SIZE);
-        pd[pd_idx].value = ((std::uint64_t)pt & PAGE_MASK) | PTE_PRESENT |
-                           PTE_WRITABLE | flags;
+// 返回 entry 指向的下一级页表 (物理地址)，不存在时分配。遇到已有的大页
+// 则拆成 512 个下一级页，sub_size 为下一级的页大小
+static PTE *NextTable(PTE *entry, std::uint64_t flags,
+                      std::uint64_t sub_size) {
+    flags &= ~PTE_GLOBAL;  // 全局位只对末级页表项有意义
+    if (!(entry->value & PTE_PRESENT)) {
+        PTE *table   = AllocTable();
+        entry->value = ((std::uint64_t)table & PAGE_MASK) | PTE_PRESENT |
+                       PTE_WRITABLE | flags;
+    } else if (entry->value & PTE_PAGE_SIZE) {
+        PTE *table          = AllocTable();
+        std::uint64_t base  = entry->value & PAGE_MASK;
+        std::uint64_t attrs = entry->value & ~PAGE_MASK & ~PTE_PAGE_SIZE;
+        if (sub_size != PAGE_SIZE) attrs |= PTE_PAGE_SIZE;
+        for (int i = 0; i < 512; i++) {
+            table[i].value = (base + i * sub_size) | attrs;
+        }
+        entry->value = ((std::uint64_t)table & PAGE_MASK) |
+                       (attrs & ~PTE_PAGE_SIZE);
     }
-    PTE *pt = (PTE *)(pd[pd_idx].value & PAGE_MASK);
+    return (PTE *)(entry->value & PAGE_MASK);
+}
+
+// entry 处能否放置一个 size 大小的大页
+static inline bool CanMapLarge(PTE *entry, std::uint64_t virt,
+                               std::uint64_t phys, std::uint64_t end,
+                               std::uint64_t size) {
+    if ((virt | phys) & (size - 1)) return false;
+    if (end - virt < size) return false;
+    return !(entry->value & PTE_PRESENT) || (entry->value & PTE_PAGE_SIZE);
+}
+
+// 映射 [virt, virt + size)。虚实地址对齐且剩余长度足够时使用大页；
+// 沿途的页表指针在跨越表边界前一直复用，不必每页从 PML4 重新遍历
+void MappingRange(PTE *pml4, std::uint64_t virt, std::uint64_t phys,
+                  std::uint64_t size, std::uint64_t flags) {
+    std::uint64_t end = virt + size;
+    while (virt < end) {
+        boot_map_stats.walks++;
+        PTE *pdpt = NextTable(&pml4[PML4_ENTRY(virt)], flags, PAGE_SIZE_1G);
+        do {
+            PTE *pdpte = &pdpt[PDPT_ENTRY(virt)];
+            if (boot_map_stats.gbpages &&
+                CanMapLarge(pdpte, virt, phys, end, PAGE_SIZE_1G)) {
+                pdpte->value = (phys & PAGE_MASK) | flags | PTE_PAGE_SIZE;
+                boot_map_stats.pages_1g++;
+                virt += PAGE_SIZE_1G;
+                phys += PAGE_SIZE_1G;
+                continue;
+            }
 
-    // PT
-    pt[pt_idx].value = (phys_addr & PAGE_MASK) | flags;
+            PTE *pd = NextTable(pdpte, flags, PAGE_SIZE_2M);
+            do {
+                PTE *pde = &pd[PD_ENTRY(virt)];
+                if (CanMapLarge(pde, virt, phys, end, PAGE_SIZE_2M)) {
+                    pde->value = (phys & PAGE_MASK) | flags | PTE_PAGE_SIZE;
+                    boot_map_stats.pages_2m++;
+                    virt += PAGE_SIZE_2M;
+                    phys += PAGE_SIZE_2M;
+                    continue;
+                }
+
+                PTE *pt = NextTable(pde, flags, PAGE_SIZE);
+                do {
+                    pt[PT_ENTRY(virt)].value = (phys & PAGE_MASK) | flags;
+                    boot_map_stats.pages_4k++;
+                    virt += PAGE_SIZE;
+                    phys += PAGE_SIZE;
+                } while (virt < end && PT_ENTRY(virt) != 0);
+            } while (virt < end && PD_ENTRY(virt) != 0);
+        } while (virt < end && PDPT_ENTRY(virt) != 0);
+    }
 }
 
 // 映射内核段
@@ -139,29 +202,21 @@ void MappingKernel(PTE *pml4, multiboot_tag_elf_sections *elf_sections) {
              boot::printf("0x%x->0x%x\n", vaddr, 0x100000 - 0x1000 + offset);
         }*/
         if (vaddr == reinterpret_cast<std::uint64_t>(__text_start)) {
-            for (std::uint64_t addr = 0; addr <= __text_end - __text_start;
-                 addr += PAGE_SIZE) {
-                mapping(pml4, vaddr + addr, 0x100000 - 0x1000 + offset + addr,
-                        PTE_PRESENT | PTE_WRITABLE);
-            }
+            MappingRange(pml4, vaddr, 0x100000 - 0x1000 + offset,
+                         __text_end - __text_start + PAGE_SIZE,
+                         PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL);
         } else if (vaddr == reinterpret_cast<std::uint64_t>(__rodata_start)) {
-            for (std::uint64_t addr = 0; addr <= __rodata_end - __rodata_start;
-                 addr += PAGE_SIZE) {
-                mapping(pml4, vaddr + addr, 0x100000 - 0x1000 + offset + addr,
-                        PTE_PRESENT | PTE_WRITABLE);
-            }
+            MappingRange(pml4, vaddr, 0x100000 - 0x1000 + offset,
+                         __rodata_end - __rodata_start + PAGE_SIZE,
+                         PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL);
         } else if (vaddr == reinterpret_cast<std::uint64_t>(__data_start)) {
-            for (std::uint64_t addr = 0; addr <= __data_end - __data_start;
-                 addr += PAGE_SIZE) {
-                mapping(pml4, vaddr + addr, 0x100000 - 0x1000 + offset + addr,
-                        PTE_PRESENT | PTE_WRITABLE);
-            }
+            MappingRange(pml4, vaddr, 0x100000 - 0x1000 + offset,
+                         __data_end - __data_start + PAGE_SIZE,
+                         PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL);
         } else if (vaddr == reinterpret_cast<std::uint64_t>(__bss_start)) {
-            for (std::uint64_t addr = 0;
-                 addr <= __bss_end - __bss_start + 0x20000; addr += PAGE_SIZE) {
-                mapping(pml4, vaddr + addr, 0x100000 - 0x1000 + offset + addr,
-                        PTE_PRESENT | PTE_WRITABLE);
-            }
+            MappingRange(pml4, vaddr, 0x100000 - 0x1000 + offset,
+                         __bss_end - __bss_start + 0x20000 + PAGE_SIZE,
+                         PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL);
             boot::printf(
                 "ELF Section '%d':"
                 "Vir: 0x%lx Off: 0x%lx Size: 0x%x B\n",
@@ -172,14 +227,42 @@ void MappingKernel(PTE *pml4, multiboot_tag_elf_sections *elf_sections) {
     }
 }
 
-void MappingIdentity(PTE *pml4, std::uint64_t size) {
-    for (std::uint64_t addr = 0; addr < 0xf00000; addr += PAGE_SIZE) {
-        mapping(pml4, addr, addr, PTE_PRESENT | PTE_WRITABLE);
+// 低 15MiB 保持恒等映射供引导代码继续运行；IDENTITY_BASE 处的直接映射
+// 覆盖低 1MiB 以及内存图中所有可用区域，并标为全局页
+void MappingIdentity(PTE *pml4, multiboot_tag_mmap *mmap_tag) {
+    MappingRange(pml4, 0, 0, 0xf00000, PTE_PRESENT | PTE_WRITABLE);
+    MappingRange(pml4, IDENTITY_BASE, 0, 0x100000,
+                 PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL);
+
+    multiboot_mmap_entry *mmap = mmap_tag->entries;
+    size_t entry_count =
+        (mmap_tag->size - sizeof(multiboot_tag_mmap)) / mmap_tag->entry_size;
+    for (size_t i = 0; i < entry_count; i++) {
+        if (mmap->type == MULTIBOOT_MEMORY_AVAILABLE) {
+            std::uint64_t start = mmap->addr & PAGE_MASK;
+            std::uint64_t end   = PAGE_ALIGN(mmap->addr + mmap->len);
+            if (end > BOOT_MAP_LIMIT) end = BOOT_MAP_LIMIT;
+            if (start < end) {
+                MappingRange(pml4, IDENTITY_BASE + start, start, end - start,
+                             PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL);
+            }
+        }
+        mmap = (multiboot_mmap_entry *)((std::uint8_t *)mmap +
+                                        mmap_tag->entry_size);
     }
-    for (std::uint64_t addr = 0; addr < size && size < 0xfffffffffff;
-         addr += PAGE_SIZE) {
-        mapping(pml4, IDENTITY_BASE + addr, addr, PTE_PRESENT | PTE_WRITABLE);
+}
+
+// head.S 只用一个 1GiB 页恒等映射了物理内存的第一个 1GiB。在初始化高处
+// zone 的管理数组之前，用同样的方式把引导页表扩展到 end
+static void ExtendBootMapping(std::uint64_t end) {
+    for (std::uint64_t i = 1; i < 512 && (i << 30) < end; i++) {
+        boot_pdpt[i].value =
+            (i << 30) | PTE_PRESENT | PTE_WRITABLE | PTE_PAGE_SIZE;
     }
+    asm __volatile__(
+        "mov %%cr3, %%rax\n"
+        "mov %%rax, %%cr3\n" ::
+            : "rax", "memory");
 }
 
 void *memset(void *dest, int val, size_t len) {
@@ -213,26 +296,52 @@ void Init(std::uint8_t *addr) {
         while (true);
     }
 
-    mmap = mmap_tag->entries;
+    // 低 1MiB、内核映像 (含引导页表与栈) 以及 multiboot 信息结构都不能
+    // 交给分配器
+    reserved[nr_reserved++] = {0, (std::uint64_t)__kernel_phys_end};
+    reserved[nr_reserved++] = {(std::uint64_t)addr,
+                               (std::uint64_t)addr + *(std::uint32_t *)addr};
+
+    std::uint64_t max_addr = 0;
+    mmap                   = mmap_tag->entries;
     size_t entry_count =
         (mmap_tag->size - sizeof(multiboot_tag_mmap)) / mmap_tag->entry_size;
     for (size_t i = 0; i < entry_count; i++) {
         if (mmap->type == MULTIBOOT_MEMORY_AVAILABLE &&
-            mmap->addr >= 0x100000) {
-            //				boot::printf("Available Memory: Addr:
-            // 0x%lx, Len: 0x%lx\n", mmap->addr, mmap->len);
-            mm::frameInit(mmap->addr + 0x100000, mmap->addr + mmap->len);
-            break;
+            mmap->addr + mmap->len > max_addr) {
+            max_addr = mmap->addr + mmap->len;
+        }
+        mmap = (multiboot_mmap_entry *)((std::uint8_t *)mmap +
+                                        mmap_tag->entry_size);
+    }
+    if (max_addr > BOOT_MAP_LIMIT) max_addr = BOOT_MAP_LIMIT;
+    ExtendBootMapping(max_addr);
+
+    mmap = mmap_tag->entries;
+    for (size_t i = 0; i < entry_count; i++) {
+        if (mmap->type == MULTIBOOT_MEMORY_AVAILABLE) {
+            std::uint64_t end = mmap->addr + mmap->len;
+            if (end > BOOT_MAP_LIMIT) end = BOOT_MAP_LIMIT;
+            if (mmap->addr < end) AddRegion(mmap->addr, end, 0);
         }
         mmap = (multiboot_mmap_entry *)((std::uint8_t *)mmap +
                                         mmap_tag->entry_size);
     }
+    if (pm.nr_zones == 0) {
+        boot::printf("Error: No usable memory region found!\n");
+        while (true);
+    }
+
+    std::uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000001, eax, ebx, ecx, edx);
+    boot_map_stats.gbpages = (edx & CPUID_EXT_PDPE1GB) != 0;
 
-    PTE *pml4 = (PTE *)Alloc();
-    memset(pml4, 0, PAGE_SIZE);
+    std::uint64_t start = rdtsc();
+    PTE *pml4           = AllocTable();
 
-    MappingIdentity(pml4, pm.start_addr + pm.total_pages * PAGE_SIZE);
+    MappingIdentity(pml4, mmap_tag);
     MappingKernel(pml4, elf_sections);
+    boot_map_stats.cycles = rdtsc() - start;
 
     asm __volatile__("mov %0, %%cr3\n" : : "r"(pml4));
 }
@@ -9,8 +9,10 @@
 
 namespace gdt {
 
-std::uint64_t gdt_table[12];
-TssEntry *tss;
+// 第 10 项起每个 CPU 的 TSS 描述符占两项
+#define GDT_TSS(cpu) (10 + 2 * (cpu))
+
+std::uint64_t gdt_table[GDT_TSS(MAX_CPUS)];
 Ptr gdtr;
 
 void SetEntry(int index, std::uint64_t base, std::uint64_t limit,
@@ -45,12 +47,42 @@ void SetTss(int index, std::uint64_t tss_base, std::uint8_t access) {
     gdt_table[index + 1] = (tss_base >> 32) & 0xFFFFFFFFULL;
 }
 
+// Allocate the TSS of a CPU and install its descriptor. rsp0 is rewritten
+// on every context switch; the stack set here only serves until the first.
+TssEntry *NewTss(std::uint32_t cpu) {
+    TssEntry *tss =
+        reinterpret_cast<TssEntry *>(mm::page::Alloc(sizeof(TssEntry)));
+    memset(tss, 0, sizeof(TssEntry));
+
+    void *stack = mm::page::Alloc(STACK_SIZE);
+    tss->rsp0   = reinterpret_cast<std::uint64_t>(stack) + STACK_SIZE;
+
+    SetTss(GDT_TSS(cpu), reinterpret_cast<std::uint64_t>(tss), 0x89);
+    return tss;
+}
+
+// Load the shared GDT and the CPU's own TSS on the calling CPU.
+void Load(std::uint32_t cpu) {
+    lgdt(&gdtr);
+    // 远返回重新装载 CS，再装载数据段
+    asm volatile(
+        "pushq %0\n"
+        "leaq 1f(%%rip), %%rax\n"
+        "pushq %%rax\n"
+        "lretq\n"
+        "1:\n"
+        "movw %w1, %%ds\n"
+        "movw %w1, %%es\n"
+        "movw %w1, %%ss\n"
+        :
+        : "i"(KERNEL_CS), "r"(KERNEL_DS)
+        : "rax", "memory");
+    ltr(GDT_TSS(cpu) * 8);
+}
+
 void Init() {
     memset(gdt_table, 0, sizeof(gdt_table));
 
-    tss = reinterpret_cast<TssEntry *>(mm::page::Alloc(sizeof(TssEntry)));
-    memset(tss, 0, sizeof(TssEntry));
-
     // Null descriptor
     SetEntry(0, 0, 0, 0, 0);
 
@@ -84,19 +116,10 @@ void Init() {
     SetEntry(8, 0, 0xfffff,
              GDT_PRESENT | GDT_DPL_RING0 | GDT_TYPE_DATA | GDT_TYPE_RW, 0);
 
-    void *stack = mm::page::Alloc(STACK_SIZE);
-    tss->rsp0   = reinterpret_cast<std::uint64_t>(stack) + STACK_SIZE;
-
-    std::uint64_t tss_addr = reinterpret_cast<std::uint64_t>(tss);
-    SetTss(10, tss_addr, 0x89);
-    // tty::printk("gdt addr: 0x%lx, tss addr: 0x%lx\n",
-    // reinterpret_cast<std::uint64_t>(&gdt_table), tss_addr);
+    task::cpus[0].tss = NewTss(0);
     gdtr.limit = sizeof(gdt_table) - 1;
     gdtr.base  = reinterpret_cast<std::uint64_t>(&gdt_table);
 
-    lgdt(&gdtr);
-
-    // Load TSS
-    ltr(10 * 8);
+    Load(0);
 }
 }  // namespace gdt
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "kernel/cpu.h"
 #include "kernel/mm.h"
 #include "kernel/page.h"
+#include "kernel/smp.h"
 #include "kernel/task.h"
 #include "kernel/tty.h"
 
@@ -217,6 +218,13 @@ extern "C" void page_fault_handler(faultStack_code *stack) {
     std::uint64_t cr3, cr2;
     asm volatile("mov %%cr2, %0" : "=r"(cr2));
     asm volatile("mov %%cr3, %0" : "=r"(cr3));
+
+    // 写时复制和按需调页，内核代写用户内存时同样可能触发
+    if (mm::page::HandleFault(cr2, stack->error_code) ||
+        mm::vma::HandleFault(cr2, stack->error_code)) {
+        return;
+    }
+
     if (stack->cs == KERNEL_CS) {
         tty::printk("Page Fault. Error code = 0x%lx\n", stack->error_code);
         if (stack->error_code & 1) {
@@ -378,11 +386,23 @@ void Init() {
     SetEntry(0x20, (void *)pit_stub, 0x08, 0x8E);
     // Keyboard IRQ1 (PIC remapped to 0x21)
     SetEntry(0x21, (void *)kbd_stub, 0x08, 0x8E);
+    // IDE IRQ14/IRQ15 (slave PIC remapped to 0x28)
+    SetEntry(0x2E, (void *)ide_stub, 0x08, 0x8E);
+    SetEntry(0x2F, (void *)ide_stub, 0x08, 0x8E);
+
+    // Local APIC timer and inter-processor interrupts
+    SetEntry(VECTOR_TIMER, (void *)apic_timer_stub, 0x08, 0x8E);
+    SetEntry(VECTOR_RESCHED, (void *)resched_ipi_stub, 0x08, 0x8E);
+    SetEntry(VECTOR_TLB, (void *)tlb_ipi_stub, 0x08, 0x8E);
+    SetEntry(VECTOR_SPURIOUS, (void *)spurious_stub, 0x08, 0x8E);
 
     idt_ptr.limit = sizeof(Entry) * 256 - 1;
     idt_ptr.base  = (std::uint64_t)&idt_table;
 
-    asm volatile("lidt %0" : : "m"(idt_ptr));
+    Load();
 }
 
+// 所有 CPU 共用同一张 IDT
+void Load() { asm volatile("lidt %0" : : "m"(idt_ptr)); }
+
 }  // namespace idt
@@ -25,7 +25,7 @@ int SysInit(int argc, char *argv[]) {
     CpuId cpu_id;
     cpu_id.PrintInfo();
 
-    task::current_proc->tty = 1;  // 绑定到第一个TTY
+    task::CurrentProc()->tty = 1;  // 绑定到第一个TTY
     task::ipc::Message msg;
     msg.dst_pid = 3;
     task::ipc::Receive(&msg);
@@ -8,6 +8,8 @@
 #include "kernel/mm.h"
 #include "kernel/multiboot2.h"
 #include "kernel/page.h"
+#include "kernel/slab.h"
+#include "kernel/smp.h"
 #include "kernel/task.h"
 #include "kernel/tty.h"
 #include "kernel/vfs.h"
@@ -15,10 +17,12 @@
 char *cmdline = nullptr;
 
 void KernelMain(std::uint8_t *addr) {
+    smp::EarlyInit();
     asm __volatile__("mov %%cr3, %0" : "=r"(mm::page::kernel_pml4));
     mm::page::kernel_pml4 =
         (PTE *)mm::Phy2Vir((std::uint64_t)mm::page::kernel_pml4);
     mm::page::frame = pm;
+    mm::page::Init();
 
     tty::video::Init((std::uint8_t *)mm::Phy2Vir((std::uint64_t)addr));
 
@@ -27,15 +31,31 @@ void KernelMain(std::uint8_t *addr) {
     idt::Init();
 
     serial::Init();
+    mm::page::ShowZones();
+    mm::page::SelfTest();
+    mm::tlb::Init();
+    mm::slab::Init();
+    mm::vmalloc::Init();
     timer::Init(TIMER_FREQUENCY);
+    timer::InitClock();
 
     asm volatile("cli");
     multiboot_tag_string *str = nullptr;
-    multiboot_tag *tag        = reinterpret_cast<multiboot_tag *>(
+    std::uint8_t rsdp[36];  // ACPI 2.0 的 RSDP 最长 36 字节
+    bool has_rsdp      = false;
+    multiboot_tag *tag = reinterpret_cast<multiboot_tag *>(
         (std::uint8_t *)mm::Phy2Vir((std::uint64_t)addr) + 8);
     while (tag->type != MULTIBOOT_TAG_TYPE_END) {
         if (tag->type == MULTIBOOT_TAG_TYPE_CMDLINE) {
             str = reinterpret_cast<multiboot_tag_string *>(tag);
+        } else if ((tag->type == MULTIBOOT_TAG_TYPE_ACPI_NEW ||
+                    (tag->type == MULTIBOOT_TAG_TYPE_ACPI_OLD && !has_rsdp)) &&
+                   tag->size > 8) {
+            // 引导信息所在的内存稍后可能被复用，先复制一份
+            std::uint32_t len = tag->size - 8;
+            memcpy(rsdp, reinterpret_cast<multiboot_tag_new_acpi *>(tag)->rsdp,
+                   len < sizeof(rsdp) ? len : sizeof(rsdp));
+            has_rsdp = true;
         }
         tag = reinterpret_cast<multiboot_tag *>(
             reinterpret_cast<std::uint8_t *>(tag) + ((tag->size + 7) & ~7));
@@ -47,10 +67,10 @@ void KernelMain(std::uint8_t *addr) {
     task::thread::Init();
 
     asm volatile("sti");
-    while (true) {
-        // asm volatile("hlt");
-    }
-    // task::thread::Exit(0);
+    smp::Init(has_rsdp ? rsdp : nullptr);
+
+    // idle: 空闲时先初始化推迟的页描述符，再预先清零页面供 GFP_ZERO 使用
+    task::Idle();
 }
 
 void *__dso_handle = nullptr;
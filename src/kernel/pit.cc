@@ -23,5 +23,6 @@ void Init(uint32_t freq) {
     pic::UnmaskIrq(0);
 }
 
-uint64_t GetTicks() { return pit_ticks; }
+// 时钟节拍数，PIT 停止后由 TSC 换算
+uint64_t GetTicks() { return Millis() / TIMER_PERIOD; }
 }  // namespace timer
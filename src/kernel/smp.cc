@@ -0,0 +1,290 @@
+/**
+ * @file smp.cc
+ * @brief Multiprocessor bring-up: ACPI MADT, local APIC and AP startup
+ * @author Kumosya, 2025-2026
+ **/
+
+#include "kernel/smp.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "kernel/cpu.h"
+#include "kernel/io.h"
+#include "kernel/mm.h"
+#include "kernel/page.h"
+#include "kernel/task.h"
+#include "kernel/tty.h"
+
+// trampoline.S
+extern "C" char trampoline_start[], trampoline_end[], trampoline_params[];
+
+namespace smp {
+
+#define ICR_INIT (5 << 8)
+#define ICR_STARTUP (6 << 8)
+#define ICR_PENDING (1 << 12)
+#define ICR_ASSERT (1 << 14)
+#define ICR_OTHERS (3 << 18)  // 除自己以外的所有 CPU
+
+// MADT 中的条目类型
+#define MADT_LAPIC 0
+#define MADT_LAPIC_ENABLED (1 << 0)
+
+#define AP_TIMEOUT_TICKS 20  // 等待 AP 上线的时间
+
+struct TrampolineParams {
+    std::uint64_t cr0, cr3, cr4, efer;
+    std::uint64_t stack;  // AP 的 idle 任务的栈顶
+    std::uint64_t entry;  // ApMain
+    std::uint64_t cpu;    // 传给 ApMain 的 task::Cpu
+};
+
+struct Rsdp {
+    char signature[8];
+    std::uint8_t checksum;
+    char oem_id[6];
+    std::uint8_t revision;
+    std::uint32_t rsdt;
+    std::uint32_t length;  // 以下字段从 ACPI 2.0 起才有
+    std::uint64_t xsdt;
+    std::uint8_t ext_checksum;
+    std::uint8_t reserved[3];
+} __attribute__((packed));
+
+struct SdtHeader {
+    char signature[4];
+    std::uint32_t length;
+    std::uint8_t revision;
+    std::uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    std::uint32_t oem_revision;
+    std::uint32_t creator_id;
+    std::uint32_t creator_revision;
+} __attribute__((packed));
+
+struct Madt {
+    SdtHeader header;
+    std::uint32_t lapic;
+    std::uint32_t flags;
+    std::uint8_t entries[0];
+} __attribute__((packed));
+
+static volatile std::uint32_t *lapic;
+static bool active;  // 至少有一个 AP 上线
+
+std::uint32_t LapicRead(std::uint32_t reg) { return lapic[reg / 4]; }
+
+void LapicWrite(std::uint32_t reg, std::uint32_t val) { lapic[reg / 4] = val; }
+
+// Map physical memory outside the direct map (ACPI tables, the APIC
+// registers) at its direct map address in the shared kernel half.
+static void *MapPhys(std::uint64_t phys, std::uint64_t size,
+                     std::uint64_t flags) {
+    std::uint64_t start = phys & PAGE_MASK;
+    mm::page::MapRange(mm::page::kernel_pml4, mm::Phy2Vir(start), start,
+                       PAGE_ALIGN(phys + size) - start,
+                       PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL | flags);
+    return (void *)mm::Phy2Vir(phys);
+}
+
+static SdtHeader *MapTable(std::uint64_t phys) {
+    SdtHeader *header = (SdtHeader *)MapPhys(phys, sizeof(SdtHeader), 0);
+    return (SdtHeader *)MapPhys(phys, header->length, 0);
+}
+
+// Walk the XSDT (or the RSDT of ACPI 1.0) for the MADT.
+static Madt *FindMadt(const Rsdp *rsdp) {
+    bool xsdt            = rsdp->revision >= 2 && rsdp->xsdt != 0;
+    SdtHeader *root      = MapTable(xsdt ? rsdp->xsdt : rsdp->rsdt);
+    std::uint32_t size   = xsdt ? 8 : 4;
+    std::uint32_t nr     = (root->length - sizeof(SdtHeader)) / size;
+    std::uint8_t *tables = (std::uint8_t *)(root + 1);
+
+    for (std::uint32_t i = 0; i < nr; i++) {
+        std::uint64_t phys = xsdt ? *(std::uint64_t *)(tables + i * 8)
+                                  : *(std::uint32_t *)(tables + i * 4);
+        SdtHeader *table   = MapTable(phys);
+        if (memcmp(table->signature, "APIC", 4) == 0) return (Madt *)table;
+    }
+    return nullptr;
+}
+
+// Collect the APIC IDs of the enabled processors other than the BSP.
+static std::uint32_t ParseMadt(Madt *madt, std::uint8_t *ids) {
+    std::uint32_t nr  = 0;
+    std::uint8_t *p   = madt->entries;
+    std::uint8_t *end = (std::uint8_t *)madt + madt->header.length;
+    while (p + 2 <= end && p[1] >= 2) {
+        // 处理器条目: type, length, ACPI ID, APIC ID, flags
+        if (p[0] == MADT_LAPIC && (p[4] & MADT_LAPIC_ENABLED) &&
+            p[3] != task::cpus[0].apic_id && nr < MAX_CPUS - 1) {
+            ids[nr++] = p[3];
+        }
+        p += p[1];
+    }
+    return nr;
+}
+
+// BSP 保持虚拟线模式，8259 的中断经 LINT0 送达；AP 只接收 IPI
+static void EnableApic(bool bsp) {
+    LapicWrite(LAPIC_TPR, 0);
+    LapicWrite(LAPIC_LVT_LINT0, bsp ? LVT_EXTINT : LVT_MASKED);
+    LapicWrite(LAPIC_LVT_LINT1, bsp ? LVT_NMI : LVT_MASKED);
+    LapicWrite(LAPIC_SVR, SVR_ENABLE | VECTOR_SPURIOUS);
+}
+
+static void WaitIcr() {
+    while (LapicRead(LAPIC_ICR_LOW) & ICR_PENDING) {
+        asm volatile("pause");
+    }
+}
+
+// Busy-wait for at least ticks whole timer ticks.
+static void Delay(std::uint64_t ticks) {
+    std::uint64_t end = timer::GetTicks() + ticks + 1;
+    while (timer::GetTicks() < end) {
+        asm volatile("pause");
+    }
+}
+
+void SendIpi(std::uint32_t apic_id, std::uint8_t vector) {
+    std::uint64_t flags = irq_save();
+    WaitIcr();
+    LapicWrite(LAPIC_ICR_HIGH, apic_id << 24);
+    LapicWrite(LAPIC_ICR_LOW, ICR_ASSERT | vector);
+    irq_restore(flags);
+}
+
+void SendIpiOthers(std::uint8_t vector) {
+    std::uint64_t flags = irq_save();
+    WaitIcr();
+    LapicWrite(LAPIC_ICR_LOW, ICR_OTHERS | ICR_ASSERT | vector);
+    irq_restore(flags);
+}
+
+void Eoi() { LapicWrite(LAPIC_EOI, 0); }
+
+bool Active() { return active; }
+
+// First thing on the BSP: point GS at its per-CPU area so that spinlocks
+// and CurrentProc() work from here on.
+void EarlyInit() {
+    task::Cpu *bsp = &task::cpus[0];
+    bsp->self      = bsp;
+    bsp->id        = 0;
+    bsp->online    = true;
+    task::nr_cpus  = 1;
+    wrmsr(MSR_GS_BASE, (std::uint64_t)bsp);
+    wrmsr(MSR_KERNEL_GS_BASE, (std::uint64_t)bsp);
+}
+
+// Entered from the trampoline on the AP's idle stack. Sets up the CPU the
+// way the BSP was set up and becomes the idle task of this CPU.
+extern "C" void ApMain(task::Cpu *cpu) {
+    wrmsr(MSR_GS_BASE, (std::uint64_t)cpu);
+    wrmsr(MSR_KERNEL_GS_BASE, (std::uint64_t)cpu);
+    gdt::Load(cpu->id);
+    idt::Load();
+    mm::tlb::InitAp();
+
+    wrmsr(0x174, KERNEL_CS);
+    wrmsr(0x175, cpu->idle->thread->rsp0);
+    wrmsr(0x176, reinterpret_cast<std::uint64_t>(enter_syscall));
+
+    EnableApic(false);
+    timer::InitLocal();
+    __atomic_store_n(&cpu->online, true, __ATOMIC_RELEASE);
+
+    asm volatile("sti");
+    task::Idle();
+}
+
+// Send INIT and two STARTUP IPIs and wait for the AP to check in.
+static bool StartAp(task::Cpu *cpu, TrampolineParams *params) {
+    task::thread::InitIdle(cpu);
+    cpu->tss = gdt::NewTss(cpu->id);
+
+    params->stack = cpu->idle->thread->rsp0;
+    params->cpu   = (std::uint64_t)cpu;
+
+    LapicWrite(LAPIC_ICR_HIGH, cpu->apic_id << 24);
+    LapicWrite(LAPIC_ICR_LOW, ICR_INIT | ICR_ASSERT);
+    WaitIcr();
+    Delay(1);
+
+    for (int i = 0; i < 2; i++) {
+        LapicWrite(LAPIC_ICR_HIGH, cpu->apic_id << 24);
+        LapicWrite(LAPIC_ICR_LOW,
+                   ICR_STARTUP | ICR_ASSERT | TRAMPOLINE_BASE >> 12);
+        WaitIcr();
+        Delay(1);
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) return true;
+    }
+
+    for (int t = 0; t < AP_TIMEOUT_TICKS; t++) {
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) return true;
+        Delay(1);
+    }
+    return false;
+}
+
+// Enable the BSP's local APIC and start every other processor listed in
+// the MADT, one at a time since they share the trampoline. Runs in the
+// BSP's idle task with interrupts enabled so that Delay can count ticks.
+void Init(const void *rsdp) {
+    std::uint64_t base = rdmsr(MSR_APIC_BASE) & PAGE_MASK;
+    lapic              = (volatile std::uint32_t *)MapPhys(
+        base, PAGE_SIZE, PTE_CACHE_DISABLE | PTE_WRITE_THROUGH);
+    task::cpus[0].apic_id = LapicRead(LAPIC_ID) >> 24;
+    EnableApic(true);
+    timer::InitLocal();
+
+    Madt *madt = rsdp ? FindMadt((const Rsdp *)rsdp) : nullptr;
+    if (madt == nullptr) {
+        tty::printk("SMP: no MADT found, running on the BSP only.\n");
+        return;
+    }
+
+    std::uint64_t cr3 = mm::Vir2Phy((std::uint64_t)mm::page::kernel_pml4);
+    if (cr3 >> 32) {
+        tty::printk("SMP: kernel page tables above 4GiB, APs not started.\n");
+        return;
+    }
+
+    std::uint8_t ids[MAX_CPUS];
+    std::uint32_t nr = ParseMadt(madt, ids);
+
+    memcpy((void *)mm::Phy2Vir(TRAMPOLINE_BASE), trampoline_start,
+           trampoline_end - trampoline_start);
+    TrampolineParams *params = (TrampolineParams *)mm::Phy2Vir(
+        TRAMPOLINE_BASE + (trampoline_params - trampoline_start));
+
+    std::uint64_t cr0, cr4;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    // CR4.PCIDE 只能在长模式下打开，由 ApMain 补上
+    params->cr0   = cr0;
+    params->cr3   = cr3;
+    params->cr4   = cr4 & ~CR4_PCIDE;
+    params->efer  = rdmsr(MSR_EFER) & ~EFER_LMA;
+    params->entry = (std::uint64_t)ApMain;
+
+    for (std::uint32_t i = 0; i < nr; i++) {
+        task::Cpu *cpu = &task::cpus[task::nr_cpus];
+        cpu->self      = cpu;
+        cpu->id        = task::nr_cpus;
+        cpu->apic_id   = ids[i];
+        if (!StartAp(cpu, params)) {
+            // 超时的 AP 可能稍后才醒来，不再复用它的数据和启动代码
+            tty::printk("SMP: CPU with APIC ID %d did not start.\n", ids[i]);
+            break;
+        }
+        task::nr_cpus++;
+        active = true;
+    }
+    tty::printk("SMP: %d of %d CPUs online.\n", task::nr_cpus, nr + 1);
+}
+
+}  // namespace smp
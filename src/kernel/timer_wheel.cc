@@ -0,0 +1,273 @@
+/**
+ * @file timer_wheel.cc
+ * @brief Per-CPU hierarchical timer wheels, sleeping and timeouts
+ * @author Kumosya, 2025-2026
+ **/
+
+#include "kernel/timer.h"
+
+#include <cstdint>
+
+#include "kernel/cpu.h"
+#include "kernel/io.h"
+#include "kernel/task.h"
+
+namespace timer {
+
+// 每层 64 个槽位，第 n 层一个槽位覆盖 64^n 毫秒，四层共约 4.6 小时
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN (1ULL << (WHEEL_BITS * WHEEL_LEVELS))
+
+#define NS_PER_MS 1000000ULL
+
+struct CACHE_ALIGNED Wheel {
+    task::SpinLock lock;
+    std::uint64_t clk;       // 下一个要处理的毫秒，更早到期的定时器都已运行
+    std::uint64_t deadline;  // 本 CPU 定时器已编程的到期时刻 (ns)
+    std::uint32_t pending;   // 轮上的定时器个数
+    Timer *running;          // 正在运行回调的定时器
+    Timer *slots[WHEEL_LEVELS][WHEEL_SIZE];
+};
+
+static Wheel wheels[MAX_CPUS];
+
+static void Link(Timer **slot, Timer *timer) {
+    timer->slot = slot;
+    timer->prev = nullptr;
+    timer->next = *slot;
+    if (*slot != nullptr) (*slot)->prev = timer;
+    *slot = timer;
+}
+
+static void Unlink(Timer *timer) {
+    if (timer->prev != nullptr) {
+        timer->prev->next = timer->next;
+    } else {
+        *timer->slot = timer->next;
+    }
+    if (timer->next != nullptr) timer->next->prev = timer->prev;
+    timer->slot = nullptr;
+}
+
+// Put timer into the level whose slots are just coarse enough to reach its
+// expiry from clk. Timers beyond the wheel's span wait in the last slot
+// reachable and are placed again when it cascades. The caller holds lock.
+static void Insert(Wheel *wheel, Timer *timer) {
+    std::uint64_t expires = timer->expires;
+    if (expires < wheel->clk) expires = wheel->clk;
+    if (expires - wheel->clk >= WHEEL_SPAN) {
+        expires = wheel->clk + WHEEL_SPAN - 1;
+    }
+
+    std::uint64_t delta = expires - wheel->clk;
+    std::uint32_t level = 0;
+    while (level < WHEEL_LEVELS - 1 &&
+           delta >= 1ULL << (WHEEL_BITS * (level + 1))) {
+        level++;
+    }
+    std::uint64_t index = (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    Link(&wheel->slots[level][index], timer);
+}
+
+// 上层槽位的时间段开始时，把其中的定时器重新分散到更细的层
+static void Cascade(Wheel *wheel, std::uint32_t level, std::uint64_t index) {
+    Timer *timer               = wheel->slots[level][index];
+    wheel->slots[level][index] = nullptr;
+    while (timer != nullptr) {
+        Timer *next = timer->next;
+        Insert(wheel, timer);
+        timer = next;
+    }
+}
+
+// Earliest millisecond at which the wheel has work: a level 0 slot falling
+// due, or an upper slot cascading, which may still be before its timers
+// expire. The caller holds lock.
+static std::uint64_t NextExpiry(Wheel *wheel) {
+    if (wheel->pending == 0) return TIMER_NEVER;
+
+    std::uint64_t next = TIMER_NEVER;
+    for (std::uint64_t i = 0; i < WHEEL_SIZE; i++) {
+        if (wheel->slots[0][(wheel->clk + i) & WHEEL_MASK] != nullptr) {
+            next = wheel->clk + i;
+            break;
+        }
+    }
+    for (std::uint32_t level = 1; level < WHEEL_LEVELS; level++) {
+        std::uint32_t shift = WHEEL_BITS * level;
+        for (std::uint64_t k = 1; k <= WHEEL_SIZE; k++) {
+            std::uint64_t block = (wheel->clk >> shift) + k;
+            if (wheel->slots[level][block & WHEEL_MASK] != nullptr) {
+                if (block << shift < next) next = block << shift;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+void Setup(Timer *timer, void (*func)(Timer *timer), void *data) {
+    timer->slot = nullptr;
+    timer->func = func;
+    timer->data = data;
+    timer->cpu  = 0;
+}
+
+// Take timer off whichever wheel it is on, without waiting for its
+// callback. Returns true if it was pending.
+static bool Detach(Timer *timer) {
+    if (!Pending(timer)) return false;
+
+    Wheel *wheel        = &wheels[timer->cpu];
+    std::uint64_t flags = wheel->lock.lock_irqsave();
+    bool pending = Pending(timer);
+    if (pending) {
+        Unlink(timer);
+        wheel->pending--;
+    }
+    wheel->lock.unlock_irqrestore(flags);
+    return pending;
+}
+
+// Arm timer to run at expires (ms since boot) on this CPU, moving it if it
+// is already pending. May be called from the timer's own callback.
+void Add(Timer *timer, std::uint64_t expires) {
+    Detach(timer);
+
+    std::uint64_t flags = irq_save();
+    std::uint32_t cpu   = task::ThisCpu()->id;
+    Wheel *wheel        = &wheels[cpu];
+    wheel->lock.lock();
+    timer->expires = expires;
+    timer->cpu     = cpu;
+    Insert(wheel, timer);
+    wheel->pending++;
+    wheel->lock.unlock();
+
+    // 比已编程的时刻更早到期时，提前本 CPU 的定时器
+    std::uint64_t deadline = expires * NS_PER_MS;
+    if (deadline < wheel->deadline) {
+        std::uint64_t now = Nanos();
+        wheel->deadline   = deadline;
+        Program(deadline > now ? deadline - now : 0);
+    }
+    irq_restore(flags);
+}
+
+// Cancel timer and wait until its callback, if running on another CPU, has
+// returned. Must not be called from the callback itself. Returns true if
+// the timer was still pending.
+bool Del(Timer *timer) {
+    bool pending = Detach(timer);
+
+    Wheel *wheel = &wheels[timer->cpu];
+    while (__atomic_load_n(&wheel->running, __ATOMIC_ACQUIRE) == timer) {
+        asm volatile("pause");
+    }
+    return pending;
+}
+
+// Run the callbacks of every timer on this CPU's wheel that has expired.
+// Called from the timer interrupt. Callbacks run without the wheel lock
+// so they can add or delete timers.
+void Run() {
+    Wheel *wheel      = &wheels[task::ThisCpu()->id];
+    std::uint64_t now = Millis();
+
+    wheel->lock.lock();
+    // 轮上无定时器时直接跳到当前时刻，空闲很久的 CPU 不必逐毫秒追赶
+    if (wheel->pending == 0 && wheel->clk <= now) wheel->clk = now + 1;
+
+    while (wheel->clk <= now) {
+        std::uint64_t index = wheel->clk & WHEEL_MASK;
+        for (std::uint32_t level = 1; level < WHEEL_LEVELS; level++) {
+            std::uint32_t shift = WHEEL_BITS * level;
+            if ((wheel->clk >> (shift - WHEEL_BITS)) & WHEEL_MASK) break;
+            Cascade(wheel, level, (wheel->clk >> shift) & WHEEL_MASK);
+        }
+
+        // 到期的定时器先摘到本地链表，回调中重新加入的不会在本轮再次运行
+        Timer *expired = nullptr;
+        while (wheel->slots[0][index] != nullptr) {
+            Timer *timer = wheel->slots[0][index];
+            Unlink(timer);
+            Link(&expired, timer);
+        }
+        while (expired != nullptr) {
+            Timer *timer = expired;
+            Unlink(timer);
+            wheel->pending--;
+            __atomic_store_n(&wheel->running, timer, __ATOMIC_RELEASE);
+            wheel->lock.unlock();
+
+            timer->func(timer);
+
+            wheel->lock.lock();
+            __atomic_store_n(&wheel->running, nullptr, __ATOMIC_RELEASE);
+        }
+        wheel->clk++;
+    }
+    wheel->lock.unlock();
+}
+
+// Program this CPU's timer for ns from now, or TIMER_NEVER for no limit,
+// or earlier if a timer on this CPU's wheel needs it first. The timer is
+// stopped when nothing is due. Called with interrupts disabled.
+void Arm(std::uint64_t ns) {
+    Wheel *wheel           = &wheels[task::ThisCpu()->id];
+    std::uint64_t now      = Nanos();
+    std::uint64_t deadline = ns == TIMER_NEVER ? TIMER_NEVER : now + ns;
+
+    wheel->lock.lock();
+    std::uint64_t next = NextExpiry(wheel);
+    wheel->lock.unlock();
+    if (next != TIMER_NEVER && next * NS_PER_MS < deadline) {
+        deadline = next * NS_PER_MS;
+    }
+
+    wheel->deadline = deadline;
+    if (deadline == TIMER_NEVER) {
+        Stop();
+    } else {
+        Program(deadline > now ? deadline - now : 0);
+    }
+}
+
+static void WakeTask(Timer *timer) {
+    task::Wakeup(static_cast<task::Pcb *>(timer->data));
+}
+
+// Block the current task for at most ms milliseconds. Like every other
+// wait, the caller first marks itself Blocked and publishes itself where
+// its waker looks, so a wakeup in between is not lost. Returns the
+// milliseconds left, 0 if the timeout expired.
+std::uint64_t ScheduleTimeout(std::uint64_t ms) {
+    Timer timer;
+    Setup(&timer, WakeTask, task::CurrentProc());
+    std::uint64_t expires = Millis() + ms;
+    Add(&timer, expires);
+    task::Schedule();
+    Del(&timer);
+
+    std::uint64_t now = Millis();
+    return expires > now ? expires - now : 0;
+}
+
+// Give up the CPU for at least ms milliseconds, or until the task is
+// killed.
+void Sleep(std::uint64_t ms) {
+    task::Pcb *current = task::CurrentProc();
+    while (ms > 0) {
+        current->stat = task::Blocked;
+        if (task::KillPending(current)) {
+            current->stat = task::Ready;
+            break;
+        }
+        ms = ScheduleTimeout(ms);
+    }
+}
+
+}  // namespace timer
@@ -0,0 +1,98 @@
+/**
+ * @file tsc.cc
+ * @brief TSC clocksource: nanoseconds since boot, calibrated against the PIT
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+
+#include "kernel/cpu.h"
+#include "kernel/io.h"
+#include "kernel/tty.h"
+
+namespace timer {
+
+// PIT 通道 2 只用于校准，门控和输出状态在端口 0x61
+#define PIT_CHANNEL2 0x42
+#define PIT_GATE 0x61
+#define PIT_GATE_ON (1 << 0)
+#define PIT_SPEAKER (1 << 1)
+#define PIT_OUT2 (1 << 5)
+
+#define CALIBRATE_MS 50
+#define NS_PER_MS 1000000ULL
+
+/* CPUID.80000007H:EDX */
+#define CPUID_INVARIANT_TSC (1 << 8)
+
+static std::uint64_t tsc_khz;   // 为 0 表示尚未校准，仍由 PIT 计时
+static std::uint64_t tsc_mult;  // ns = cycles * tsc_mult >> 32
+static std::uint64_t tsc_base;  // 切换到 TSC 计时时的 TSC 和纳秒数
+static std::uint64_t ns_base;
+
+// Count TSC cycles over CALIBRATE_MS, timed by PIT channel 2 in one-shot
+// mode with interrupts disabled.
+static std::uint64_t CalibrateTsc() {
+    std::uint64_t flags = irq_save();
+
+    std::uint8_t gate = inb(PIT_GATE);
+    outb(PIT_GATE, (gate & ~PIT_SPEAKER) | PIT_GATE_ON);
+    std::uint32_t latch = PIT_FREQ * CALIBRATE_MS / 1000;
+    outb(PIT_COMMAND, 0xB0);  // 通道 2，先低后高字节，模式 0
+    outb(PIT_CHANNEL2, latch & 0xFF);
+    outb(PIT_CHANNEL2, (latch >> 8) & 0xFF);
+    std::uint64_t start = rdtsc();
+
+    // 计数到 0 时 OUT2 变为高电平
+    while (!(inb(PIT_GATE) & PIT_OUT2)) {
+        asm volatile("pause");
+    }
+    std::uint64_t cycles = rdtsc() - start;
+    outb(PIT_GATE, gate);
+
+    irq_restore(flags);
+    return cycles / CALIBRATE_MS;
+}
+
+// Calibrate the TSC and switch the clock over to it. The scheduler charges
+// tasks from this clock, so it runs before the first task is created.
+void InitClock() {
+    std::uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000000, eax, ebx, ecx, edx);
+    bool invariant = false;
+    if (eax >= 0x80000007) {
+        cpuid(0x80000007, eax, ebx, ecx, edx);
+        invariant = (edx & CPUID_INVARIANT_TSC) != 0;
+    }
+
+    std::uint64_t khz = CalibrateTsc();
+    tsc_mult          = (NS_PER_MS << 32) / khz;
+    ns_base           = Nanos();
+    tsc_base          = rdtsc();
+    __atomic_store_n(&tsc_khz, khz, __ATOMIC_RELEASE);
+
+    tty::printk("Clock: TSC %d kHz%s.\n", khz,
+                invariant ? ", invariant" : ", not invariant, may drift");
+}
+
+// Time since boot in nanoseconds. Counted in PIT ticks until the TSC has
+// been calibrated, from the TSC afterwards; the TSCs of all CPUs are
+// assumed to run in step.
+std::uint64_t Nanos() {
+    if (__atomic_load_n(&tsc_khz, __ATOMIC_ACQUIRE) == 0) {
+        return pit_ticks * TIMER_PERIOD * NS_PER_MS;
+    }
+    unsigned __int128 cycles = rdtsc() - tsc_base;
+    return ns_base + (std::uint64_t)((cycles * tsc_mult) >> 32);
+}
+
+std::uint64_t Millis() { return Nanos() / NS_PER_MS; }
+
+std::uint64_t TscKhz() { return tsc_khz; }
+
+// TSC cycles in ns nanoseconds, split so that long spans cannot overflow.
+std::uint64_t NsToCycles(std::uint64_t ns) {
+    return ns / NS_PER_MS * tsc_khz + ns % NS_PER_MS * tsc_khz / NS_PER_MS;
+}
+
+}  // namespace timer
@@ -14,10 +14,10 @@ namespace mm {
 int Service(int argc, char *argv[]) {
     /*tty::printk(
         "mm task is running, argc: %d, argv[0]: %s, pcb addr: 0x%lx, pid: %d\n",
-        argc, argv[0], (std::uint64_t)task::current_proc,
-        task::current_proc->pid);*/
+        argc, argv[0], (std::uint64_t)task::CurrentProc(),
+        task::CurrentProc()->pid);*/
 
-    task::current_proc->tty = 1;  // 绑定到第一个TTY
+    task::CurrentProc()->tty = 1;  // 绑定到第一个TTY
     task::ipc::Message msg;
     msg.dst_pid = SYS_CHAR;
     msg.type    = SYS_CHAR_PUTS;
@@ -25,7 +25,73 @@ int Service(int argc, char *argv[]) {
                  timer::GetTicks());
     task::ipc::Send(&msg);
 
+#if MM_BENCHMARK == true
+    page::Benchmark();
+    tlb::Benchmark();
+#endif
+
+    // 交换分区和根文件系统在同一块盘上
+    msg.dst_pid = SYS_BLOCK;
+    msg.type    = SYS_BLOCK_GET;
+    strcpy(msg.data, "hda");
+    task::ipc::Send(&msg);
+    task::ipc::Receive(&msg);
+    swap::Init(reinterpret_cast<block::BlockDevice *>(msg.num[0]));
+
+    bool reply;
     while (true) {
+        reply = true;
+        if (task::ipc::Receive(&msg)) {
+            task::Pcb *proc = msg.sender;
+            task::Mem *mem  = &proc->mm;
+            if (msg.type == SYS_MM_RECLAIM) {
+                // 页分配器发出的通知，不需要回复
+                swap::Balance();
+                reply = false;
+            } else if (msg.type == SYS_MM_MEMINFO) {
+                // 只读统计，内核线程也可以查询
+                stat::Query(&msg);
+            } else if (proc->flags & THREAD_KERNEL) {
+                // 内核线程没有用户地址空间
+                msg.num[0] = -1;
+            } else {
+                // 页表项的修改与别的 CPU 上的回收者互斥
+                mem->lock.lock();
+                switch (msg.type) {
+                    case SYS_MM_MMAP:
+                        // 请求方在等回复，不会同时改动自己的 fd 表
+                        msg.num[0] = vma::Mmap(
+                            &mem->vmas, mem->pml4, msg.num[0], msg.num[1],
+                            static_cast<int>(msg.num[2]),
+                            static_cast<int>(msg.num[3]),
+                            proc->files.Get(static_cast<int>(msg.num[4])),
+                            msg.num[5]);
+                        break;
+                    case SYS_MM_MUNMAP:
+                        msg.num[0] = vma::Munmap(&mem->vmas, mem->pml4,
+                                                 msg.num[0], msg.num[1]);
+                        break;
+                    case SYS_MM_MPROTECT:
+                        msg.num[0] = vma::Mprotect(
+                            &mem->vmas, mem->pml4, msg.num[0], msg.num[1],
+                            static_cast<int>(msg.num[2]));
+                        break;
+                    default:
+                        tty::printk("MM: Unknown message type: %d\n",
+                                    msg.type);
+                        reply = false;
+                        break;
+                }
+                mem->lock.unlock();
+                // 请求方的页表在本服务运行时被修改，切回时必须刷新 TLB
+                tlb::Invalidate(&mem->asid);
+            }
+            if (reply) {
+                msg.dst_pid = proc->pid;
+                msg.sender  = task::CurrentProc();
+                task::ipc::Send(&msg);
+            }
+        }
     }
     return 0;
 }
@@ -2,9 +2,10 @@
 
 #include "kernel/mm.h"
 #include "kernel/page.h"
+#include "kernel/slab.h"
 
-// Simple kernel operator new/delete backed by page allocator.
-// Allocation stores the page count in the first 8 bytes of the allocation.
+// Kernel operator new/delete backed by the slab allocator. Small requests
+// are served from the kmalloc size classes, larger ones from whole pages.
 
 typedef unsigned long size_t;
 
@@ -12,27 +13,27 @@ struct nothrow_t {
     // placement new tag type to suppress exceptions
 };
 
-void *operator new(size_t size) noexcept { return mm::page::Alloc(size); }
+void *operator new(size_t size) noexcept { return mm::slab::Alloc(size); }
 
-void operator delete(void *ptr) noexcept { mm::page::Free(ptr); }
+void operator delete(void *ptr) noexcept { mm::slab::Free(ptr); }
 
-void *operator new[](size_t size) noexcept { return mm::page::Alloc(size); }
-void operator delete[](void *ptr) noexcept { mm::page::Free(ptr); }
+void *operator new[](size_t size) noexcept { return mm::slab::Alloc(size); }
+void operator delete[](void *ptr) noexcept { mm::slab::Free(ptr); }
 
 // nothrow variants
 void *operator new(size_t size, const nothrow_t &) noexcept {
-    return mm::page::Alloc(size);
+    return mm::slab::Alloc(size);
 }
 void operator delete(void *ptr, const nothrow_t &) noexcept {
-    mm::page::Free(ptr);
+    mm::slab::Free(ptr);
 }
 void *operator new[](size_t size, const nothrow_t &) noexcept {
-    return mm::page::Alloc(size);
+    return mm::slab::Alloc(size);
 }
 void operator delete[](void *ptr, const nothrow_t &) noexcept {
-    mm::page::Free(ptr);
+    mm::slab::Free(ptr);
 }
 
 // sized delete (C++14+)
-void operator delete(void *ptr, size_t) noexcept { mm::page::Free(ptr); }
-void operator delete[](void *ptr, size_t) noexcept { mm::page::Free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { mm::slab::Free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { mm::slab::Free(ptr); }
@@ -5,142 +5,1177 @@
 #include <cstdint>
 #include <cstring>
 
+#include "kernel/cpu.h"
+#include "kernel/io.h"
 #include "kernel/mm.h"
+#include "kernel/task.h"
 #include "kernel/tty.h"
 
 namespace mm::page {
 FrameMem frame;
 PTE *kernel_pml4;
 
-// Allocate N contiguous pages. Returns physical address (page-aligned) or
-// nullptr.
-void *AllocPages(std::size_t n) {
-    if (n == 0) n = 1;
-    if (frame.free_pages < n) return nullptr;
-    std::uint64_t total = frame.total_pages;
-    for (std::uint64_t start = 0; start + n <= total; ++start) {
-        bool ok = true;
-        for (std::size_t j = 0; j < n; ++j) {
-            std::uint64_t idx  = start + j;
-            std::uint64_t byte = idx / 8;
-            int bit            = idx % 8;
-            std::uint8_t mask  = (1u << bit);
-            if (frame.bitmap[byte] & mask) {
-                ok = false;
-                start += j;
-                break;
-            }
+static task::SpinLock page_lock CACHE_ALIGNED;
+static task::SpinLock grow_lock;  // 串行化推迟的页描述符初始化
+static bool gbpages;              // CPU 支持 1GiB 页
+
+// 启动时只初始化这么多页的描述符，其余的在空闲时或内存不足时分批初始化
+#define DEFER_BOOT_PAGES 16384
+#define DEFER_CHUNK_PAGES 16384
+
+static std::uint64_t init_cycles;      // Init 中初始化页描述符耗费的周期
+static std::uint64_t deferred_cycles;  // 推迟的初始化累计耗费的周期
+
+// 按分配时的阶统计在用的页数，在 page_lock 内更新；启动阶段分配的页算作 0 阶
+static std::int64_t used_pages[MAX_ORDER];
+static std::uint64_t nr_tables;  // 页表占用的页，包括启动时建立的
+
+static inline std::uint64_t PageToPfn(Zone *zone, Page *page) {
+    return zone->start_pfn + (page - zone->pages);
+}
+
+// 描述符尚未初始化的页不属于任何分配器，查不到
+static inline Page *ZonePfnToPage(Zone *zone, std::uint64_t pfn) {
+    if (pfn < zone->start_pfn || pfn >= zone->start_pfn + zone->init_pages) {
+        return nullptr;
+    }
+    return &zone->pages[pfn - zone->start_pfn];
+}
+
+static Zone *PfnToZone(std::uint64_t pfn) {
+    for (std::uint32_t i = 0; i < frame.nr_zones; i++) {
+        Zone *zone = &frame.zones[i];
+        if (pfn >= zone->start_pfn &&
+            pfn < zone->start_pfn + zone->total_pages) {
+            return zone;
         }
-        if (!ok) continue;
-        // mark bits
-        for (std::size_t j = 0; j < n; ++j) {
-            std::uint64_t idx  = start + j;
-            std::uint64_t byte = idx / 8;
-            int bit            = idx % 8;
-            std::uint8_t mask  = (1u << bit);
-            frame.bitmap[byte] |= mask;
-            frame.pages[idx].flag  = PAGE_USED;
-            frame.pages[idx].count = 1;
+    }
+    return nullptr;
+}
+
+static inline void *PageToVirt(Zone *zone, Page *page) {
+    return (void *)Phy2Vir(PageToPfn(zone, page) * PAGE_SIZE);
+}
+
+static void FreeListAdd(Zone *zone, std::uint32_t order, Page *page) {
+    FreeArea &area = zone->free_area[order];
+    page->flag     = PAGE_FREE | PAGE_BUDDY;
+    page->order    = order;
+    page->prev     = nullptr;
+    page->next     = area.head;
+    if (area.head) area.head->prev = page;
+    area.head = page;
+    area.nr_free++;
+}
+
+static void FreeListDel(Zone *zone, std::uint32_t order, Page *page) {
+    FreeArea &area = zone->free_area[order];
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        area.head = page->next;
+    }
+    if (page->next) page->next->prev = page->prev;
+    page->prev = page->next = nullptr;
+    page->flag &= ~PAGE_BUDDY;
+    area.nr_free--;
+}
+
+// Take a 2^order block from the zone's free lists, splitting a larger block
+// when needed. Caller holds page_lock.
+static Page *AllocBlock(Zone *zone, std::uint32_t order) {
+    std::uint32_t cur = order;
+    while (cur < MAX_ORDER && zone->free_area[cur].head == nullptr) cur++;
+    if (cur >= MAX_ORDER) return nullptr;
+
+    Page *page = zone->free_area[cur].head;
+    FreeListDel(zone, cur, page);
+
+    // 把多余的一半逐级挂回低阶空闲链表
+    while (cur > order) {
+        cur--;
+        FreeListAdd(zone, cur, page + (1ULL << cur));
+    }
+
+    page->flag  = PAGE_USED;
+    page->count = 1;
+    page->order = order;
+    zone->free_pages -= 1ULL << order;
+    frame.free_pages -= 1ULL << order;
+    return page;
+}
+
+// Try every zone in address order. Caller holds page_lock.
+static Page *AllocBlockAny(std::uint32_t order, Zone **zone_out) {
+    for (std::uint32_t i = 0; i < frame.nr_zones; i++) {
+        Page *page = AllocBlock(&frame.zones[i], order);
+        if (page) {
+            *zone_out = &frame.zones[i];
+            return page;
         }
-        frame.free_pages -= n;
-        std::uint64_t addr = frame.start_usable + start * PAGE_SIZE;
-        return (void *)Phy2Vir(addr);
     }
     return nullptr;
 }
 
+// Return a 2^order block and merge it with its buddies. Buddies never cross
+// a zone boundary. Caller holds page_lock.
+static void FreeBlock(Zone *zone, std::uint64_t pfn, std::uint32_t order) {
+    zone->free_pages += 1ULL << order;
+    frame.free_pages += 1ULL << order;
+
+    while (order < MAX_ORDER - 1) {
+        std::uint64_t buddy_pfn = pfn ^ (1ULL << order);
+        Page *buddy             = ZonePfnToPage(zone, buddy_pfn);
+        if (buddy == nullptr || !(buddy->flag & PAGE_BUDDY) ||
+            buddy->order != order) {
+            break;
+        }
+        FreeListDel(zone, order, buddy);
+        pfn &= ~(1ULL << order);
+        order++;
+    }
+
+    Page *page  = ZonePfnToPage(zone, pfn);
+    page->count = 0;
+    page->size  = 0;
+    FreeListAdd(zone, order, page);
+}
+
+// Free an arbitrary run of pages by splitting it into naturally aligned
+// power-of-two blocks. Caller holds page_lock.
+static void FreeRange(Zone *zone, std::uint64_t pfn, std::uint64_t n) {
+    while (n > 0) {
+        std::uint32_t order = 0;
+        while (order < MAX_ORDER - 1 && !(pfn & (1ULL << order)) &&
+               (2ULL << order) <= n) {
+            order++;
+        }
+        FreeBlock(zone, pfn, order);
+        pfn += 1ULL << order;
+        n -= 1ULL << order;
+    }
+}
+
+static inline std::uint32_t PagesToOrder(std::size_t n) {
+    std::uint32_t order = 0;
+    while ((1ULL << order) < n) order++;
+    return order;
+}
+
+std::uint64_t NrFree(std::uint32_t order) {
+    std::uint64_t nr = 0;
+    for (std::uint32_t i = 0; i < frame.nr_zones; i++) {
+        nr += frame.zones[i].free_area[order].nr_free;
+    }
+    return nr;
+}
+
+// Initialise up to nr more page descriptors of the zone and give those
+// pages to the buddy allocator. Returns the number of pages added.
+static std::uint64_t GrowZone(Zone *zone, std::uint64_t nr) {
+    std::uint64_t left = zone->total_pages - zone->init_pages;
+    if (nr > left) nr = left;
+    if (nr == 0) return 0;
+
+    // 描述符在 init_pages 增加之前对其他路径不可见，清零不需要持有 page_lock
+    memset(&zone->pages[zone->init_pages], 0, nr * sizeof(Page));
+
+    page_lock.lock();
+    std::uint64_t pfn = zone->start_pfn + zone->init_pages;
+    zone->init_pages += nr;
+    FreeRange(zone, pfn, nr);
+    page_lock.unlock();
+    return nr;
+}
+
+std::uint64_t DeferredPages() {
+    std::uint64_t nr = 0;
+    for (std::uint32_t i = 0; i < frame.nr_zones; i++) {
+        nr += frame.zones[i].total_pages - frame.zones[i].init_pages;
+    }
+    return nr;
+}
+
+// Initialise the next chunk of deferred page descriptors. Called from the
+// idle loop until it returns false, and by the allocator when it runs out.
+bool InitDeferred() {
+    grow_lock.lock();
+    std::uint64_t start = rdtsc();
+    std::uint64_t added = 0;
+    for (std::uint32_t i = 0; i < frame.nr_zones && added == 0; i++) {
+        added = GrowZone(&frame.zones[i], DEFER_CHUNK_PAGES);
+    }
+    if (added != 0) {
+        deferred_cycles += rdtsc() - start;
+        if (DeferredPages() == 0) {
+            tty::printk("Memory: deferred page descriptors done, %d cycles\n",
+                        deferred_cycles);
+        }
+    }
+    grow_lock.unlock();
+    return added != 0;
+}
+
+// Set up the buddy free lists. Only the descriptors handed out by the boot
+// allocator are valid at this point; the first DEFER_BOOT_PAGES free pages
+// are initialised here and the rest later by InitDeferred(). The boot
+// allocator hands over physical pointers; switch them to the direct map
+// first.
+void Init() {
+    page_lock.SetName("page");
+    grow_lock.SetName("page_grow");
+    page_lock.lock();
+
+    gbpages = boot_map_stats.gbpages;
+
+    // 让内核对只读页的写入同样触发缺页，写时复制才能覆盖内核代写的情况
+    std::uint64_t cr0;
+    asm __volatile__("mov %%cr0, %0" : "=r"(cr0));
+    asm __volatile__("mov %0, %%cr0" ::"r"(cr0 | CR0_WP));
+
+    frame.free_pages = 0;
+    nr_tables        = boot_map_stats.table_pages;
+    for (std::uint32_t z = 0; z < frame.nr_zones; z++) {
+        Zone *zone  = &frame.zones[z];
+        zone->pages = (Page *)Phy2Vir((std::uint64_t)zone->pages);
+        used_pages[0] += zone->boot_used;
+        for (std::uint32_t i = 0; i < MAX_ORDER; i++) {
+            zone->free_area[i].head    = nullptr;
+            zone->free_area[i].nr_free = 0;
+        }
+        zone->free_pages = 0;
+    }
+
+    page_lock.unlock();
+
+    std::uint64_t start = rdtsc();
+    std::uint64_t nr    = DEFER_BOOT_PAGES;
+    for (std::uint32_t z = 0; z < frame.nr_zones && nr > 0; z++) {
+        nr -= GrowZone(&frame.zones[z], nr);
+    }
+    init_cycles = rdtsc() - start;
+}
+
+// Report the memory discovered at boot, one line per zone.
+void ShowZones() {
+    for (std::uint32_t i = 0; i < frame.nr_zones; i++) {
+        Zone *zone = &frame.zones[i];
+        tty::printk("Memory zone %d: 0x%lx - 0x%lx, %d pages\n", i,
+                    zone->start_pfn * PAGE_SIZE,
+                    (zone->start_pfn + zone->total_pages) * PAGE_SIZE,
+                    zone->total_pages);
+    }
+    tty::printk("Memory: %d MiB usable in %d zones, %d MiB free.\n",
+                frame.total_pages * PAGE_SIZE >> 20, frame.nr_zones,
+                frame.free_pages * PAGE_SIZE >> 20);
+    tty::printk("Memory: page descriptors %d cycles at boot, %d MiB "
+                "deferred, %d bytes each\n",
+                init_cycles, DeferredPages() * PAGE_SIZE >> 20, sizeof(Page));
+
+    // 每个 2MiB 页省掉一个 PT，每个 1GiB 页省掉一个 PD 及其下 512 个 PT；
+    // 逐页映射时每个 4KiB 页都要从 PML4 遍历一次
+    const BootMapStats &st = boot_map_stats;
+    std::uint64_t saved    = st.pages_2m + st.pages_1g * (1 + 512);
+    std::uint64_t walks_4k = st.pages_4k + st.pages_2m * 512 +
+                             st.pages_1g * 512 * 512;
+    tty::printk("Boot mapping: %d x 1GiB, %d x 2MiB, %d x 4KiB pages%s\n",
+                st.pages_1g, st.pages_2m, st.pages_4k,
+                st.gbpages ? "" : " (no 1GiB page support)");
+    tty::printk("Boot mapping: %d table pages (%d KiB saved), %d walks "
+                "instead of %d, %d cycles\n",
+                st.table_pages, saved * PAGE_SIZE >> 10, st.walks, walks_4k,
+                st.cycles);
+}
+
+void *AllocOrder(std::uint32_t order) {
+    if (order >= MAX_ORDER) return nullptr;
+
+    Zone *zone = nullptr;
+    page_lock.lock();
+    Page *page = AllocBlockAny(order, &zone);
+    if (page) {
+        page->size = 1U << order;
+        used_pages[order] += 1LL << order;
+    }
+    page_lock.unlock();
+    if (page == nullptr) return nullptr;
+
+    void *addr = PageToVirt(zone, page);
+#if MM_TRACK_ALLOC == true
+    track::Record(addr, 1ULL << order,
+                  (std::uint64_t)__builtin_return_address(0));
+#endif
+    return addr;
+}
+
+// 空闲时预先清零的单页，GFP_ZERO 的单页分配优先从这里取
+#define ZERO_POOL_MAX 256
+
+static void *zero_pool[ZERO_POOL_MAX];
+static std::uint64_t zero_pool_count;
+static task::SpinLock zero_pool_lock CACHE_ALIGNED;
+
+static void *PopZeroPage() {
+    void *page = nullptr;
+    zero_pool_lock.lock();
+    if (zero_pool_count > 0) page = zero_pool[--zero_pool_count];
+    zero_pool_lock.unlock();
+    return page;
+}
+
+static void *AllocRaw(std::size_t n) {
+    std::uint32_t order = PagesToOrder(n);
+    if (order >= MAX_ORDER) return nullptr;
+
+    Zone *zone = nullptr;
+    page_lock.lock();
+    Page *page = AllocBlockAny(order, &zone);
+    if (page == nullptr) {
+        page_lock.unlock();
+        return nullptr;
+    }
+    if ((1ULL << order) > n) {
+        FreeRange(zone, PageToPfn(zone, page) + n, (1ULL << order) - n);
+    }
+    page->size = n;
+    used_pages[order] += n;
+    page_lock.unlock();
+
+    return PageToVirt(zone, page);
+}
+
+// Give every pooled page back to the buddy allocator. Returns the number of
+// pages released.
+static std::uint64_t DrainZeroPool() {
+    std::uint64_t drained = 0;
+    while (void *page = PopZeroPage()) {
+        FreePages(page, 1);
+        drained++;
+    }
+    return drained;
+}
+
+// The first allocation failure shows who is holding the memory.
+static void TrackFailure() {
+#if MM_TRACK_ALLOC == true
+    static bool dumped = false;
+    if (!dumped) {
+        dumped = true;
+        tty::printk("page: allocation failed, %d pages free\n",
+                    frame.free_pages);
+        track::Dump(8);
+    }
+#endif
+}
+
+// Allocate N contiguous pages. Returns the direct-mapped virtual address
+// (page-aligned) or nullptr. The tail of the rounded-up block is given back
+// to the free lists immediately. With GFP_ZERO the pages come back cleared;
+// single pages are taken from the idle-zeroed pool when it has any.
+void *AllocPages(std::size_t n, std::uint32_t gfp) {
+    if (n == 0) n = 1;
+    void *addr = nullptr;
+    if ((gfp & GFP_ZERO) && n == 1) addr = PopZeroPage();
+
+    if (addr == nullptr) {
+        // 先启用推迟初始化的页，再收回预清零的页
+        addr = AllocRaw(n);
+        while (addr == nullptr && InitDeferred()) addr = AllocRaw(n);
+        if (addr == nullptr && DrainZeroPool() != 0) addr = AllocRaw(n);
+        if (addr == nullptr) {
+            TrackFailure();
+            return nullptr;
+        }
+        if (gfp & GFP_ZERO) memset(addr, 0, n * PAGE_SIZE);
+        swap::Wake();
+    }
+#if MM_TRACK_ALLOC == true
+    track::Record(addr, n, (std::uint64_t)__builtin_return_address(0));
+#endif
+    return addr;
+}
+
+// Clear a page with non-temporal stores: the idle loop should not push the
+// working set of the next task out of the cache.
+static void ZeroPageNT(void *addr) {
+    std::uint64_t *p = reinterpret_cast<std::uint64_t *>(addr);
+    for (std::uint64_t i = 0; i < PAGE_SIZE / 8; i += 4) {
+        asm volatile(
+            "movnti %1, 0(%0)\n\t"
+            "movnti %1, 8(%0)\n\t"
+            "movnti %1, 16(%0)\n\t"
+            "movnti %1, 24(%0)" ::"r"(p + i),
+            "r"(0ULL)
+            : "memory");
+    }
+    asm volatile("sfence" ::: "memory");
+}
+
+// Zero one free page and park it in the pool. Called from the idle loop;
+// returns false when the pool is full or no memory is free so the caller can
+// stop for now.
+bool RefillZeroPool() {
+    if (zero_pool_count >= ZERO_POOL_MAX) return false;
+
+    void *page = AllocRaw(1);
+    if (page == nullptr) return false;
+    ZeroPageNT(page);
+
+    zero_pool_lock.lock();
+    if (zero_pool_count < ZERO_POOL_MAX) {
+        zero_pool[zero_pool_count++] = page;
+        page = nullptr;
+    }
+    zero_pool_lock.unlock();
+
+    if (page != nullptr) {
+        FreePages(page, 1);
+        return false;
+    }
+    return true;
+}
+
+// Convert a direct-mapped kernel address to its page descriptor.
+Page *VirtToPage(const void *addr) {
+    std::uint64_t pfn = Vir2Phy((std::uint64_t)addr) / PAGE_SIZE;
+    Zone *zone        = PfnToZone(pfn);
+    return zone ? ZonePfnToPage(zone, pfn) : nullptr;
+}
+
 void FreePages(void *addr, std::size_t n) {
     if (!addr || n == 0) return;
-    std::uint64_t a = (std::uint64_t)(std::uint64_t)addr;
-    if (a < frame.start_usable) return;
-    std::uint64_t idx = (a - frame.start_usable) / PAGE_SIZE;
-    if (idx >= frame.total_pages) return;
-    for (std::size_t i = 0; i < n && (idx + i) < frame.total_pages; ++i) {
-        std::uint64_t cur  = idx + i;
-        std::uint64_t byte = cur / 8;
-        int bit            = cur % 8;
-        std::uint8_t mask  = (1u << bit);
-        frame.bitmap[byte] &= ~mask;
-        frame.pages[cur].flag  = PAGE_FREE;
-        frame.pages[cur].count = 0;
-    }
-    frame.free_pages += n;
+    std::uint64_t pfn = Vir2Phy((std::uint64_t)addr) / PAGE_SIZE;
+    Zone *zone        = PfnToZone(pfn);
+    if (zone == nullptr) return;
+    Page *page = ZonePfnToPage(zone, pfn);
+    if (page->flag & PAGE_BUDDY) {
+        tty::printk("page: double free of 0x%lx\n", (std::uint64_t)addr);
+        return;
+    }
+
+#if MM_TRACK_ALLOC == true
+    track::Forget(addr);
+#endif
+    page_lock.lock();
+    page->flag = PAGE_FREE;
+    FreeRange(zone, pfn, n);
+    used_pages[PagesToOrder(n)] -= n;
+    page_lock.unlock();
+}
+
+std::uint64_t NrUsed(std::uint32_t order) {
+    std::int64_t nr = used_pages[order];
+    return nr > 0 ? nr : 0;
+}
+
+std::uint64_t NrTables() { return nr_tables; }
+
+std::uint64_t NrZeroPool() { return zero_pool_count; }
+
+// Page-table pages are counted separately from other kernel memory so that
+// meminfo can show what the address spaces cost.
+PTE *AllocTable() {
+    PTE *table = reinterpret_cast<PTE *>(AllocPages(1, GFP_ZERO));
+    if (table != nullptr) __sync_fetch_and_add(&nr_tables, 1);
+    return table;
+}
+
+void FreeTable(PTE *table) {
+    if (table == nullptr) return;
+    __sync_fetch_and_sub(&nr_tables, 1);
+    FreePages(table, 1);
+}
+
+static inline PTE *EntryTable(PTE entry) {
+    return (PTE *)Phy2Vir(entry.value & PAGE_MASK & ~PTE_NO_EXECUTE);
+}
+
+// Install a large page in *entry. Page tables previously hanging there only
+// covered the same range, so they are released (a PD replaced by a 1GiB
+// page may still hold PTs of its own).
+static void SetLargeEntry(PTE *entry, std::uint64_t phys_addr,
+                          std::uint64_t flags, bool pdpt_level) {
+    if ((entry->value & PTE_PRESENT) && !(entry->value & PTE_PAGE_SIZE)) {
+        PTE *table = EntryTable(*entry);
+        if (pdpt_level) {
+            for (int i = 0; i < 512; i++) {
+                if ((table[i].value & PTE_PRESENT) &&
+                    !(table[i].value & PTE_PAGE_SIZE)) {
+                    FreeTable(EntryTable(table[i]));
+                }
+            }
+        }
+        FreeTable(table);
+    }
+    entry->value = (phys_addr & PAGE_MASK) | flags | PTE_PAGE_SIZE;
 }
 
+// Return the next-level table referenced by *entry, allocating it when the
+// entry is empty. A large page found on the way is split into a table of
+// smaller pages covering the same range; sub_size is the page size one level
+// down.
+static PTE *NextTable(PTE *entry, std::uint64_t flags,
+                      std::uint64_t sub_size) {
+    flags &= ~PTE_GLOBAL;  // 全局位只对末级页表项有意义
+    if (!(entry->value & PTE_PRESENT)) {
+        PTE *table   = AllocTable();
+        entry->value = (Vir2Phy((std::uint64_t)table) & PAGE_MASK) |
+                       PTE_PRESENT | PTE_WRITABLE | flags;
+        return table;
+    }
+
+    if (entry->value & PTE_PAGE_SIZE) {
+        PTE *table          = AllocTable();
+        std::uint64_t base  = entry->value & PAGE_MASK & ~PTE_NO_EXECUTE;
+        std::uint64_t attrs =
+            entry->value & (~PAGE_MASK | PTE_NO_EXECUTE) & ~PTE_PAGE_SIZE;
+        if (sub_size != PAGE_SIZE) attrs |= PTE_PAGE_SIZE;
+        for (int i = 0; i < 512; i++) {
+            table[i].value = (base + i * sub_size) | attrs;
+        }
+        entry->value = (Vir2Phy((std::uint64_t)table) & PAGE_MASK) |
+                       (attrs & ~PTE_PAGE_SIZE);
+        return table;
+    }
+
+    return EntryTable(*entry);
+}
+
+// Map one page of page_size bytes (PAGE_SIZE, PAGE_SIZE_2M or PAGE_SIZE_1G).
+// Both addresses must be aligned to page_size. Large pages are installed
+// with PTE_PAGE_SIZE at the PD or PDPT level; a table already sitting
+// there is dropped and its memory released.
 void Map(PTE *pml4, std::uint64_t virt_addr, std::uint64_t phys_addr,
-         std::uint64_t flags) {
+         std::uint64_t flags, std::uint64_t page_size) {
     int pml4_idx = PML4_ENTRY(virt_addr);
     int pdpt_idx = PDPT_ENTRY(virt_addr);
     int pd_idx   = PD_ENTRY(virt_addr);
     int pt_idx   = PT_ENTRY(virt_addr);
+
     // PML4 -> PDPT
-    if (!(pml4[pml4_idx].value & PTE_PRESENT)) {
-        PTE *pdpt = reinterpret_cast<PTE *>(AllocPages(1));
-        memset(pdpt, 0, PAGE_SIZE);
-        pml4[pml4_idx].value =
-            ((std::uint64_t)Vir2Phy((std::uint64_t)pdpt) & PAGE_MASK) |
-            PTE_PRESENT | PTE_WRITABLE | flags;
-    }
-    PTE *pdpt = reinterpret_cast<PTE *>(pml4[pml4_idx].value & PAGE_MASK);
-    if ((std::uint64_t)pdpt < 0xffff800000000000ULL) {
-        pdpt = (PTE *)Phy2Vir((std::uint64_t)pdpt);
+    PTE *pdpt = NextTable(&pml4[pml4_idx], flags, PAGE_SIZE_1G);
+
+    if (page_size == PAGE_SIZE_1G) {
+        SetLargeEntry(&pdpt[pdpt_idx], phys_addr, flags, true);
+        return;
     }
 
     // PDPT -> PD
-    if (!(pdpt[pdpt_idx].value & PTE_PRESENT)) {
-        PTE *pd = reinterpret_cast<PTE *>(AllocPages(1));
-        memset(pd, 0, PAGE_SIZE);
-        pdpt[pdpt_idx].value =
-            ((std::uint64_t)Vir2Phy((std::uint64_t)pd) & PAGE_MASK) |
-            PTE_PRESENT | PTE_WRITABLE | flags;
-    }
-    PTE *pd = reinterpret_cast<PTE *>((std::uint64_t)pdpt[pdpt_idx].value &
-                                      PAGE_MASK);
-    if ((std::uint64_t)pd < 0xffff800000000000ULL) {
-        pd = (PTE *)Phy2Vir((std::uint64_t)pd);
+    PTE *pd = NextTable(&pdpt[pdpt_idx], flags, PAGE_SIZE_2M);
+
+    if (page_size == PAGE_SIZE_2M) {
+        SetLargeEntry(&pd[pd_idx], phys_addr, flags, false);
+        return;
     }
 
     // PD -> PT
-    if (!(pd[pd_idx].value & PTE_PRESENT)) {
-        PTE *pt = reinterpret_cast<PTE *>(AllocPages(1));
-        memset(pt, 0, PAGE_SIZE);
-        pd[pd_idx].value =
-            ((std::uint64_t)Vir2Phy((std::uint64_t)pt) & PAGE_MASK) |
-            PTE_PRESENT | PTE_WRITABLE | flags;
-    }
-    PTE *pt =
-        reinterpret_cast<PTE *>((std::uint64_t)pd[pd_idx].value & PAGE_MASK);
-    if ((std::uint64_t)pt < 0xffff800000000000ULL) {
-        pt = (PTE *)Phy2Vir((std::uint64_t)pt);
-    }
+    PTE *pt = NextTable(&pd[pd_idx], flags, PAGE_SIZE);
 
     // PT
     pt[pt_idx].value = (phys_addr & PAGE_MASK) | flags;
 }
 
-void *Alloc(std::size_t size) {
-    if (size == 0) size = 1;
-    std::size_t total = size + sizeof(std::uint64_t);
-    std::size_t pages = (total + PAGE_SIZE - 1) / PAGE_SIZE;
-    void *base        = AllocPages(pages);
-    if (!base) {
-        // allocation failure: halt
-        return NULL;
+static inline bool LargeAligned(std::uint64_t virt, std::uint64_t phys,
+                                std::uint64_t end, std::uint64_t size) {
+    return !((virt | phys) & (size - 1)) && end - virt >= size;
+}
+
+// Map [virt, virt + size) to [phys, phys + size). The table pointers found
+// on the way down are reused until the walk crosses a table boundary, so a
+// range costs one walk per PT/PD/PDPT it touches instead of one per page.
+// With MAP_LARGE, 2MiB and 1GiB pages are used wherever both addresses are
+// aligned and enough of the range is left.
+void MapRange(PTE *pml4, std::uint64_t virt, std::uint64_t phys,
+              std::uint64_t size, std::uint64_t flags,
+              std::uint32_t map_flags) {
+    bool large        = map_flags & MAP_LARGE;
+    std::uint64_t end = PAGE_ALIGN(virt + size);
+    virt &= PAGE_MASK;
+    phys &= PAGE_MASK;
+
+    while (virt < end) {
+        PTE *pdpt = NextTable(&pml4[PML4_ENTRY(virt)], flags, PAGE_SIZE_1G);
+        do {
+            PTE *pdpte = &pdpt[PDPT_ENTRY(virt)];
+            if (large && gbpages &&
+                LargeAligned(virt, phys, end, PAGE_SIZE_1G)) {
+                SetLargeEntry(pdpte, phys, flags, true);
+                virt += PAGE_SIZE_1G;
+                phys += PAGE_SIZE_1G;
+                continue;
+            }
+
+            PTE *pd = NextTable(pdpte, flags, PAGE_SIZE_2M);
+            do {
+                PTE *pde = &pd[PD_ENTRY(virt)];
+                if (large && LargeAligned(virt, phys, end, PAGE_SIZE_2M)) {
+                    SetLargeEntry(pde, phys, flags, false);
+                    virt += PAGE_SIZE_2M;
+                    phys += PAGE_SIZE_2M;
+                    continue;
+                }
+
+                PTE *pt = NextTable(pde, flags, PAGE_SIZE);
+                do {
+                    pt[PT_ENTRY(virt)].value = phys | flags;
+                    virt += PAGE_SIZE;
+                    phys += PAGE_SIZE;
+                } while (virt < end && PT_ENTRY(virt) != 0);
+            } while (virt < end && PD_ENTRY(virt) != 0);
+        } while (virt < end && PDPT_ENTRY(virt) != 0);
+    }
+}
+
+// Allocate every intermediate table (PDPT, PD and PT) needed to map
+// [virt, virt + size) without installing any page, so that later MapRange
+// or Map calls on the region never allocate.
+void PopulateRange(PTE *pml4, std::uint64_t virt, std::uint64_t size,
+                   std::uint64_t flags) {
+    std::uint64_t end = PAGE_ALIGN(virt + size);
+    virt &= ~(PAGE_SIZE_2M - 1);
+
+    while (virt < end) {
+        PTE *pdpt = NextTable(&pml4[PML4_ENTRY(virt)], flags, PAGE_SIZE_1G);
+        do {
+            PTE *pd = NextTable(&pdpt[PDPT_ENTRY(virt)], flags, PAGE_SIZE_2M);
+            do {
+                NextTable(&pd[PD_ENTRY(virt)], flags, PAGE_SIZE);
+                virt += PAGE_SIZE_2M;
+            } while (virt < end && PD_ENTRY(virt) != 0);
+        } while (virt < end && PDPT_ENTRY(virt) != 0);
+    }
+}
+
+static inline bool TableEmpty(PTE *table) {
+    for (int i = 0; i < 512; i++) {
+        if (table[i].value & PTE_PRESENT) return false;
+    }
+    return true;
+}
+
+// Drop the TLB entries for a range that was just unmapped. Kernel-half
+// tables are shared by every address space and mapped global, so those are
+// always flushed, on the other CPUs too, and a large range needs a global
+// flush. Reloading CR3 without the no-flush bit drops the current PCID's
+// user entries.
+static void FlushRange(PTE *pml4, std::uint64_t virt, std::uint64_t size) {
+    std::uint64_t cr3;
+    asm __volatile__("mov %%cr3, %0" : "=r"(cr3));
+    bool kernel = virt >= 0xffff800000000000ULL;
+    if ((cr3 & PAGE_MASK) != Vir2Phy((std::uint64_t)pml4) && !kernel) {
+        return;
+    }
+    if (kernel) tlb::Shootdown();
+
+    if (size > 32 * PAGE_SIZE) {
+        if (kernel) {
+            tlb::FlushAll();
+        } else {
+            asm __volatile__("mov %0, %%cr3" ::"r"(cr3) : "memory");
+        }
+        return;
+    }
+    for (std::uint64_t a = virt; a < virt + size; a += PAGE_SIZE) {
+        asm __volatile__("invlpg (%0)" ::"r"(a) : "memory");
+    }
+}
+
+// Remove the mappings of [virt, virt + size). Large pages fully inside the
+// range are cleared and partially covered ones are split first. Page
+// tables left empty are freed; the mapped frames themselves belong to the
+// caller and are not touched.
+void UnmapRange(PTE *pml4, std::uint64_t virt, std::uint64_t size) {
+    std::uint64_t start = virt & PAGE_MASK;
+    std::uint64_t end   = PAGE_ALIGN(virt + size);
+    virt                = start;
+
+    while (virt < end) {
+        PTE *pml4e = &pml4[PML4_ENTRY(virt)];
+        if (!(pml4e->value & PTE_PRESENT)) {
+            virt = (virt | ((1ULL << PML4_OFFSET) - 1)) + 1;
+            continue;
+        }
+        PTE *pdpt = EntryTable(*pml4e);
+        do {
+            PTE *pdpte = &pdpt[PDPT_ENTRY(virt)];
+            if (!(pdpte->value & PTE_PRESENT)) {
+                virt = (virt | (PAGE_SIZE_1G - 1)) + 1;
+                continue;
+            }
+            if ((pdpte->value & PTE_PAGE_SIZE) &&
+                LargeAligned(virt, 0, end, PAGE_SIZE_1G)) {
+                pdpte->value = 0;
+                virt += PAGE_SIZE_1G;
+                continue;
+            }
+
+            PTE *pd = NextTable(pdpte, 0, PAGE_SIZE_2M);
+            do {
+                PTE *pde = &pd[PD_ENTRY(virt)];
+                if (!(pde->value & PTE_PRESENT)) {
+                    virt = (virt | (PAGE_SIZE_2M - 1)) + 1;
+                    continue;
+                }
+                if ((pde->value & PTE_PAGE_SIZE) &&
+                    LargeAligned(virt, 0, end, PAGE_SIZE_2M)) {
+                    pde->value = 0;
+                    virt += PAGE_SIZE_2M;
+                    continue;
+                }
+
+                PTE *pt = NextTable(pde, 0, PAGE_SIZE);
+                do {
+                    pt[PT_ENTRY(virt)].value = 0;
+                    virt += PAGE_SIZE;
+                } while (virt < end && PT_ENTRY(virt) != 0);
+
+                if (TableEmpty(pt)) {
+                    pde->value = 0;
+                    FreeTable(pt);
+                }
+            } while (virt < end && PD_ENTRY(virt) != 0);
+
+            // 内核半部的 PD/PDPT 被所有地址空间共享，不能释放
+            if (virt < 0xffff800000000000ULL && TableEmpty(pd)) {
+                pdpte->value = 0;
+                FreeTable(pd);
+            }
+        } while (virt < end && PDPT_ENTRY(virt) != 0);
+    }
+
+    FlushRange(pml4, start, end - start);
+}
+
+// Turn an N-page allocation into N single pages that are freed and
+// reference counted one by one. User memory goes through this once it is
+// mapped, because fork may later share any single page of it.
+void SplitPages(void *addr, std::size_t n) {
+    std::uint64_t pfn = Vir2Phy((std::uint64_t)addr) / PAGE_SIZE;
+    Zone *zone        = PfnToZone(pfn);
+    if (zone == nullptr) return;
+#if MM_TRACK_ALLOC == true
+    // 拆开后的页由地址空间按引用计数管理，不再按调用点跟踪
+    track::Forget(addr);
+#endif
+
+    page_lock.lock();
+    Page *page = ZonePfnToPage(zone, pfn);
+    used_pages[PagesToOrder(n)] -= n;
+    used_pages[0] += n;
+    for (std::size_t i = 0; i < n; i++) {
+        page[i].flag  = PAGE_USED;
+        page[i].count = 1;
+        page[i].size  = 1;
+        page[i].order = 0;
+    }
+    page_lock.unlock();
+}
+
+static inline Page *PhysToPage(std::uint64_t phys) {
+    std::uint64_t pfn = phys / PAGE_SIZE;
+    Zone *zone        = PfnToZone(pfn);
+    return zone ? ZonePfnToPage(zone, pfn) : nullptr;
+}
+
+static inline std::uint64_t EntryPhys(PTE entry) {
+    return entry.value & PAGE_MASK & ~PTE_NO_EXECUTE;
+}
+
+void GetPage(std::uint64_t phys) {
+    Page *page = PhysToPage(phys);
+    if (page) __sync_fetch_and_add(&page->count, 1);
+}
+
+// Drop one reference to a single page and free it with the last one.
+void PutPage(std::uint64_t phys) {
+    Page *page = PhysToPage(phys);
+    if (page == nullptr) return;
+    if (__sync_sub_and_fetch(&page->count, 1) == 0) {
+        if (page->flag & PAGE_LRU) swap::LruDel(page);
+        FreePages((void *)Phy2Vir(phys), 1);
+    }
+}
+
+// Copy one level of user page tables (3 = PDPT ... 1 = PT). Leaf pages are
+// shared: every leaf becomes read-only + PTE_COW in both copies and gains a
+// reference. Read-only pages are tagged too so that a later mprotect cannot
+// hand out write access to a shared frame. Swapped-out leaves share their
+// swap slot. User space is never mapped with large pages.
+static bool CloneLevel(PTE *src, PTE *dst, int level) {
+    for (int i = 0; i < 512; i++) {
+        if (!(src[i].value & PTE_PRESENT)) {
+            if (level == 1 && (src[i].value & PTE_SWAP)) {
+                swap::Dup(src[i].value);
+                dst[i].value = src[i].value;
+            }
+            continue;
+        }
+
+        if (level == 1) {
+            src[i].value = (src[i].value & ~PTE_WRITABLE) | PTE_COW;
+            dst[i].value = src[i].value;
+            GetPage(EntryPhys(src[i]));
+            continue;
+        }
+        if (src[i].value & PTE_PAGE_SIZE) continue;
+
+        PTE *table = AllocTable();
+        if (table == nullptr) return false;
+        dst[i].value = Vir2Phy((std::uint64_t)table) |
+                       (src[i].value & ~PAGE_MASK);
+        if (!CloneLevel(EntryTable(src[i]), table, level - 1)) return false;
+    }
+    return true;
+}
+
+static void FreeLevel(PTE *table, int level) {
+    for (int i = 0; i < 512; i++) {
+        if (!(table[i].value & PTE_PRESENT)) {
+            if (level == 1 && (table[i].value & PTE_SWAP)) {
+                swap::Free(table[i].value);
+            }
+            continue;
+        }
+        if (level == 1) {
+            PutPage(EntryPhys(table[i]));
+            continue;
+        }
+        if (table[i].value & PTE_PAGE_SIZE) continue;
+
+        PTE *next = EntryTable(table[i]);
+        FreeLevel(next, level - 1);
+        FreeTable(next);
+    }
+}
+
+// Release the user half of an address space: drop a reference on every
+// mapped page, free the page tables and finally the PML4 itself. The
+// address space must not be loaded in CR3.
+void FreeUserSpace(PTE *pml4) {
+    for (int i = 0; i < 256; i++) {
+        if (!(pml4[i].value & PTE_PRESENT)) continue;
+        PTE *pdpt = EntryTable(pml4[i]);
+        FreeLevel(pdpt, 3);
+        FreeTable(pdpt);
+    }
+    FreeTable(pml4);
+}
+
+static void CountLevel(PTE *table, int level, UserSpaceStats *st) {
+    for (int i = 0; i < 512; i++) {
+        if (!(table[i].value & PTE_PRESENT)) {
+            if (level == 1 && (table[i].value & PTE_SWAP)) st->swapped++;
+            continue;
+        }
+        if (level == 1) {
+            st->resident++;
+            continue;
+        }
+        if (table[i].value & PTE_PAGE_SIZE) continue;
+        st->tables++;
+        CountLevel(EntryTable(table[i]), level - 1, st);
+    }
+}
+
+// Count the resident and swapped-out pages and the page tables of the user
+// half of an address space, the PML4 included. The caller keeps the address
+// space from being torn down meanwhile.
+void CountUserSpace(PTE *pml4, UserSpaceStats *st) {
+    st->resident = 0;
+    st->swapped  = 0;
+    st->tables   = 1;
+    for (int i = 0; i < 256; i++) {
+        if (!(pml4[i].value & PTE_PRESENT)) continue;
+        st->tables++;
+        CountLevel(EntryTable(pml4[i]), 3, st);
+    }
+}
+
+// Call fn on every present or swapped-out 4KiB leaf of [virt, end), skipping
+// whole unpopulated tables. Large pages are skipped as well.
+static void WalkLeaves(PTE *pml4, std::uint64_t virt, std::uint64_t end,
+                       void (*fn)(PTE *pte, std::uint64_t arg),
+                       std::uint64_t arg) {
+    while (virt < end) {
+        PTE *entry = &pml4[PML4_ENTRY(virt)];
+        if (!(entry->value & PTE_PRESENT)) {
+            virt = (virt | ((1ULL << PML4_OFFSET) - 1)) + 1;
+            continue;
+        }
+        entry = &EntryTable(*entry)[PDPT_ENTRY(virt)];
+        if (!(entry->value & PTE_PRESENT) || (entry->value & PTE_PAGE_SIZE)) {
+            virt = (virt | (PAGE_SIZE_1G - 1)) + 1;
+            continue;
+        }
+        entry = &EntryTable(*entry)[PD_ENTRY(virt)];
+        if (!(entry->value & PTE_PRESENT) || (entry->value & PTE_PAGE_SIZE)) {
+            virt = (virt | (PAGE_SIZE_2M - 1)) + 1;
+            continue;
+        }
+        entry = &EntryTable(*entry)[PT_ENTRY(virt)];
+        if (entry->value & (PTE_PRESENT | PTE_SWAP)) fn(entry, arg);
+        virt += PAGE_SIZE;
+    }
+}
+
+// 先原子地清掉页表项再放掉它引用的页或交换槽，页表项不会指向已释放的页
+static void PutLeaf(PTE *pte, std::uint64_t) {
+    PTE old;
+    old.value = __atomic_exchange_n(&pte->value, 0, __ATOMIC_SEQ_CST);
+    if (old.value & PTE_PRESENT) {
+        PutPage(EntryPhys(old));
+    } else {
+        swap::Free(old.value);
+    }
+}
+
+// 只改权限位：写时复制的页保持只读，由缺页处理决定是否复制；不可访问的
+// 区域去掉 PTE_USER 而保留页面，以便之后恢复权限
+static void ProtectLeaf(PTE *pte, std::uint64_t flags) {
+    std::uint64_t old = __atomic_load_n(&pte->value, __ATOMIC_RELAXED);
+    std::uint64_t value;
+    do {
+        if (!(old & PTE_PRESENT)) return;  // 换入时按区域权限映射
+        value = old & ~(PTE_WRITABLE | PTE_USER);
+        if ((flags & PTE_WRITABLE) && !(value & PTE_COW)) value |= PTE_WRITABLE;
+        value |= flags & PTE_USER;
+        // 硬件可能同时置访问位和脏位，不能用普通写覆盖
+    } while (!__atomic_compare_exchange_n(&pte->value, &old, value, true,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+}
+
+// Unmap a user range and drop the reference of every page mapped in it.
+void ReleaseRange(PTE *pml4, std::uint64_t virt, std::uint64_t size) {
+    WalkLeaves(pml4, virt, virt + size, PutLeaf, 0);
+    UnmapRange(pml4, virt, size);
+}
+
+// Apply new PTE flags to the pages already mapped in a user range.
+void ProtectRange(PTE *pml4, std::uint64_t virt, std::uint64_t size,
+                  std::uint64_t flags) {
+    WalkLeaves(pml4, virt, virt + size, ProtectLeaf, flags);
+    FlushRange(pml4, virt, size);
+}
+
+// Build a copy-on-write clone of a user address space. The caller must
+// flush the TLB of the source address space afterwards since its writable
+// pages have just become read-only.
+PTE *CloneUserSpace(PTE *src) {
+    PTE *dst = AllocTable();
+    if (dst == nullptr) return nullptr;
+    UpdateKernelPml4(dst);
+
+    for (int i = 0; i < 256; i++) {
+        if (!(src[i].value & PTE_PRESENT)) continue;
+
+        PTE *pdpt = AllocTable();
+        if (pdpt != nullptr) {
+            dst[i].value = Vir2Phy((std::uint64_t)pdpt) |
+                           (src[i].value & ~PAGE_MASK);
+        }
+        if (pdpt == nullptr || !CloneLevel(EntryTable(src[i]), pdpt, 3)) {
+            FreeUserSpace(dst);
+            return nullptr;
+        }
     }
-    // store page count at base
-    *(reinterpret_cast<std::uint64_t *>(base)) = pages;
+    return dst;
+}
+
+// Find the slot of the 4KiB leaf entry for virt, present or not. Returns
+// nullptr when no page table covers virt or it is mapped by a large page.
+PTE *FindLeaf(PTE *pml4, std::uint64_t virt) {
+    PTE *entry = &pml4[PML4_ENTRY(virt)];
+    if (!(entry->value & PTE_PRESENT)) return nullptr;
+    entry = &EntryTable(*entry)[PDPT_ENTRY(virt)];
+    if (!(entry->value & PTE_PRESENT) || (entry->value & PTE_PAGE_SIZE)) {
+        return nullptr;
+    }
+    entry = &EntryTable(*entry)[PD_ENTRY(virt)];
+    if (!(entry->value & PTE_PRESENT) || (entry->value & PTE_PAGE_SIZE)) {
+        return nullptr;
+    }
+    return &EntryTable(*entry)[PT_ENTRY(virt)];
+}
+
+// Find the 4KiB leaf entry for virt, or nullptr when it is not mapped by a
+// 4KiB page.
+static PTE *LookupPte(PTE *pml4, std::uint64_t virt) {
+    PTE *entry = FindLeaf(pml4, virt);
+    return (entry && (entry->value & PTE_PRESENT)) ? entry : nullptr;
+}
 
-    return base;
+// Physical address behind a 4KiB mapping, or 0 when virt is not mapped by
+// a 4KiB page.
+std::uint64_t Translate(PTE *pml4, std::uint64_t virt) {
+    PTE *pte = LookupPte(pml4, virt);
+    return pte ? EntryPhys(*pte) : 0;
+}
+
+// Resolve a write fault on a copy-on-write page of the current address
+// space. The last owner just gets write access back, everyone else gets a
+// private copy. Returns false when the fault is not a COW fault.
+bool HandleFault(std::uint64_t addr, std::uint64_t error_code) {
+    if (!(error_code & PF_ERR_PRESENT) || !(error_code & PF_ERR_WRITE)) {
+        return false;
+    }
+    if (addr >= 0xffff800000000000ULL) return false;
+
+    std::uint64_t cr3;
+    asm __volatile__("mov %%cr3, %0" : "=r"(cr3));
+    PTE *pte = LookupPte((PTE *)Phy2Vir(cr3 & PAGE_MASK), addr);
+    if (pte == nullptr || !(pte->value & PTE_COW)) return false;
+    task::Mem *mm = &task::CurrentProc()->mm;
+
+    PTE old            = *pte;
+    std::uint64_t phys = EntryPhys(old);
+    Page *page         = PhysToPage(phys);
+    std::uint64_t attrs =
+        (old.value & (~PAGE_MASK | PTE_NO_EXECUTE) & ~PTE_COW) | PTE_WRITABLE;
+
+    // 别的 CPU 上的回收者可能正把这一项换成交换项：在 mm->lock 内用 CAS
+    // 替换，项已变化时返回，重新执行的访问会再次缺页
+    std::uint64_t flags;
+    if (page != nullptr && page->count == 1) {
+        flags     = mm->lock.lock_irqsave();
+        bool same = __atomic_compare_exchange_n(
+            &pte->value, &old.value, phys | attrs, false, __ATOMIC_SEQ_CST,
+            __ATOMIC_RELAXED);
+        // 最后的持有者可能不是当初把页放进 LRU 的进程，重新登记
+        if (same) swap::LruAdd((void *)Phy2Vir(phys), mm, addr & PAGE_MASK);
+        mm->lock.unlock_irqrestore(flags);
+    } else {
+        void *copy = swap::AllocPage();
+        if (copy == nullptr) return false;
+        memcpy(copy, (void *)Phy2Vir(phys), PAGE_SIZE);
+        SplitPages(copy, 1);
+
+        // 回收期间可能睡眠，重新确认页表项没有变化
+        flags     = mm->lock.lock_irqsave();
+        PTE cur   = *pte;
+        bool same = (cur.value & PTE_PRESENT) && EntryPhys(cur) == phys;
+        if (same) {
+            same = __atomic_compare_exchange_n(
+                &pte->value, &cur.value, Vir2Phy((std::uint64_t)copy) | attrs,
+                false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        }
+        if (same) swap::LruAdd(copy, mm, addr & PAGE_MASK);
+        mm->lock.unlock_irqrestore(flags);
+        PutPage(same ? phys : Vir2Phy((std::uint64_t)copy));
+    }
+
+    asm __volatile__("invlpg (%0)" ::"r"(addr & PAGE_MASK) : "memory");
+    return true;
+}
+
+// Allocate page-aligned memory. The page count is recorded in the head
+// page descriptor so that Free() does not need a size.
+void *Alloc(std::size_t size, std::uint32_t gfp) {
+    if (size == 0) size = 1;
+    std::size_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    void *addr        = AllocPages(pages, gfp);
+#if MM_TRACK_ALLOC == true
+    // 记到 Alloc 的调用者名下，而不是这里
+    if (addr) {
+        track::Record(addr, pages, (std::uint64_t)__builtin_return_address(0));
+    }
+#endif
+    return addr;
 }
 
 void Free(void *addr) {
     if (!addr) return;
-    std::uint8_t *p      = reinterpret_cast<std::uint8_t *>(addr);
-    std::uint8_t *header = p - sizeof(std::uint64_t);
-    std::uint64_t base   = (std::uint64_t)header & PAGE_MASK;
-    std::uint64_t pages  = *(reinterpret_cast<std::uint64_t *>(base));
-    // Delegate to the boot frame allocator
-    FreePages(addr, pages);
+    Page *page = VirtToPage(addr);
+    if (page == nullptr || page->size == 0) return;
+    FreePages(addr, page->size);
+}
+
+// Boot-time sanity check: allocate one block of every order, verify
+// alignment and that the blocks do not overlap, then free everything and
+// make sure the free lists coalesce back to their original shape.
+void SelfTest() {
+    std::uint64_t free_before = frame.free_pages;
+    std::uint64_t nr_free_before[MAX_ORDER];
+    for (std::uint32_t o = 0; o < MAX_ORDER; o++) {
+        nr_free_before[o] = NrFree(o);
+    }
+
+    bool ok = true;
+    void *blocks[MAX_ORDER];
+    for (std::uint32_t o = 0; o < MAX_ORDER; o++) {
+        blocks[o] = AllocOrder(o);
+        if (blocks[o] == nullptr) continue;
+
+        std::uint64_t pfn = Vir2Phy((std::uint64_t)blocks[o]) / PAGE_SIZE;
+        if (pfn & ((1ULL << o) - 1)) ok = false;
+
+        // 在每块的首页和末页写入标记
+        std::uint64_t *first = (std::uint64_t *)blocks[o];
+        std::uint64_t *last =
+            (std::uint64_t *)((std::uint64_t)first + (PAGE_SIZE << o) - 8);
+        *first = 0x5a5a000000000000ULL | o;
+        *last  = 0xa5a5000000000000ULL | o;
+    }
+    for (std::uint32_t o = 0; o < MAX_ORDER; o++) {
+        if (blocks[o] == nullptr) continue;
+        std::uint64_t *first = (std::uint64_t *)blocks[o];
+        std::uint64_t *last =
+            (std::uint64_t *)((std::uint64_t)first + (PAGE_SIZE << o) - 8);
+        if (*first != (0x5a5a000000000000ULL | o)) ok = false;
+        if (*last != (0xa5a5000000000000ULL | o)) ok = false;
+    }
+
+    // 非 2 的幂的分配会把尾部还给空闲链表
+    void *odd = AllocPages(3);
+    if (odd == nullptr || VirtToPage(odd)->size != 3) ok = false;
+    Free(odd);
+
+    for (std::uint32_t o = 0; o < MAX_ORDER; o++) {
+        if (blocks[o]) FreePages(blocks[o], 1ULL << o);
+    }
+
+    if (frame.free_pages != free_before) ok = false;
+    for (std::uint32_t o = 0; o < MAX_ORDER; o++) {
+        if (NrFree(o) != nr_free_before[o]) ok = false;
+    }
+
+    if (!ok) {
+        tty::Panic("Buddy allocator self-test failed.\n");
+    }
+    tty::printk("Buddy allocator self-test passed, %d free pages.\n",
+                frame.free_pages);
+}
+
+// Measure allocation throughput for orders 0-9. Each round allocates and
+// frees a batch of blocks for BENCH_TICKS timer ticks; must be called with
+// the timer running.
+void Benchmark() {
+    const std::uint64_t BENCH_TICKS = 10;
+    const int BATCH                 = 16;
+    void *batch[BATCH];
+
+    for (std::uint32_t o = 0; o < 10; o++) {
+        std::uint64_t count = 0;
+        std::uint64_t start = timer::GetTicks();
+        while (timer::GetTicks() == start) {
+        }
+        start = timer::GetTicks();
+
+        while (timer::GetTicks() - start < BENCH_TICKS) {
+            int n = 0;
+            for (; n < BATCH; n++) {
+                batch[n] = AllocOrder(o);
+                if (batch[n] == nullptr) break;
+            }
+            for (int i = 0; i < n; i++) {
+                FreePages(batch[i], 1ULL << o);
+            }
+            count += n;
+            if (n == 0) break;
+        }
+
+        tty::printk("Buddy benchmark: order %d, %d allocs/s\n", o,
+                    count * TIMER_FREQUENCY / BENCH_TICKS);
+    }
 }
 
 void UpdateKernelPml4(PTE *user_pml4) {
@@ -242,6 +1277,16 @@ std::uint64_t AnalyzePageTable(PTE *pml4, std::uint64_t virt_addr) {
         return 0;
     }
 
+    if (pdpt_entry.value & PTE_PAGE_SIZE) {
+        std::uint64_t phy_addr =
+            (pdpt_entry.value & ~(PAGE_SIZE_1G - 1) & ~PTE_NO_EXECUTE) +
+            (virt_addr & (PAGE_SIZE_1G - 1));
+        tty::printk("\nMapping Successful (1GiB page)!\n");
+        tty::printk("  Virtual Address 0x%lx → Physical Address 0x%lx\n",
+                    virt_addr, phy_addr);
+        return phy_addr;
+    }
+
     // -------------------------- Analyze PD Level --------------------------
     std::uint64_t pd_phys = pdpt_entry.value & PAGE_MASK;
     PTE *pd               = reinterpret_cast<PTE *>(pd_phys);
@@ -263,6 +1308,16 @@ std::uint64_t AnalyzePageTable(PTE *pml4, std::uint64_t virt_addr) {
         return 0;
     }
 
+    if (pd_entry.value & PTE_PAGE_SIZE) {
+        std::uint64_t phy_addr =
+            (pd_entry.value & ~(PAGE_SIZE_2M - 1) & ~PTE_NO_EXECUTE) +
+            (virt_addr & (PAGE_SIZE_2M - 1));
+        tty::printk("\nMapping Successful (2MiB page)!\n");
+        tty::printk("  Virtual Address 0x%lx → Physical Address 0x%lx\n",
+                    virt_addr, phy_addr);
+        return phy_addr;
+    }
+
     // -------------------------- Analyze PT Level --------------------------
     std::uint64_t pt_phys = pd_entry.value & PAGE_MASK;
     PTE *pt               = reinterpret_cast<PTE *>(pt_phys);
@@ -1,3 +1,11 @@
+/**
+ * @file slab.cc
+ * @brief Slab object caches and the kmalloc size classes
+ * @author Kumosya, 2025-2026
+ **/
+
+#include "kernel/slab.h"
+
 #include <cstdint>
 #include <cstring>
 
@@ -6,14 +14,239 @@
 #include "kernel/tty.h"
 
 namespace mm::slab {
+
+#define KMALLOC_CACHES (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+static Cache cache_cache;  // 用于分配 Cache 结构本身
+static Cache kmalloc_caches[KMALLOC_CACHES];
+static Cache *cache_list = nullptr;
+static task::SpinLock cache_list_lock CACHE_ALIGNED;
+static bool initialized = false;
+
+static const char *kmalloc_names[KMALLOC_CACHES] = {
+    "kmalloc-8",   "kmalloc-16",  "kmalloc-32",  "kmalloc-64",
+    "kmalloc-128", "kmalloc-256", "kmalloc-512", "kmalloc-1024",
+};
+
+static void RegisterCache(Cache *cache) {
+    cache_list_lock.lock();
+    cache->next = cache_list;
+    cache_list  = cache;
+    cache_list_lock.unlock();
+}
+
+void Cache::Init(const char *cache_name, std::size_t size, std::size_t align,
+                 void (*constructor)(void *)) {
+    strncpy(name, cache_name, SLAB_NAME_LEN - 1);
+    name[SLAB_NAME_LEN - 1] = '\0';
+
+    if (align < SLAB_MIN_ALIGN) align = SLAB_MIN_ALIGN;
+    if (size < sizeof(void *)) size = sizeof(void *);
+
+    // 有构造函数时链接指针放在对象之后，不覆盖构造好的内容
+    std::size_t link = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    free_off         = constructor ? link : 0;
+    obj_size         = constructor ? link + sizeof(void *) : size;
+
+    obj_size  = (obj_size + align - 1) & ~(align - 1);
+    offset    = (sizeof(Slab) + align - 1) & ~(align - 1);
+    per_slab  = (PAGE_SIZE - offset) / obj_size;
+    ctor      = constructor;
+    partial   = nullptr;
+    full      = nullptr;
+    empty     = nullptr;
+    nr_slabs  = 0;
+    nr_active = 0;
+    next      = nullptr;
+    lock.SetName("slab");
+}
+
+void Cache::ListAdd(Slab **head, Slab *slab) {
+    slab->prev = nullptr;
+    slab->next = *head;
+    if (*head) (*head)->prev = slab;
+    *head = slab;
+}
+
+void Cache::ListDel(Slab **head, Slab *slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->prev = slab->next = nullptr;
+}
+
+// 分配一页作为新 slab，并把其中的对象串成空闲链表
+Slab *Cache::Grow() {
+    void *page_addr = page::AllocPages(1);
+    if (page_addr == nullptr) return nullptr;
+
+    Page *page = page::VirtToPage(page_addr);
+    page->flag |= PAGE_SLAB;
+
+    Slab *slab     = reinterpret_cast<Slab *>(page_addr);
+    slab->cache    = this;
+    slab->inuse    = 0;
+    slab->total    = per_slab;
+    slab->freelist = nullptr;
+
+    std::uint8_t *base = reinterpret_cast<std::uint8_t *>(page_addr) + offset;
+    for (std::int64_t i = per_slab - 1; i >= 0; i--) {
+        void *obj = base + i * obj_size;
+        if (ctor) ctor(obj);
+        *Link(obj)     = slab->freelist;
+        slab->freelist = obj;
+    }
+
+    nr_slabs++;
+    return slab;
+}
+
+void *Cache::Alloc() {
+    lock.lock();
+
+    Slab *slab = partial;
+    if (slab == nullptr) {
+        slab = empty;
+        if (slab != nullptr) {
+            ListDel(&empty, slab);
+        } else {
+            slab = Grow();
+            if (slab == nullptr) {
+                lock.unlock();
+                return nullptr;
+            }
+        }
+        ListAdd(&partial, slab);
+    }
+
+    void *obj      = slab->freelist;
+    slab->freelist = *Link(obj);
+    slab->inuse++;
+    nr_active++;
+
+    if (slab->inuse == slab->total) {
+        ListDel(&partial, slab);
+        ListAdd(&full, slab);
+    }
+
+    lock.unlock();
+    return obj;
+}
+
+void Cache::Free(void *obj) {
+    if (obj == nullptr) return;
+
+    Slab *slab = reinterpret_cast<Slab *>((std::uint64_t)obj & PAGE_MASK);
+
+    lock.lock();
+
+    bool was_full  = (slab->inuse == slab->total);
+    *Link(obj)     = slab->freelist;
+    slab->freelist = obj;
+    slab->inuse--;
+    nr_active--;
+
+    if (was_full) {
+        ListDel(&full, slab);
+        ListAdd(&partial, slab);
+    }
+    if (slab->inuse == 0) {
+        ListDel(&partial, slab);
+        ListAdd(&empty, slab);
+    }
+
+    lock.unlock();
+}
+
+std::uint64_t Cache::Shrink() {
+    std::uint64_t freed = 0;
+
+    lock.lock();
+    while (empty != nullptr) {
+        Slab *slab = empty;
+        ListDel(&empty, slab);
+        page::VirtToPage(slab)->flag &= ~PAGE_SLAB;
+        page::FreePages(slab, 1);
+        nr_slabs--;
+        freed++;
+    }
+    lock.unlock();
+
+    return freed;
+}
+
+Cache *CreateCache(const char *name, std::size_t size, void (*ctor)(void *)) {
+    if (size > KMALLOC_MAX_SIZE) {
+        tty::printk("Slab: object size %d too large for cache %s\n", size,
+                    name);
+        return nullptr;
+    }
+
+    Cache *cache = reinterpret_cast<Cache *>(cache_cache.Alloc());
+    if (cache == nullptr) return nullptr;
+
+    memset(cache, 0, sizeof(Cache));
+    cache->Init(name, size, SLAB_MIN_ALIGN, ctor);
+    RegisterCache(cache);
+    return cache;
+}
+
+void DestroyCache(Cache *cache) {
+    if (cache == nullptr) return;
+
+    cache_list_lock.lock();
+    Cache **pp = &cache_list;
+    while (*pp && *pp != cache) pp = &(*pp)->next;
+    if (*pp) *pp = cache->next;
+    cache_list_lock.unlock();
+
+    cache->Shrink();
+    cache_cache.Free(cache);
+}
+
+Cache *CacheList() { return cache_list; }
+
+static inline int KmallocIndex(std::size_t size) {
+    int shift = KMALLOC_MIN_SHIFT;
+    while ((1ULL << shift) < size) shift++;
+    return shift - KMALLOC_MIN_SHIFT;
+}
+
+void *Alloc(std::size_t size) {
+    if (size == 0) size = 1;
+    if (size > KMALLOC_MAX_SIZE || !initialized) {
+        return page::Alloc(size);
+    }
+    return kmalloc_caches[KmallocIndex(size)].Alloc();
+}
+
+void Free(void *ptr) {
+    if (ptr == nullptr) return;
+
+    Page *page = page::VirtToPage(ptr);
+    if (page != nullptr && (page->flag & PAGE_SLAB)) {
+        Slab *slab = reinterpret_cast<Slab *>((std::uint64_t)ptr & PAGE_MASK);
+        slab->cache->Free(ptr);
+    } else {
+        page::Free(ptr);
+    }
+}
+
 void Init() {
-    /* TODO */
+    cache_list_lock.SetName("slab_list");
+    cache_cache.Init("cache", sizeof(Cache), SLAB_MIN_ALIGN, nullptr);
+    RegisterCache(&cache_cache);
 
-    tty::printk("Slab initialized.\n");
+    for (int i = 0; i < KMALLOC_CACHES; i++) {
+        kmalloc_caches[i].Init(kmalloc_names[i], 1 << (i + KMALLOC_MIN_SHIFT),
+                               SLAB_MIN_ALIGN, nullptr);
+        RegisterCache(&kmalloc_caches[i]);
+    }
+    initialized = true;
 
-    int *p = new int;
-    *p     = 0x3456789a;
-    tty::printk("p = 0x%lx, *p = 0x%x\n", (std::uint64_t)p, *p);
-    delete p;
+    tty::printk("Slab initialized.\n");
 }
-}  // namespace mm::slab
\ No newline at end of file
+}  // namespace mm::slab
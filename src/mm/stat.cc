@@ -0,0 +1,183 @@
+/**
+ * @file stat.cc
+ * @brief Memory statistics for meminfo: buddy orders, slab caches and
+ *        per-process usage
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+#include <cstring>
+#include <sys/meminfo.h>
+
+#include "kernel/io.h"
+#include "kernel/mm.h"
+#include "kernel/page.h"
+#include "kernel/slab.h"
+#include "kernel/task.h"
+
+namespace mm::stat {
+
+static task::Mem *mm_list;  // 所有用户地址空间
+static task::SpinLock mm_list_lock CACHE_ALIGNED;
+
+// Register a user address space so that meminfo can find it. Called when a
+// process gets its first user page tables.
+void Attach(task::Mem *mm, task::Pcb *owner) {
+    std::uint64_t flags = mm_list_lock.lock_irqsave();
+    mm->owner = owner;
+    mm->prev  = nullptr;
+    mm->next  = mm_list;
+    if (mm_list) mm_list->prev = mm;
+    mm_list = mm;
+    mm_list_lock.unlock_irqrestore(flags);
+}
+
+// Remove an address space before its page tables are freed. The list is
+// walked with interrupts disabled, so once this returns no walk can still
+// be looking at it.
+void Detach(task::Mem *mm) {
+    std::uint64_t flags = mm_list_lock.lock_irqsave();
+    if (mm->owner != nullptr) {
+        if (mm->prev) {
+            mm->prev->next = mm->next;
+        } else {
+            mm_list = mm->next;
+        }
+        if (mm->next) mm->next->prev = mm->prev;
+        mm->owner = nullptr;
+        mm->prev  = nullptr;
+        mm->next  = nullptr;
+    }
+    mm_list_lock.unlock_irqrestore(flags);
+}
+
+// Unusable free space index of an order: the share of free memory, in
+// thousandths, sitting in blocks too small for a request of that order.
+static std::uint64_t FragIndex(std::uint32_t order) {
+    std::uint64_t total = 0, usable = 0;
+    for (std::uint32_t o = 0; o < MAX_ORDER; o++) {
+        std::uint64_t pages = page::NrFree(o) << o;
+        total += pages;
+        if (o >= order) usable += pages;
+    }
+    return total ? (total - usable) * 1000 / total : 0;
+}
+
+static void FillSummary(struct meminfo *info) {
+    info->total_pages    = page::frame.total_pages;
+    info->free_pages     = page::frame.free_pages;
+    info->deferred_pages = page::DeferredPages();
+    info->table_pages    = page::NrTables();
+    info->vmalloc_pages  = vmalloc::NrPages();
+    info->zero_pages     = page::NrZeroPool();
+    info->lru_pages      = swap::NrLru();
+    info->swap_pages     = swap::NrSlots();
+    info->swap_free      = swap::NrFreeSlots();
+    info->nr_orders      = MAX_ORDER;
+    info->frag_index     = FragIndex(MAX_ORDER - 1);
+    for (slab::Cache *c = slab::CacheList(); c != nullptr; c = c->next) {
+        info->slab_pages += c->Slabs();
+    }
+}
+
+static bool FillOrder(std::uint64_t order, meminfo_order *info) {
+    if (order >= MAX_ORDER) return false;
+    info->order       = order;
+    info->free_blocks = page::NrFree(order);
+    info->used_pages  = page::NrUsed(order);
+    info->frag_index  = FragIndex(order);
+    return true;
+}
+
+static bool FillSlab(std::uint64_t index, meminfo_slab *info) {
+    slab::Cache *c = slab::CacheList();
+    while (c != nullptr && index-- > 0) c = c->next;
+    if (c == nullptr) return false;
+
+    strncpy(info->name, c->Name(), MEMINFO_NAME_LEN - 1);
+    info->object_size    = c->ObjectSize();
+    info->active_objects = c->ActiveObjects();
+    info->total_objects  = c->TotalObjects();
+    info->slabs          = c->Slabs();
+    return true;
+}
+
+static void FillProc(task::Mem *mm, meminfo_proc *info) {
+    UserSpaceStats st;
+    page::CountUserSpace(mm->pml4, &st);
+    info->pid         = mm->owner->pid;
+    info->rss         = st.resident;
+    info->swapped     = st.swapped;
+    info->table_pages = st.tables;
+    info->nr_vmas     = mm->vmas.nr_vmas;
+    for (Vma *vma = mm->vmas.head; vma != nullptr; vma = vma->next) {
+        info->vm_pages += (vma->end - vma->start) / PAGE_SIZE;
+    }
+}
+
+static bool FillSite(std::uint64_t index, meminfo_site *info) {
+#if MM_TRACK_ALLOC == true
+    track::Site site;
+    if (!track::GetSite(index, &site)) return false;
+    info->rip    = site.rip;
+    info->pages  = site.pages;
+    info->blocks = site.count;
+    info->age_ms = site.age * TIMER_PERIOD;
+    return true;
+#else
+    (void)index;
+    (void)info;
+    return false;
+#endif
+}
+
+// Index -1 selects the caller. The walk runs with interrupts disabled so
+// the address space cannot exit under it.
+static bool FindProc(std::int64_t index, task::Pcb *caller,
+                     meminfo_proc *info) {
+    std::uint64_t flags = mm_list_lock.lock_irqsave();
+    task::Mem *mm = mm_list;
+    if (index < 0) {
+        while (mm != nullptr && mm->owner != caller) mm = mm->next;
+    } else {
+        while (mm != nullptr && index-- > 0) mm = mm->next;
+    }
+    if (mm != nullptr) FillProc(mm, info);
+    mm_list_lock.unlock_irqrestore(flags);
+    return mm != nullptr;
+}
+
+// Handle a SYS_MM_MEMINFO request: num[0] selects the section and num[1]
+// the entry. The reply has 0 or -1 in num[0] and the record from num[1] on.
+void Query(task::ipc::Message *msg) {
+    std::uint64_t what = msg->num[0];
+    std::int64_t index = msg->num[1];
+    void *buf          = &msg->num[1];
+    memset(buf, 0, sizeof(msg->data) - sizeof(msg->num[0]));
+
+    bool ok = true;
+    switch (what) {
+        case MEMINFO_SUMMARY:
+            FillSummary(reinterpret_cast<struct meminfo *>(buf));
+            break;
+        case MEMINFO_ORDER:
+            ok = FillOrder(index, reinterpret_cast<meminfo_order *>(buf));
+            break;
+        case MEMINFO_SLAB:
+            ok = FillSlab(index, reinterpret_cast<meminfo_slab *>(buf));
+            break;
+        case MEMINFO_PROC:
+            ok = FindProc(index, msg->sender,
+                          reinterpret_cast<meminfo_proc *>(buf));
+            break;
+        case MEMINFO_SITE:
+            ok = FillSite(index, reinterpret_cast<meminfo_site *>(buf));
+            break;
+        default:
+            ok = false;
+            break;
+    }
+    msg->num[0] = ok ? 0 : -1;
+}
+
+}  // namespace mm::stat
@@ -0,0 +1,416 @@
+/**
+ * @file swap.cc
+ * @brief LRU of user pages, page reclaim and swap to a block device
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+#include <cstring>
+
+#include "kernel/block.h"
+#include "kernel/fs/ext2.h"
+#include "kernel/io.h"
+#include "kernel/mm.h"
+#include "kernel/page.h"
+#include "kernel/syscall.h"
+#include "kernel/task.h"
+#include "kernel/tty.h"
+
+namespace mm::swap {
+
+#define SWAP_BUSY 0x8000       // 槽内容正在写盘
+#define SWAP_COUNT_MAX 0x7fff  // 引用计数饱和后槽不再释放
+#define SWAP_CLUSTER 32        // 每轮回收的目标页数
+#define RECLAIM_RETRIES 8      // 缺页分配失败后回收重试的次数
+
+static block::BlockDevice *swap_dev = nullptr;
+static std::uint64_t swap_start;  // 交换分区的起始扇区
+static std::uint64_t nr_slots;
+static std::uint64_t nr_free_slots;
+static std::uint64_t next_slot;  // 下一次分配从这里开始查找
+static std::uint16_t *swap_map;  // 每个槽的引用计数，高位为 SWAP_BUSY
+static task::SpinLock swap_lock;
+
+// 新映射和刚被访问过的页放在表头，回收从表尾开始
+static Page *lru_head;
+static Page *lru_tail;
+static std::uint64_t nr_lru;
+static task::SpinLock lru_lock CACHE_ALIGNED;
+
+static bool reclaiming;        // 同一时刻只有一个回收者，写盘时不持有自旋锁
+static task::Mem *reclaim_mm;  // 回收者正在处理其页的地址空间，见 Forget
+static bool wake_pending;
+static std::uint64_t low_pages;   // 空闲页低于此值时唤醒回收
+static std::uint64_t high_pages;  // 回收到此值为止
+
+static std::uint64_t nr_swap_out;
+static std::uint64_t nr_swap_in;
+static std::uint64_t nr_dropped;  // 直接丢弃的干净文件页
+
+void Init(block::BlockDevice *dev) {
+    swap_lock.SetName("swap");
+    lru_lock.SetName("lru");
+
+    // 干净的文件页没有交换分区也能丢弃，水位总是生效
+    low_pages  = page::frame.total_pages / 64;
+    high_pages = low_pages * 2;
+    if (dev == nullptr) return;
+
+    MBR *mbr = reinterpret_cast<MBR *>(page::Alloc(sizeof(MBR)));
+    if (mbr == nullptr) return;
+    if (dev->Read(0, 1, mbr) == 0 && mbr->signature == 0xAA55) {
+        for (int i = 0; i < 4; i++) {
+            MBRPartitionEntry *part = &mbr->partitions[i];
+            if (part->partition_type != PARTITION_TYPE_SWAP) continue;
+            swap_start = part->starting_lba;
+            nr_slots   = part->total_sectors * dev->sector_size / PAGE_SIZE;
+            break;
+        }
+    }
+    page::Free(mbr);
+
+    if (nr_slots == 0) {
+        tty::printk("Swap: no swap partition on %s\n", dev->disk_name);
+        return;
+    }
+    swap_map = reinterpret_cast<std::uint16_t *>(
+        vmalloc::Alloc(nr_slots * sizeof(std::uint16_t), GFP_ZERO));
+    if (swap_map == nullptr) {
+        nr_slots = 0;
+        return;
+    }
+    nr_free_slots = nr_slots;
+    swap_dev      = dev;
+
+    tty::printk("Swap: %d KiB on %s, reclaim below %d free pages\n",
+                nr_slots * PAGE_SIZE >> 10, dev->disk_name, low_pages);
+}
+
+static inline std::uint64_t EntrySlot(std::uint64_t entry) {
+    return entry >> PAGE_SHIFT;
+}
+
+// Reserve a free slot. It stays busy until its page has been written.
+static bool AllocSlot(std::uint64_t *slot) {
+    swap_lock.lock();
+    if (nr_free_slots == 0) {
+        swap_lock.unlock();
+        return false;
+    }
+    while (swap_map[next_slot] != 0) next_slot = (next_slot + 1) % nr_slots;
+    *slot               = next_slot;
+    swap_map[next_slot] = SWAP_BUSY | 1;
+    next_slot           = (next_slot + 1) % nr_slots;
+    nr_free_slots--;
+    swap_lock.unlock();
+    return true;
+}
+
+// 清除标志位或减少计数后，槽不再被引用时归还
+static void ReleaseSlot(std::uint64_t slot, bool end_write) {
+    swap_lock.lock();
+    if (end_write) {
+        swap_map[slot] &= ~SWAP_BUSY;
+    } else if ((swap_map[slot] & SWAP_COUNT_MAX) != SWAP_COUNT_MAX) {
+        swap_map[slot]--;
+    }
+    if (swap_map[slot] == 0) nr_free_slots++;
+    swap_lock.unlock();
+}
+
+void Dup(std::uint64_t entry) {
+    std::uint64_t slot = EntrySlot(entry);
+    if (slot >= nr_slots) return;
+    swap_lock.lock();
+    if ((swap_map[slot] & SWAP_COUNT_MAX) != SWAP_COUNT_MAX) swap_map[slot]++;
+    swap_lock.unlock();
+}
+
+void Free(std::uint64_t entry) {
+    std::uint64_t slot = EntrySlot(entry);
+    if (slot < nr_slots) ReleaseSlot(slot, false);
+}
+
+static int SlotIo(std::uint64_t slot, void *buf, bool write) {
+    std::uint32_t count  = PAGE_SIZE / swap_dev->sector_size;
+    std::uint64_t sector = swap_start + slot * count;
+    return write ? swap_dev->Write(sector, count, buf)
+                 : swap_dev->Read(sector, count, buf);
+}
+
+// LRU 链表操作，调用者持有 lru_lock 并关中断
+static void ListAdd(Page *page) {
+    page->prev = nullptr;
+    page->next = lru_head;
+    if (lru_head) {
+        lru_head->prev = page;
+    } else {
+        lru_tail = page;
+    }
+    lru_head = page;
+    page->flag |= PAGE_LRU;
+    nr_lru++;
+}
+
+static void ListDel(Page *page) {
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        lru_head = page->next;
+    }
+    if (page->next) {
+        page->next->prev = page->prev;
+    } else {
+        lru_tail = page->prev;
+    }
+    page->prev = page->next = nullptr;
+    page->flag &= ~PAGE_LRU;
+    nr_lru--;
+}
+
+// Record that the user page at addr is mapped at virt in mm and move it to
+// the hot end of the LRU. file marks a page filled from its region's file,
+// which can be dropped instead of swapped while it stays clean.
+void LruAdd(void *addr, task::Mem *mm, std::uint64_t virt, bool file) {
+    Page *page = page::VirtToPage(addr);
+    if (page == nullptr) return;
+
+    std::uint64_t flags = lru_lock.lock_irqsave();
+    if (page->flag & PAGE_LRU) ListDel(page);
+    page->mapping = mm;
+    page->index   = virt;
+    if (file) {
+        page->flag |= PAGE_FILE;
+    } else {
+        page->flag &= ~PAGE_FILE;
+    }
+    ListAdd(page);
+    lru_lock.unlock_irqrestore(flags);
+}
+
+void LruDel(Page *page) {
+    std::uint64_t flags = lru_lock.lock_irqsave();
+    if (page->flag & PAGE_LRU) ListDel(page);
+    lru_lock.unlock_irqrestore(flags);
+}
+
+// 地址空间销毁前调用：仍被其他进程共享的页不能再指向它。回收者正在处理
+// 这个地址空间的页时先等它做完，之后页表才能释放
+void Forget(task::Mem *mm) {
+    std::uint64_t flags = lru_lock.lock_irqsave();
+    while (reclaim_mm == mm) {
+        lru_lock.unlock_irqrestore(flags);
+        task::Schedule();
+        flags = lru_lock.lock_irqsave();
+    }
+    Page *page = lru_head;
+    while (page != nullptr) {
+        Page *next = page->next;
+        if (page->mapping == mm) ListDel(page);
+        page = next;
+    }
+    lru_lock.unlock_irqrestore(flags);
+}
+
+// 地址空间可能正在另一个 CPU 上运行，那边的 TLB 项只能靠 IPI 清除
+static void FlushPage(task::Mem *mm, std::uint64_t virt) {
+    tlb::Invalidate(&mm->asid);
+    task::Pcb *current = task::CurrentProc();
+    if (current != nullptr && &current->mm == mm) {
+        asm __volatile__("invlpg (%0)" ::"r"(virt) : "memory");
+    } else {
+        tlb::Shootdown();
+    }
+}
+
+// Evict up to nr pages from the cold end of the LRU. Recently accessed pages
+// get a second chance. Without reverse mappings only the recorded owner can
+// be unmapped, so pages still shared after fork are skipped. Clean file
+// pages are dropped and read again on fault, everything else goes to swap.
+// Returns the number of pages freed, 0 also when another thread is already
+// reclaiming.
+std::uint64_t Reclaim(std::uint64_t nr) {
+    if (__atomic_exchange_n(&reclaiming, true, __ATOMIC_ACQUIRE)) return 0;
+
+    std::uint64_t freed = 0;
+    std::uint64_t scan  = nr_lru * 2;
+    while (freed < nr && scan-- > 0) {
+        std::uint64_t flags = irq_save();
+        lru_lock.lock();
+        Page *page = lru_tail;
+        if (page != nullptr) ListDel(page);
+        reclaim_mm = page != nullptr ? page->mapping : nullptr;
+        lru_lock.unlock();
+        if (page == nullptr) {
+            irq_restore(flags);
+            break;
+        }
+
+        // 记录的映射已经不在了 (进程退出、页已被复制或解除映射)，不再跟踪
+        // 这一页。持有 mm->lock 期间 munmap 和写时复制不会改动页表
+        task::Mem *mm = page->mapping;
+        mm->lock.lock();
+        std::uint64_t virt = page->index;
+        PTE *pte           = page::FindLeaf(mm->pml4, virt);
+        std::uint64_t old  = pte ? pte->value : 0;
+        std::uint64_t phys = old & PAGE_MASK & ~PTE_NO_EXECUTE;
+        if (!(old & PTE_PRESENT) ||
+            page::VirtToPage((void *)Phy2Vir(phys)) != page) {
+            mm->lock.unlock();
+            irq_restore(flags);
+            continue;
+        }
+
+        // 地址空间可能正在别的 CPU 上运行，硬件随时会置访问位和脏位，
+        // 页表项只能用原子操作修改
+        bool clean_file     = (page->flag & PAGE_FILE) && !(old & PTE_DIRTY);
+        std::uint64_t slot  = 0;
+        std::uint64_t entry = 0;
+
+        bool keep = page->count > 1 || (old & PTE_ACCESSED) ||
+                    (!clean_file && (swap_dev == nullptr || !AllocSlot(&slot)));
+        if (keep) {
+            __atomic_fetch_and(&pte->value, ~PTE_ACCESSED, __ATOMIC_RELAXED);
+        } else {
+            // 先解除映射再写盘：写盘期间进程再访问会在换入时等待槽写完。
+            // 只替换判断时读到的值，其间被访问或写脏的页留到下一轮
+            if (!clean_file) entry = (slot << PAGE_SHIFT) | PTE_SWAP;
+            keep = !__atomic_compare_exchange_n(&pte->value, &old, entry, false,
+                                                __ATOMIC_SEQ_CST,
+                                                __ATOMIC_RELAXED);
+            if (keep && !clean_file) {
+                ReleaseSlot(slot, false);
+                ReleaseSlot(slot, true);
+            }
+        }
+        if (keep) {
+            lru_lock.lock();
+            ListAdd(page);
+            lru_lock.unlock();
+            mm->lock.unlock();
+            irq_restore(flags);
+            continue;
+        }
+        // 清掉其他 CPU 的 TLB 项之后页内容和 old 中的脏位才不会再变
+        FlushPage(mm, virt);
+        mm->lock.unlock();
+        irq_restore(flags);
+
+        if (clean_file) {
+            nr_dropped++;
+        } else if (SlotIo(slot, (void *)Phy2Vir(phys), true) == 0) {
+            ReleaseSlot(slot, true);
+            nr_swap_out++;
+        } else {
+            // 写盘失败，页还在内存中；写盘期间进程可能已退出，重新查找页表项
+            flags    = mm->lock.lock_irqsave();
+            pte      = page::FindLeaf(mm->pml4, virt);
+            bool hit = pte && __atomic_compare_exchange_n(
+                                  &pte->value, &entry, old, false,
+                                  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+            if (hit) {
+                LruAdd((void *)Phy2Vir(phys), mm, virt);
+                ReleaseSlot(slot, false);
+            }
+            mm->lock.unlock_irqrestore(flags);
+            ReleaseSlot(slot, true);
+            if (hit) continue;
+        }
+        page::PutPage(phys);
+        freed++;
+    }
+
+    std::uint64_t flags = lru_lock.lock_irqsave();
+    reclaim_mm          = nullptr;
+    lru_lock.unlock_irqrestore(flags);
+    __atomic_store_n(&reclaiming, false, __ATOMIC_RELEASE);
+    return freed;
+}
+
+// Allocate one page for a user fault, reclaiming user pages while memory is
+// exhausted. May sleep.
+void *AllocPage(std::uint32_t gfp) {
+    for (int retry = 0; retry < RECLAIM_RETRIES; retry++) {
+        void *page = page::AllocPages(1, gfp);
+        if (page != nullptr) return page;
+
+        asm __volatile__("sti");
+        // 没回收到页时可能是别的线程正在回收，让出 CPU 后重试
+        if (Reclaim(SWAP_CLUSTER) == 0) task::Schedule();
+    }
+    return nullptr;
+}
+
+// Bring back the swapped-out page behind *pte for a not-present fault at
+// virt and map it with flags. May sleep.
+bool SwapIn(task::Mem *mm, PTE *pte, std::uint64_t virt,
+            std::uint64_t flags) {
+    std::uint64_t entry = pte->value;
+    std::uint64_t slot  = EntrySlot(entry);
+    if (swap_dev == nullptr || slot >= nr_slots) return false;
+
+    asm __volatile__("sti");
+    while (swap_map[slot] & SWAP_BUSY) task::Schedule();
+
+    void *page = AllocPage();
+    if (page == nullptr) return false;
+    page::SplitPages(page, 1);
+    std::uint64_t phys = Vir2Phy((std::uint64_t)page);
+    if (SlotIo(slot, page, false) != 0) {
+        page::PutPage(phys);
+        return false;
+    }
+
+    std::uint64_t irq = irq_save();
+    if (pte->value != entry) {
+        irq_restore(irq);
+        page::PutPage(phys);
+        return true;
+    }
+    // 内容可能已和文件不同，置脏位让回收时写回交换区而不是丢弃
+    page::Map(mm->pml4, virt, phys, flags | PTE_DIRTY);
+    Free(entry);
+    LruAdd(page, mm, virt);
+    irq_restore(irq);
+
+    nr_swap_in++;
+    return true;
+}
+
+// Ask mm::Service to reclaim once free memory drops below the low
+// watermark. Never blocks, so it is safe to call from the page allocator.
+void Wake() {
+    if (low_pages == 0 || wake_pending) return;
+    if (page::frame.free_pages >= low_pages) return;
+
+    wake_pending = true;
+    task::ipc::Message msg;
+    msg.dst_pid = SYS_MM;
+    msg.type    = SYS_MM_RECLAIM;
+    if (task::ipc::Post(&msg) <= 0) wake_pending = false;
+}
+
+// Reclaim until free memory is back above the high watermark or nothing
+// more can be freed. Pages whose descriptors are still deferred are enabled
+// before anything is evicted. Runs in mm::Service.
+void Balance() {
+    std::uint64_t before = nr_swap_out + nr_dropped;
+    while (page::frame.free_pages < high_pages) {
+        if (page::InitDeferred()) continue;
+        if (Reclaim(SWAP_CLUSTER) == 0) break;
+    }
+    wake_pending = false;
+
+    if (nr_swap_out + nr_dropped != before) {
+        tty::printk("Swap: %d pages out, %d in, %d dropped, %d slots free\n",
+                    nr_swap_out, nr_swap_in, nr_dropped, nr_free_slots);
+    }
+}
+
+std::uint64_t NrLru() { return nr_lru; }
+
+std::uint64_t NrSlots() { return nr_slots; }
+
+std::uint64_t NrFreeSlots() { return nr_free_slots; }
+
+}  // namespace mm::swap
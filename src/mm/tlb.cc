@@ -0,0 +1,246 @@
+/**
+ * @file tlb.cc
+ * @brief Address-space switching with PCID and TLB flushing helpers
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+#include <cstring>
+
+#include "kernel/cpu.h"
+#include "kernel/io.h"
+#include "kernel/mm.h"
+#include "kernel/page.h"
+#include "kernel/smp.h"
+#include "kernel/task.h"
+#include "kernel/tty.h"
+
+namespace mm::tlb {
+
+// 内核页表固定使用 PCID 0，用户地址空间从 1 开始分配
+#define PCID_KERNEL 0
+#define PCID_FIRST 1
+
+static bool pcid_enabled        = false;
+static std::uint64_t generation = 1;  // PCID 全部用完后递增
+static std::uint64_t next_pcid  = PCID_FIRST;
+static task::SpinLock pcid_lock CACHE_ALIGNED;
+
+static inline std::uint64_t ReadCr3() {
+    std::uint64_t cr3;
+    asm __volatile__("mov %%cr3, %0" : "=r"(cr3));
+    return cr3;
+}
+
+static inline void WriteCr3(std::uint64_t cr3) {
+    asm __volatile__("mov %0, %%cr3" ::"r"(cr3) : "memory");
+}
+
+static inline std::uint64_t ReadCr4() {
+    std::uint64_t cr4;
+    asm __volatile__("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+static inline void WriteCr4(std::uint64_t cr4) {
+    asm __volatile__("mov %0, %%cr4" ::"r"(cr4) : "memory");
+}
+
+void Init() {
+    pcid_lock.SetName("pcid");
+
+    std::uint32_t eax, ebx, ecx, edx;
+    cpuid(1, eax, ebx, ecx, edx);
+
+    // 置 CR4.PCIDE 时 CR3[11:0] 必须为 0，此时仍在 PCID 0 的内核页表上
+    if ((ecx & CPUID_PCID) && !(ReadCr3() & ~PAGE_MASK)) {
+        WriteCr4(ReadCr4() | CR4_PCIDE);
+        pcid_enabled = true;
+    }
+    tty::printk("TLB: global kernel pages, PCID %s.\n",
+                pcid_enabled ? "enabled" : "not supported");
+}
+
+bool PcidEnabled() { return pcid_enabled; }
+
+// Match the BSP's CR4.PCIDE on an application processor. The trampoline
+// cannot set it before long mode is active.
+void InitAp() {
+    if (pcid_enabled) WriteCr4(ReadCr4() | CR4_PCIDE);
+}
+
+// Give the address space a PCID that is valid in the current generation.
+// Returns true when the PCID is (re)used for the first time and its stale
+// entries must be flushed on the next CR3 load.
+static bool AssignPcid(std::uint64_t *asid) {
+    pcid_lock.lock();
+    if ((*asid >> 12) == generation) {
+        pcid_lock.unlock();
+        return false;
+    }
+
+    if (next_pcid > PCID_MASK) {
+        // 所有 PCID 都分配过一轮：旧代的编号作废，重新分配时逐个刷新
+        generation++;
+        next_pcid = PCID_FIRST;
+    }
+    *asid = generation << 12 | next_pcid++;
+    pcid_lock.unlock();
+    return true;
+}
+
+// Load pml4 into CR3. With PCID the entries tagged with the address
+// space's PCID are kept unless the PCID is new or stale is set.
+static void Load(PTE *pml4, std::uint64_t *asid, bool stale) {
+    std::uint64_t cr3 = Vir2Phy((std::uint64_t)pml4);
+    if (!pcid_enabled) {
+        WriteCr3(cr3);
+        return;
+    }
+
+    // 内核页表的用户半部从不修改，内核半部全部是全局页，无需刷新
+    if (pml4 == page::kernel_pml4) {
+        WriteCr3(cr3 | PCID_KERNEL | CR3_NOFLUSH);
+        return;
+    }
+
+    bool flush = AssignPcid(asid) || stale;
+    cr3 |= *asid & PCID_MASK;
+    if (!flush) cr3 |= CR3_NOFLUSH;
+    WriteCr3(cr3);
+}
+
+// Switch to an address space. Its entries left in this CPU's TLB are only
+// trusted if it did not run on another CPU in between, where its page
+// tables may have changed without this CPU being told.
+void Switch(task::Mem *mm) {
+    std::uint32_t cpu = task::ThisCpu()->id;
+    bool stale        = mm->cpu != cpu;
+    mm->cpu           = cpu;
+    Load(mm->pml4, &mm->asid, stale);
+}
+
+void Invalidate(std::uint64_t *asid) { *asid = 0; }
+
+// Drop the non-global entries of the current address space. Reloading CR3
+// without the no-flush bit does this with or without PCID.
+void FlushLocal() { WriteCr3(ReadCr3()); }
+
+// Flush every TLB entry including global ones by toggling CR4.PGE.
+void FlushAll() {
+    std::uint64_t cr4 = ReadCr4();
+    WriteCr4(cr4 & ~CR4_PGE);
+    WriteCr4(cr4);
+}
+
+// Flush this CPU's TLB if another CPU asked for it since the last time.
+void ServePending() {
+    task::Cpu *cpu  = task::ThisCpu();
+    std::uint64_t r = __atomic_load_n(&cpu->tlb_req, __ATOMIC_ACQUIRE);
+    if (r != __atomic_load_n(&cpu->tlb_done, __ATOMIC_RELAXED)) {
+        FlushAll();
+        __atomic_store_n(&cpu->tlb_done, r, __ATOMIC_RELEASE);
+    }
+}
+
+// Make every other online CPU flush its whole TLB, including global
+// entries, and wait until all of them have. Requests are counted per CPU
+// so concurrent shootdowns are served by a single flush. A CPU waiting
+// here or spinning on a lock with interrupts disabled keeps serving its
+// own requests, so two CPUs cannot wait for each other.
+void Shootdown() {
+    if (!smp::Active()) return;
+
+    std::uint64_t flags = irq_save();
+    task::Cpu *self     = task::ThisCpu();
+    std::uint64_t want[MAX_CPUS];
+    for (std::uint32_t i = 0; i < task::nr_cpus; i++) {
+        task::Cpu *cpu = &task::cpus[i];
+        if (cpu == self || !__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        want[i] = __atomic_add_fetch(&cpu->tlb_req, 1, __ATOMIC_SEQ_CST);
+    }
+    smp::SendIpiOthers(VECTOR_TLB);
+
+    for (std::uint32_t i = 0; i < task::nr_cpus; i++) {
+        task::Cpu *cpu = &task::cpus[i];
+        if (cpu == self || !__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        while (__atomic_load_n(&cpu->tlb_done, __ATOMIC_ACQUIRE) < want[i]) {
+            ServePending();
+            asm volatile("pause");
+        }
+    }
+    irq_restore(flags);
+}
+
+// Measure a context switch to another address space and back followed by
+// touching BENCH_PAGES pages of kernel data, first with the old behaviour (no
+// global pages, full flush on every CR3 load), then with global kernel
+// pages, then with PCID no-flush loads. Interrupts are disabled for the
+// duration.
+void Benchmark() {
+    const int BENCH_ROUNDS = 2000;
+    const int BENCH_PAGES  = 64;
+
+    // 内核 bss 以 4KiB 页映射，每页占一个 TLB 项
+    std::uint8_t *buf = (std::uint8_t *)__bss_start;
+    if ((std::uint64_t)(__bss_end - __bss_start) < BENCH_PAGES * PAGE_SIZE) {
+        return;
+    }
+
+    PTE *scratch = (PTE *)page::AllocPages(1);
+    if (scratch == nullptr) {
+        tty::printk("TLB benchmark: out of memory\n");
+        return;
+    }
+    memset(scratch, 0, PAGE_SIZE);
+    page::UpdateKernelPml4(scratch);
+
+    std::uint64_t scratch_asid = 0;
+    std::uint64_t kernel_asid  = 0;
+    std::uint64_t cr4          = ReadCr4();
+    std::uint64_t kernel_cr3   = Vir2Phy((std::uint64_t)page::kernel_pml4);
+    std::uint64_t scratch_cr3  = Vir2Phy((std::uint64_t)scratch);
+    const char *names[3]       = {"no global, flush", "global, flush",
+                                  "global, PCID"};
+
+    asm volatile("cli");
+    for (int mode = 0; mode < 3; mode++) {
+        if (mode == 2 && !pcid_enabled) break;
+        WriteCr4(mode == 0 ? cr4 & ~CR4_PGE : cr4);
+
+        std::uint64_t sum   = 0;
+        std::uint64_t start = rdtsc();
+        for (int r = 0; r < BENCH_ROUNDS; r++) {
+            if (mode == 2) {
+                Load(scratch, &scratch_asid, false);
+                Load(page::kernel_pml4, &kernel_asid, false);
+            } else {
+                WriteCr3(scratch_cr3);
+                WriteCr3(kernel_cr3);
+            }
+            for (int p = 0; p < BENCH_PAGES; p++) {
+                sum += *(volatile std::uint8_t *)(buf + p * PAGE_SIZE);
+            }
+        }
+        std::uint64_t cycles = rdtsc() - start;
+        (void)sum;
+
+        tty::printk("TLB benchmark: %s: %d cycles per switch\n", names[mode],
+                    cycles / BENCH_ROUNDS);
+    }
+    WriteCr4(cr4);
+    asm volatile("sti");
+
+    page::FreePages(scratch, 1);
+}
+
+}  // namespace mm::tlb
+
+extern "C" void tlb_ipi_handler_c() {
+    mm::tlb::ServePending();
+    smp::Eoi();
+}
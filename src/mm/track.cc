@@ -0,0 +1,166 @@
+/**
+ * @file track.cc
+ * @brief Optional tracker of live page allocations by call site
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+#include <cstring>
+
+#include "kernel/io.h"
+#include "kernel/mm.h"
+#include "kernel/page.h"
+#include "kernel/task.h"
+#include "kernel/tty.h"
+
+#if MM_TRACK_ALLOC == true
+
+namespace mm::track {
+
+// 以块首地址为键的开放寻址哈希表，只记录尚未释放的分配
+#define TRACK_BITS 12
+#define TRACK_SLOTS (1 << TRACK_BITS)
+#define TRACK_MASK (TRACK_SLOTS - 1)
+#define TRACK_SITES 64  // 汇总时最多区分的调用点，其余归入 rip 为 0 的一项
+
+struct Entry {
+    std::uint64_t addr;   // 0 表示空槽
+    std::uint64_t rip;    // 调用分配函数的返回地址
+    std::uint64_t ticks;  // 分配时的时钟节拍
+    std::uint64_t pages;
+};
+
+static Entry table[TRACK_SLOTS];
+static std::uint64_t nr_live;
+static std::uint64_t nr_lost;  // 表满时没有记下的分配
+static task::SpinLock track_lock;
+
+static Site sites[TRACK_SITES];  // Collect 的结果，在 track_lock 内使用
+
+static inline std::uint64_t Slot(std::uint64_t addr) {
+    return ((addr >> PAGE_SHIFT) * 0x9e3779b97f4a7c15ULL) >>
+           (64 - TRACK_BITS);
+}
+
+// Find the slot holding addr, or the empty slot where it would go. Returns
+// TRACK_SLOTS when addr is absent and the table is full. Caller holds
+// track_lock.
+static std::uint64_t Probe(std::uint64_t addr) {
+    std::uint64_t i = Slot(addr);
+    for (std::uint64_t n = 0; n < TRACK_SLOTS; n++, i = (i + 1) & TRACK_MASK) {
+        if (table[i].addr == addr || table[i].addr == 0) return i;
+    }
+    return TRACK_SLOTS;
+}
+
+// Remember a block handed out to the caller at rip. Recording the same
+// address again replaces the entry, so a wrapper such as page::Alloc can
+// overwrite the site recorded by the AllocPages call it made.
+void Record(void *addr, std::size_t pages, std::uint64_t rip) {
+    std::uint64_t key = (std::uint64_t)addr;
+    track_lock.lock();
+    std::uint64_t i = Probe(key);
+    if (i == TRACK_SLOTS) {
+        nr_lost++;
+    } else {
+        if (table[i].addr == 0) nr_live++;
+        table[i].addr  = key;
+        table[i].rip   = rip;
+        table[i].ticks = timer::GetTicks();
+        table[i].pages = pages;
+    }
+    track_lock.unlock();
+}
+
+// Drop the entry of a freed block. Later entries of the same probe run are
+// shifted back so that lookups never need tombstones.
+void Forget(void *addr) {
+    std::uint64_t key = (std::uint64_t)addr;
+    track_lock.lock();
+    std::uint64_t i = Probe(key);
+    if (i == TRACK_SLOTS || table[i].addr != key) {
+        track_lock.unlock();
+        return;
+    }
+
+    std::uint64_t j = i;
+    while (true) {
+        j = (j + 1) & TRACK_MASK;
+        if (table[j].addr == 0) break;
+        // 槽 j 的理想位置落在 (i, j] 内时它不能前移
+        std::uint64_t k = Slot(table[j].addr);
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        table[i] = table[j];
+        i        = j;
+    }
+    table[i].addr = 0;
+    nr_live--;
+    track_lock.unlock();
+}
+
+// Sum the live entries per call site into sites[], largest first. Returns
+// the number of sites. Caller holds track_lock.
+static std::uint64_t Collect() {
+    std::uint64_t nr  = 0;
+    std::uint64_t now = timer::GetTicks();
+    for (std::uint64_t i = 0; i < TRACK_SLOTS; i++) {
+        if (table[i].addr == 0) continue;
+
+        std::uint64_t s = 0;
+        while (s < nr && sites[s].rip != table[i].rip) s++;
+        if (s == nr) {
+            if (nr == TRACK_SITES) {
+                // 调用点太多，最后一项改为汇总其余的
+                s            = TRACK_SITES - 1;
+                sites[s].rip = 0;
+            } else {
+                memset(&sites[s], 0, sizeof(Site));
+                sites[s].rip = table[i].rip;
+                nr++;
+            }
+        }
+        sites[s].pages += table[i].pages;
+        sites[s].count++;
+        if (now - table[i].ticks > sites[s].age) {
+            sites[s].age = now - table[i].ticks;
+        }
+    }
+
+    for (std::uint64_t a = 1; a < nr; a++) {
+        Site site       = sites[a];
+        std::uint64_t b = a;
+        for (; b > 0 && sites[b - 1].pages < site.pages; b--) {
+            sites[b] = sites[b - 1];
+        }
+        sites[b] = site;
+    }
+    return nr;
+}
+
+// Copy the index-th largest call site. Returns false past the last one.
+bool GetSite(std::uint64_t index, Site *site) {
+    track_lock.lock();
+    bool found = index < Collect();
+    if (found) *site = sites[index];
+    track_lock.unlock();
+    return found;
+}
+
+// Print the top live allocation sites. The addresses are return addresses
+// in the kernel image; resolve them with addr2line -e kernel.elf.
+void Dump(std::uint64_t top) {
+    track_lock.lock();
+    std::uint64_t nr = Collect();
+    tty::printk("Alloc tracker: %d live blocks, %d not recorded\n", nr_live,
+                nr_lost);
+    for (std::uint64_t i = 0; i < nr && i < top; i++) {
+        tty::printk("  0x%lx: %d pages in %d blocks, oldest %d ms\n",
+                    sites[i].rip, sites[i].pages, sites[i].count,
+                    sites[i].age * TIMER_PERIOD);
+    }
+    track_lock.unlock();
+}
+
+}  // namespace mm::track
+
+#endif  // MM_TRACK_ALLOC
@@ -0,0 +1,497 @@
+/**
+ * @file vma.cc
+ * @brief User address-space regions, mmap and demand paging
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "kernel/cpu.h"
+#include "kernel/mm.h"
+#include "kernel/page.h"
+#include "kernel/syscall.h"
+#include "kernel/task.h"
+#include "kernel/vfs.h"
+
+namespace mm::vma {
+
+static inline bool RbIsRed(Vma *node) { return node && node->rb_is_red; }
+
+static void RbLeftRotate(VmaTree *tree, Vma *x) {
+    Vma *y      = x->rb_right;
+    x->rb_right = y->rb_left;
+    if (y->rb_left) y->rb_left->rb_parent = x;
+
+    y->rb_parent = x->rb_parent;
+    if (x->rb_parent == nullptr) {
+        tree->rb_root = y;
+    } else if (x == x->rb_parent->rb_left) {
+        x->rb_parent->rb_left = y;
+    } else {
+        x->rb_parent->rb_right = y;
+    }
+    y->rb_left   = x;
+    x->rb_parent = y;
+}
+
+static void RbRightRotate(VmaTree *tree, Vma *y) {
+    Vma *x     = y->rb_left;
+    y->rb_left = x->rb_right;
+    if (x->rb_right) x->rb_right->rb_parent = y;
+
+    x->rb_parent = y->rb_parent;
+    if (y->rb_parent == nullptr) {
+        tree->rb_root = x;
+    } else if (y == y->rb_parent->rb_right) {
+        y->rb_parent->rb_right = x;
+    } else {
+        y->rb_parent->rb_left = x;
+    }
+    x->rb_right  = y;
+    y->rb_parent = x;
+}
+
+static void RbInsertColorFixup(VmaTree *tree, Vma *node) {
+    while (RbIsRed(node->rb_parent)) {
+        Vma *parent      = node->rb_parent;
+        Vma *grandparent = parent->rb_parent;
+
+        if (parent == grandparent->rb_left) {
+            Vma *uncle = grandparent->rb_right;
+            if (RbIsRed(uncle)) {
+                parent->rb_is_red      = false;
+                uncle->rb_is_red       = false;
+                grandparent->rb_is_red = true;
+                node                   = grandparent;
+                continue;
+            }
+            if (node == parent->rb_right) {
+                node = parent;
+                RbLeftRotate(tree, node);
+                parent = node->rb_parent;
+            }
+            parent->rb_is_red      = false;
+            grandparent->rb_is_red = true;
+            RbRightRotate(tree, grandparent);
+        } else {
+            Vma *uncle = grandparent->rb_left;
+            if (RbIsRed(uncle)) {
+                parent->rb_is_red      = false;
+                uncle->rb_is_red       = false;
+                grandparent->rb_is_red = true;
+                node                   = grandparent;
+                continue;
+            }
+            if (node == parent->rb_left) {
+                node = parent;
+                RbRightRotate(tree, node);
+                parent = node->rb_parent;
+            }
+            parent->rb_is_red      = false;
+            grandparent->rb_is_red = true;
+            RbLeftRotate(tree, grandparent);
+        }
+    }
+    tree->rb_root->rb_is_red = false;
+}
+
+// 用 v 替换 u 在树中的位置
+static void RbTransplant(VmaTree *tree, Vma *u, Vma *v) {
+    if (u->rb_parent == nullptr) {
+        tree->rb_root = v;
+    } else if (u == u->rb_parent->rb_left) {
+        u->rb_parent->rb_left = v;
+    } else {
+        u->rb_parent->rb_right = v;
+    }
+    if (v) v->rb_parent = u->rb_parent;
+}
+
+static void RbEraseColorFixup(VmaTree *tree, Vma *node, Vma *parent) {
+    while (node != tree->rb_root && !RbIsRed(node)) {
+        if (node == parent->rb_left) {
+            Vma *sibling = parent->rb_right;
+            if (RbIsRed(sibling)) {
+                sibling->rb_is_red = false;
+                parent->rb_is_red  = true;
+                RbLeftRotate(tree, parent);
+                sibling = parent->rb_right;
+            }
+            if (!RbIsRed(sibling->rb_left) && !RbIsRed(sibling->rb_right)) {
+                sibling->rb_is_red = true;
+                node               = parent;
+                parent             = node->rb_parent;
+                continue;
+            }
+            if (!RbIsRed(sibling->rb_right)) {
+                sibling->rb_left->rb_is_red = false;
+                sibling->rb_is_red          = true;
+                RbRightRotate(tree, sibling);
+                sibling = parent->rb_right;
+            }
+            sibling->rb_is_red           = parent->rb_is_red;
+            parent->rb_is_red            = false;
+            sibling->rb_right->rb_is_red = false;
+            RbLeftRotate(tree, parent);
+        } else {
+            Vma *sibling = parent->rb_left;
+            if (RbIsRed(sibling)) {
+                sibling->rb_is_red = false;
+                parent->rb_is_red  = true;
+                RbRightRotate(tree, parent);
+                sibling = parent->rb_left;
+            }
+            if (!RbIsRed(sibling->rb_left) && !RbIsRed(sibling->rb_right)) {
+                sibling->rb_is_red = true;
+                node               = parent;
+                parent             = node->rb_parent;
+                continue;
+            }
+            if (!RbIsRed(sibling->rb_left)) {
+                sibling->rb_right->rb_is_red = false;
+                sibling->rb_is_red           = true;
+                RbLeftRotate(tree, sibling);
+                sibling = parent->rb_left;
+            }
+            sibling->rb_is_red          = parent->rb_is_red;
+            parent->rb_is_red           = false;
+            sibling->rb_left->rb_is_red = false;
+            RbRightRotate(tree, parent);
+        }
+        node = tree->rb_root;
+    }
+    if (node) node->rb_is_red = false;
+}
+
+static void RbErase(VmaTree *tree, Vma *node) {
+    Vma *child, *parent;
+    bool black = !node->rb_is_red;
+
+    if (node->rb_left == nullptr || node->rb_right == nullptr) {
+        child  = node->rb_left ? node->rb_left : node->rb_right;
+        parent = node->rb_parent;
+        RbTransplant(tree, node, child);
+    } else {
+        // 用右子树中最小的节点接替被删除的节点
+        Vma *next = node->rb_right;
+        while (next->rb_left) next = next->rb_left;
+        black = !next->rb_is_red;
+        child = next->rb_right;
+
+        if (next->rb_parent == node) {
+            parent = next;
+        } else {
+            parent = next->rb_parent;
+            RbTransplant(tree, next, next->rb_right);
+            next->rb_right            = node->rb_right;
+            next->rb_right->rb_parent = next;
+        }
+        RbTransplant(tree, node, next);
+        next->rb_left            = node->rb_left;
+        next->rb_left->rb_parent = next;
+        next->rb_is_red          = node->rb_is_red;
+    }
+
+    if (black) RbEraseColorFixup(tree, child, parent);
+}
+
+Vma *Find(VmaTree *tree, std::uint64_t addr) {
+    Vma *node = tree->rb_root;
+    while (node != nullptr) {
+        if (addr < node->start) {
+            node = node->rb_left;
+        } else if (addr >= node->end) {
+            node = node->rb_right;
+        } else {
+            return node;
+        }
+    }
+    return nullptr;
+}
+
+// Record a region without allocating or mapping anything. The region takes
+// its own reference to file. Returns nullptr when the range overlaps an
+// existing region.
+Vma *Insert(VmaTree *tree, std::uint64_t start, std::uint64_t end,
+            std::uint64_t flags, vfs::File *file, std::uint64_t offset,
+            std::uint64_t file_size) {
+    if (start >= end) return nullptr;
+
+    // 下降时记录最后一次向右走的节点，即新区域在链表中的前驱
+    Vma *parent = nullptr;
+    Vma *prev   = nullptr;
+    Vma **link  = &tree->rb_root;
+    while (*link != nullptr) {
+        parent = *link;
+        if (start < parent->start) {
+            link = &parent->rb_left;
+        } else {
+            prev = parent;
+            link = &parent->rb_right;
+        }
+    }
+    Vma *next = prev ? prev->next : tree->head;
+    if ((prev && prev->end > start) || (next && next->start < end)) {
+        return nullptr;
+    }
+
+    Vma *vma = new Vma;
+    if (vma == nullptr) return nullptr;
+    vma->start     = start;
+    vma->end       = end;
+    vma->flags     = flags;
+    vma->file      = vfs::Hold(file);
+    vma->offset    = offset;
+    vma->file_size = file_size;
+    vma->rb_left   = nullptr;
+    vma->rb_right  = nullptr;
+    vma->rb_parent = parent;
+    vma->rb_is_red = true;
+    *link          = vma;
+    RbInsertColorFixup(tree, vma);
+
+    vma->prev = prev;
+    vma->next = next;
+    if (prev) {
+        prev->next = vma;
+    } else {
+        tree->head = vma;
+    }
+    if (next) next->prev = vma;
+    tree->nr_vmas++;
+    return vma;
+}
+
+static void Remove(VmaTree *tree, Vma *vma) {
+    RbErase(tree, vma);
+    if (vma->prev) {
+        vma->prev->next = vma->next;
+    } else {
+        tree->head = vma->next;
+    }
+    if (vma->next) vma->next->prev = vma->prev;
+    tree->nr_vmas--;
+    vfs::Close(vma->file);
+    delete vma;
+}
+
+// Cut vma in two at addr; the upper half becomes a new region that keeps
+// the matching part of the file.
+static bool Split(VmaTree *tree, Vma *vma, std::uint64_t addr) {
+    std::uint64_t head = addr - vma->start;
+    std::uint64_t tail_file =
+        vma->file_size > head ? vma->file_size - head : 0;
+    std::uint64_t end = vma->end;
+
+    // 先缩短原区域，否则新区域会被判定为重叠
+    vma->end = addr;
+    if (Insert(tree, addr, end, vma->flags, vma->file, vma->offset + head,
+               tail_file) == nullptr) {
+        vma->end = end;
+        return false;
+    }
+    if (vma->file_size > head) vma->file_size = head;
+    return true;
+}
+
+// 保证 [start, end) 的两端都落在区域边界上
+static bool SplitEdges(VmaTree *tree, std::uint64_t start, std::uint64_t end) {
+    Vma *vma = Find(tree, start);
+    if (vma && vma->start < start && !Split(tree, vma, start)) return false;
+    vma = Find(tree, end - 1);
+    if (vma && vma->end > end && !Split(tree, vma, end)) return false;
+    return true;
+}
+
+// fork 时复制区域描述，已经调入的页由页表共享
+bool Clone(VmaTree *dst, VmaTree *src) {
+    for (Vma *vma = src->head; vma != nullptr; vma = vma->next) {
+        if (Insert(dst, vma->start, vma->end, vma->flags, vma->file,
+                   vma->offset, vma->file_size) == nullptr) {
+            Destroy(dst);
+            return false;
+        }
+    }
+    return true;
+}
+
+void Destroy(VmaTree *tree) {
+    Vma *vma = tree->head;
+    while (vma != nullptr) {
+        Vma *next = vma->next;
+        vfs::Close(vma->file);
+        delete vma;
+        vma = next;
+    }
+    tree->rb_root = nullptr;
+    tree->head    = nullptr;
+    tree->nr_vmas = 0;
+}
+
+static std::uint64_t ProtToFlags(int prot) {
+    // EFER.NXE 未开启，PROT_EXEC 无法单独控制
+    if (prot == PROT_NONE) return 0;
+    std::uint64_t flags = PTE_PRESENT | PTE_USER;
+    if (prot & PROT_WRITE) flags |= PTE_WRITABLE;
+    return flags;
+}
+
+static bool RangeFree(VmaTree *tree, std::uint64_t start, std::uint64_t end) {
+    if (start < PAGE_SIZE || end > USER_SPACE_END || start >= end) {
+        return false;
+    }
+    Vma *vma = tree->head;
+    while (vma && vma->end <= start) vma = vma->next;
+    return vma == nullptr || vma->start >= end;
+}
+
+// 从 MMAP_BASE 开始首次适配
+static std::uint64_t FindFree(VmaTree *tree, std::uint64_t len) {
+    std::uint64_t addr = MMAP_BASE;
+    for (Vma *vma = tree->head; vma != nullptr; vma = vma->next) {
+        if (vma->end <= addr) continue;
+        if (vma->start >= addr + len) break;
+        addr = vma->end;
+    }
+    return addr + len <= USER_SPACE_END ? addr : 0;
+}
+
+// Create a region of len bytes. Nothing is allocated: anonymous pages are
+// zero-filled and file pages read on first touch. MAP_SHARED is treated as
+// MAP_PRIVATE since there is no page cache to share through. The region
+// keeps file open after the caller closes its descriptor. Returns the
+// address or MAP_FAILED.
+std::uint64_t Mmap(VmaTree *tree, PTE *pml4, std::uint64_t addr,
+                   std::uint64_t len, int prot, int flags, vfs::File *file,
+                   std::uint64_t offset) {
+    std::uint64_t fail = reinterpret_cast<std::uint64_t>(MAP_FAILED);
+    if (len == 0 || (offset & ~PAGE_MASK)) return fail;
+    len = PAGE_ALIGN(len);
+    if (flags & MAP_ANONYMOUS) file = nullptr;
+    if (file == nullptr && !(flags & MAP_ANONYMOUS)) return fail;
+
+    if (flags & MAP_FIXED) {
+        // 覆盖指定范围内原有的映射
+        if (addr < PAGE_SIZE || Munmap(tree, pml4, addr, len) != 0) {
+            return fail;
+        }
+    } else {
+        addr &= PAGE_MASK;
+        if (addr == 0 || !RangeFree(tree, addr, addr + len)) {
+            addr = FindFree(tree, len);
+            if (addr == 0) return fail;
+        }
+    }
+
+    if (Insert(tree, addr, addr + len, ProtToFlags(prot), file, offset,
+               file != nullptr ? len : 0) == nullptr) {
+        return fail;
+    }
+    return addr;
+}
+
+// Remove every region part inside [addr, addr + len) and free the pages
+// mapped there. The caller must invalidate the address space's TLB entries
+// if it is not the current one.
+int Munmap(VmaTree *tree, PTE *pml4, std::uint64_t addr, std::uint64_t len) {
+    if (len == 0 || (addr & ~PAGE_MASK)) return -1;
+    std::uint64_t end = PAGE_ALIGN(addr + len);
+    if (end > USER_SPACE_END || end <= addr) return -1;
+    if (!SplitEdges(tree, addr, end)) return -1;
+
+    Vma *vma = tree->head;
+    while (vma && vma->end <= addr) vma = vma->next;
+    while (vma && vma->start < end) {
+        Vma *next = vma->next;
+        page::ReleaseRange(pml4, vma->start, vma->end - vma->start);
+        Remove(tree, vma);
+        vma = next;
+    }
+    return 0;
+}
+
+// Change the protection of [addr, addr + len), which must be fully covered
+// by regions.
+int Mprotect(VmaTree *tree, PTE *pml4, std::uint64_t addr, std::uint64_t len,
+             int prot) {
+    if (len == 0 || (addr & ~PAGE_MASK)) return -1;
+    std::uint64_t end = PAGE_ALIGN(addr + len);
+    if (end > USER_SPACE_END || end <= addr) return -1;
+
+    std::uint64_t covered = addr;
+    for (Vma *vma = Find(tree, addr); vma && vma->start <= covered;
+         vma = vma->next) {
+        covered = vma->end;
+        if (covered >= end) break;
+    }
+    if (covered < end) return -1;
+    if (!SplitEdges(tree, addr, end)) return -1;
+
+    std::uint64_t flags = ProtToFlags(prot);
+    for (Vma *vma = Find(tree, addr); vma && vma->start < end;
+         vma = vma->next) {
+        vma->flags = flags;
+        page::ProtectRange(pml4, vma->start, vma->end - vma->start, flags);
+    }
+    return 0;
+}
+
+// 由 VFS 服务按地址找到区域，从它持有的文件读入 virt 所在的一页
+static std::int64_t ReadPage(std::uint64_t virt, void *page) {
+    task::ipc::Message msg;
+    msg.dst_pid = SYS_FS;
+    msg.type    = SYS_FS_PAGEIN;
+    msg.num[0]  = virt;
+    msg.num[1]  = reinterpret_cast<std::uint64_t>(page);
+    task::ipc::Send(&msg);
+    task::ipc::Receive(&msg);
+    return static_cast<std::int64_t>(msg.num[0]);
+}
+
+// Resolve a user page fault from the current process's regions: write
+// faults on present pages go to copy-on-write, swapped-out pages are read
+// back, other not-present pages are allocated and filled from the file
+// (the rest stays zero, which also covers bss). Faults outside any region
+// or against its protection are left to the caller.
+bool HandleFault(std::uint64_t addr, std::uint64_t error_code) {
+    task::Pcb *proc = task::CurrentProc();
+    if (proc == nullptr || (proc->flags & THREAD_KERNEL)) return false;
+
+    Vma *vma = Find(&proc->mm.vmas, addr);
+    if (vma == nullptr || !(vma->flags & PTE_PRESENT)) return false;
+    if ((error_code & PF_ERR_WRITE) && !(vma->flags & PTE_WRITABLE)) {
+        return false;
+    }
+    if (error_code & PF_ERR_PRESENT) {
+        return page::HandleFault(addr, error_code);
+    }
+
+    std::uint64_t virt = addr & PAGE_MASK;
+    PTE *pte           = page::FindLeaf(proc->mm.pml4, virt);
+    if (pte != nullptr && (pte->value & PTE_SWAP)) {
+        return swap::SwapIn(&proc->mm, pte, virt, vma->flags);
+    }
+
+    void *page = swap::AllocPage(GFP_ZERO);
+    if (page == nullptr) return false;
+    page::SplitPages(page, 1);
+
+    std::uint64_t off = virt - vma->start;
+    bool file         = vma->file != nullptr && off < vma->file_size;
+    if (file) {
+        // 读文件要经过 VFS 服务的 IPC，期间需要响应时钟中断
+        asm __volatile__("sti");
+        if (ReadPage(virt, page) < 0) {
+            page::PutPage(Vir2Phy((std::uint64_t)page));
+            return false;
+        }
+    }
+
+    page::Map(proc->mm.pml4, virt, Vir2Phy((std::uint64_t)page), vma->flags);
+    swap::LruAdd(page, &proc->mm, virt, file);
+    return true;
+}
+
+}  // namespace mm::vma
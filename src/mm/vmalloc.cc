@@ -0,0 +1,145 @@
+/**
+ * @file vmalloc.cc
+ * @brief Virtually contiguous kernel allocations backed by single pages
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+#include <cstring>
+
+#include "kernel/mm.h"
+#include "kernel/page.h"
+#include "kernel/task.h"
+#include "kernel/tty.h"
+
+namespace mm::vmalloc {
+
+#define RELEASE_BATCH 32  // 每次解除映射并刷新 TLB 的页数
+
+// 已分配的一段虚拟地址，按地址升序链接
+struct Area {
+    std::uint64_t addr;
+    std::uint64_t pages;  // 映射的页数，其后留一页不映射作为保护页
+    Area *next;
+};
+
+static Area *areas = nullptr;
+static task::SpinLock vmalloc_lock CACHE_ALIGNED;
+static std::uint64_t nr_pages;  // 已映射的页数，在 vmalloc_lock 内更新
+
+void Init() {
+    vmalloc_lock.SetName("vmalloc");
+
+    // 预先建立 vmalloc 区域的 PDPT，使它对应的 PML4 项之后不再变化
+    PTE *entry = &page::kernel_pml4[PML4_ENTRY(VMALLOC_BASE)];
+    if (!(entry->value & PTE_PRESENT)) {
+        PTE *pdpt = page::AllocTable();
+        if (pdpt == nullptr) tty::Panic("vmalloc: out of memory\n");
+        entry->value = Vir2Phy((std::uint64_t)pdpt) | PTE_PRESENT |
+                       PTE_WRITABLE;
+    }
+    tty::printk("vmalloc: 0x%lx - 0x%lx\n", VMALLOC_BASE, VMALLOC_END);
+}
+
+// First fit over the sorted area list. Caller holds vmalloc_lock.
+static Area *ReserveArea(std::uint64_t pages) {
+    std::uint64_t size = (pages + 1) * PAGE_SIZE;
+    std::uint64_t addr = VMALLOC_BASE;
+    Area **pos         = &areas;
+    while (*pos != nullptr && (*pos)->addr - addr < size) {
+        addr = (*pos)->addr + ((*pos)->pages + 1) * PAGE_SIZE;
+        pos  = &(*pos)->next;
+    }
+    if (addr + size > VMALLOC_END) return nullptr;
+
+    Area *area = new Area;
+    if (area == nullptr) return nullptr;
+    area->addr  = addr;
+    area->pages = pages;
+    area->next  = *pos;
+    *pos        = area;
+    return area;
+}
+
+// Unmap n pages starting at addr and give the frames back. Pages that were
+// never mapped are skipped. The frames are freed only after UnmapRange has
+// shot down the other CPUs' TLB entries, which could still write to them.
+static void ReleasePages(std::uint64_t addr, std::uint64_t n) {
+    std::uint64_t frames[RELEASE_BATCH];
+    while (n > 0) {
+        std::uint64_t batch = n < RELEASE_BATCH ? n : RELEASE_BATCH;
+        for (std::uint64_t i = 0; i < batch; i++) {
+            frames[i] =
+                page::Translate(page::kernel_pml4, addr + i * PAGE_SIZE);
+        }
+        page::UnmapRange(page::kernel_pml4, addr, batch * PAGE_SIZE);
+        for (std::uint64_t i = 0; i < batch; i++) {
+            if (frames[i] == 0) continue;
+            page::FreePages((void *)Phy2Vir(frames[i]), 1);
+            nr_pages--;
+        }
+        addr += batch * PAGE_SIZE;
+        n -= batch;
+    }
+}
+
+// Remove an area from the list and release its pages. Caller holds
+// vmalloc_lock.
+static bool FreeArea(std::uint64_t addr) {
+    Area **pos = &areas;
+    while (*pos != nullptr && (*pos)->addr != addr) pos = &(*pos)->next;
+    Area *area = *pos;
+    if (area == nullptr) return false;
+
+    *pos = area->next;
+    ReleasePages(area->addr, area->pages);
+    delete area;
+    return true;
+}
+
+// Allocate size bytes that are contiguous in the vmalloc area but backed by
+// independent single pages, so the buddy allocator never needs a high-order
+// block. The memory is zeroed only when gfp has GFP_ZERO.
+void *Alloc(std::size_t size, std::uint32_t gfp) {
+    if (size == 0) return nullptr;
+    std::uint64_t pages = PAGE_ALIGN(size) / PAGE_SIZE;
+
+    // 内核半部的页表被所有地址空间共享，映射和解除映射都在锁内完成
+    vmalloc_lock.lock();
+    Area *area = ReserveArea(pages);
+    if (area == nullptr) {
+        vmalloc_lock.unlock();
+        return nullptr;
+    }
+
+    for (std::uint64_t i = 0; i < pages; i++) {
+        void *frame = page::AllocPages(1, gfp);
+        if (frame == nullptr) {
+            FreeArea(area->addr);
+            vmalloc_lock.unlock();
+            return nullptr;
+        }
+        page::Map(page::kernel_pml4, area->addr + i * PAGE_SIZE,
+                  Vir2Phy((std::uint64_t)frame),
+                  PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL);
+        nr_pages++;
+    }
+    vmalloc_lock.unlock();
+    return (void *)area->addr;
+}
+
+void Free(void *addr) {
+    if (addr == nullptr) return;
+
+    vmalloc_lock.lock();
+    bool found = FreeArea((std::uint64_t)addr);
+    vmalloc_lock.unlock();
+
+    if (!found) {
+        tty::printk("vmalloc: bad free of 0x%lx\n", (std::uint64_t)addr);
+    }
+}
+
+std::uint64_t NrPages() { return nr_pages; }
+
+}  // namespace mm::vmalloc
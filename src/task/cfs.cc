@@ -12,7 +12,7 @@
 
 namespace task::cfs {
 
-Sched sched;
+#define RETRY_NS 1000000ULL
 
 static inline std::uint64_t CalcVruntimeDelta(std::uint64_t delta,
                                               std::uint32_t weight) {
@@ -30,128 +30,262 @@ void Sched::UpdateVruntime(task::Pcb *pcb, std::uint64_t delta) {
     }
 }
 
-void Sched::NormalizeVruntime(task::Pcb *pcb) {
-    if (pcb->se.vruntime < min_vruntime) {
-        pcb->se.vruntime = min_vruntime;
+// Charge the running task for the time since it was last charged, so its
+// vruntime is exact whenever the queue changes or a decision is made.
+// The caller holds lock.
+void Sched::UpdateCurrLocked() {
+    std::uint64_t now = timer::Nanos();
+    clock             = now;
+    if (current == nullptr || now <= current->se.exec_start) return;
+
+    std::uint64_t delta    = now - current->se.exec_start;
+    current->se.exec_start = now;
+    current->time_used += delta;
+    UpdateVruntime(current, delta);
+}
+
+// Pick the vruntime of a task entering the queue. A new task starts at
+// min_vruntime. A woken task keeps its own vruntime but is moved up to at
+// most half a latency period behind min_vruntime, so that a long sleep
+// earns it a prompt run but not the CPU to itself.
+void Sched::PlaceEntity(task::Pcb *pcb, std::uint32_t flags) {
+    std::uint64_t vruntime = min_vruntime;
+    if (flags & ENQUEUE_WAKEUP) {
+        std::uint64_t credit = SYSCTL_SCHED_LATENCY / 2;
+        vruntime             = vruntime > credit ? vruntime - credit : 0;
+    }
+    if (pcb->se.vruntime < vruntime) {
+        pcb->se.vruntime = vruntime;
     }
 }
 
-void Sched::Enqueue(task::Pcb *pcb) {
-    if (pcb == nullptr) return;
+// Whether pcb, just put on the queue, should preempt the running task:
+// always if that is the idle task, otherwise if the running task is ahead
+// in vruntime by more than the wakeup granularity, scaled to pcb's weight.
+// Marks the running task and returns true if so. The caller holds lock.
+bool Sched::CheckPreemptWakeup(task::Pcb *pcb) {
+    if (current == nullptr || current == pcb || !pcb->se.on_rq) return false;
+
+    if (!(current->flags & THREAD_IDLE)) {
+        std::uint64_t gran = CalcVruntimeDelta(SYSCTL_SCHED_WAKEUP_GRANULARITY,
+                                               pcb->se.weight);
+        if (current->se.vruntime <= pcb->se.vruntime + gran) return false;
+    }
+    current->need_resched = true;
+    return true;
+}
 
-    lock.lock();
+// 调用者持有 lock。重复入队不做任何事；flags 为 0 时保留原有 vruntime
+void Sched::EnqueueLocked(task::Pcb *pcb, std::uint32_t flags) {
+    if (pcb->se.on_rq) return;
+    if (pcb->stat != task::Running && pcb->stat != task::Ready) return;
 
-    if (pcb->stat == task::Running || pcb->stat == task::Ready) {
-        if (rb_root != nullptr) {
-            NormalizeVruntime(pcb);
-        }
+    UpdateCurrLocked();
 
-        if (pcb->se.weight == 0) {
-            pcb->se.weight = 1024;
-        }
+    if (rb_root != nullptr && flags != 0) {
+        PlaceEntity(pcb, flags);
+    }
 
-        RbInsert(pcb);
+    if (pcb->se.weight == 0) {
+        pcb->se.weight = 1024;
+    }
 
-        nr_running++;
-        total_weight += pcb->se.weight;
+    RbInsert(pcb);
+    pcb->se.on_rq = true;
 
-        if (current == nullptr) {
-            current = pcb;
-        }
-    }
+    nr_running++;
+    total_weight += pcb->se.weight;
 
-    lock.unlock();
+    if (current == nullptr) {
+        current            = pcb;
+        pcb->se.exec_start = clock;
+    }
 }
 
-void Sched::Dequeue(task::Pcb *pcb) {
-    if (pcb == nullptr) return;
-
-    // tty::printk("[Dequeue] pid=%d, stat=%d, nr_before=%d, wt_before=%d\n",
-    //             pcb->pid, pcb->stat, nr_running, total_weight);
+// 调用者持有 lock。出队的任务若正在运行，仍记为 current，直到选出下一个
+void Sched::DequeueLocked(task::Pcb *pcb) {
+    if (!pcb->se.on_rq) return;
 
-    lock.lock();
+    UpdateCurrLocked();
 
     RbErase(pcb);
+    pcb->se.on_rq = false;
 
-    // tty::printk("[Dequeue] after RbErase, rb_root=%d\n",
-    //             rb_root ? rb_root->pid : -1);
+    nr_running--;
+    total_weight -= pcb->se.weight;
+}
 
-    if (pcb->stat == task::Running || pcb->stat == task::Ready ||
-        pcb->stat == task::Blocked) {
-        nr_running--;
-        total_weight -= pcb->se.weight;
-        //    tty::printk("[Dequeue] nr-- to %d\n", nr_running);
-    } /*else {
-        tty::printk("[Dequeue] stat=%d, no nr change\n", pcb->stat);
-    }*/
+// The run queue is also touched from the timer interrupt and by other
+// CPUs, so every entry point takes the lock with interrupts disabled.
+// Returns true if a woken or new task should preempt the running one.
+bool Sched::Enqueue(task::Pcb *pcb, std::uint32_t flags) {
+    if (pcb == nullptr) return false;
+
+    std::uint64_t irq = lock.lock_irqsave();
+    EnqueueLocked(pcb, flags);
+    bool preempt = flags != 0 && CheckPreemptWakeup(pcb);
+    lock.unlock_irqrestore(irq);
+    return preempt;
+}
 
-    if (current == pcb) {
-        current = FirstTask();
-    }
+void Sched::Dequeue(task::Pcb *pcb) {
+    if (pcb == nullptr) return;
 
-    lock.unlock();
+    std::uint64_t flags = lock.lock_irqsave();
+    DequeueLocked(pcb);
+    lock.unlock_irqrestore(flags);
+}
+
+// Put the task that is being switched out back in vruntime order, or take
+// it off the queue if it can no longer run. A task preempted between
+// marking itself Blocked and calling Schedule has not gone to sleep yet:
+// it stays queued and checks its wait condition when it runs again.
+void Sched::PutPrev(task::Pcb *prev, bool preempt) {
+    std::uint64_t flags = lock.lock_irqsave();
+    UpdateCurrLocked();
+    DequeueLocked(prev);
+    if (prev->stat == task::Running || prev->stat == task::Ready) {
+        prev->stat = task::Ready;
+        EnqueueLocked(prev);
+    } else if (preempt && prev->stat == task::Blocked) {
+        prev->stat = task::Ready;
+        EnqueueLocked(prev);
+        prev->stat = task::Blocked;
+    }
+    lock.unlock_irqrestore(flags);
 }
 
 task::Pcb *Sched::PickNextTask(void) {
     task::Pcb *next = nullptr;
 
-    lock.lock();
-    // tty::printk("[PickNextTask] curr=%d, nr=%d, wt=%d\n",
-    //             current ? current->pid : -1,
-    //             nr_running, total_weight);
+    std::uint64_t flags = lock.lock_irqsave();
 
-    if (nr_running > 0) {
+    // 跳过 Dead 状态的进程
+    next = FirstTask();
+    while (next && next->stat == Dead) {
+        DequeueLocked(next);
         next = FirstTask();
-        // tty::printk("[PickNextTask] first=%d, stat=%d\n",
-        //             next ? next->pid : -1, next ? next->stat : -1);
-        //  跳过 Dead 状态的进程
-        while (next && next->stat == Dead) {
-            // tty::printk("[PickNextTask] skip dead proc %d\n", next->pid);
-            Dequeue(next);
-            nr_running--;
-            if (nr_running > 0) {
-                next = FirstTask();
-            } else {
-                next = nullptr;
-                break;
-            }
-        }
+    }
+    if (next != nullptr && next != current) {
+        UpdateCurrLocked();
+        next->se.exec_start = clock;
     }
     current = next;
 
-    lock.unlock();
+    lock.unlock_irqrestore(flags);
 
     return next;
 }
 
-void Sched::UpdateClock(std::uint64_t delta) {
-    lock.lock();
-
-    clock += delta;
-    if (current == nullptr) return;
-    UpdateVruntime(current, delta);
-
-    lock.unlock();
+void Sched::UpdateCurr() {
+    std::uint64_t flags = lock.lock_irqsave();
+    UpdateCurrLocked();
+    lock.unlock_irqrestore(flags);
 }
 
-void Sched::UpdateVruntimeCurrent(std::uint64_t delta) {
-    if (current == nullptr) return;
-
-    lock.lock();
-    UpdateVruntime(current, delta);
-    lock.unlock();
+// The running task's share of the scheduling period, in ns. The period is
+// stretched once more tasks are runnable than fit into it at the minimum
+// granularity.
+std::uint64_t Sched::Slice() {
+    std::uint64_t period = SYSCTL_SCHED_LATENCY;
+    if (nr_running * SYSCTL_SCHED_MIN_GRANULARITY > period) {
+        period = nr_running * SYSCTL_SCHED_MIN_GRANULARITY;
+    }
+    return period * current->se.weight / total_weight;
 }
 
 bool Sched::NeedsSchedule() {
-    if (total_weight == 0 || nr_running == 0) return false;
-    std::uint64_t need_time =
-        nr_running * TIMER_PERIOD * current->se.weight / total_weight;
+    if (total_weight == 0 || nr_running == 0 || current == nullptr) {
+        return false;
+    }
 
-    if (current->time_used >= need_time) {
+    if (current->time_used >= Slice()) {
         current->time_used = 0;
         return true;
     } else {
         return false;
     }
 }
+
+// Nanoseconds until the running task's slice is used up. A task that is
+// past its slice or due to be preempted but holds a lock is looked at
+// again after RETRY_NS.
+std::uint64_t Sched::SliceLeft() {
+    if (total_weight == 0 || current == nullptr) return SYSCTL_SCHED_LATENCY;
+
+    std::uint64_t slice = Slice();
+    if (current->need_resched || current->time_used >= slice) return RETRY_NS;
+    return slice - current->time_used;
+}
+
+// In-order walk for the leftmost task that may change CPUs: ready, not an
+// idle task and not still running or saving its context on its old CPU.
+task::Pcb *Sched::FindMovable(task::Pcb *node) {
+    if (node == nullptr) return nullptr;
+
+    task::Pcb *pcb = FindMovable(node->se.rb_left);
+    if (pcb != nullptr) return pcb;
+    if (node->stat == task::Ready && !(node->flags & THREAD_IDLE) &&
+        !__atomic_load_n(&node->on_cpu, __ATOMIC_ACQUIRE)) {
+        return node;
+    }
+    return FindMovable(node->se.rb_right);
+}
+
+// Move one task from src to this queue, which belongs to cpu. Both locks
+// are taken in address order so two CPUs pulling from each other cannot
+// deadlock.
+bool Sched::PullFrom(Sched *src, std::uint32_t cpu) {
+    if (src == this) return false;
+
+    std::uint64_t flags = irq_save();
+    Sched *first  = src < this ? src : this;
+    Sched *second = src < this ? this : src;
+    first->lock.lock();
+    second->lock.lock();
+
+    task::Pcb *pcb = nullptr;
+    if (src->nr_running > nr_running + 1) {
+        pcb = src->FindMovable(src->rb_root);
+    }
+    if (pcb != nullptr) {
+        // vruntime 只在同一个队列内可比，换队列时按两边的 min_vruntime 平移
+        std::uint64_t lag = pcb->se.vruntime > src->min_vruntime
+                                ? pcb->se.vruntime - src->min_vruntime
+                                : 0;
+        src->DequeueLocked(pcb);
+        pcb->se.vruntime = min_vruntime + lag;
+        pcb->cpu         = cpu;
+        EnqueueLocked(pcb);
+    }
+
+    second->lock.unlock();
+    first->lock.unlock();
+    irq_restore(flags);
+    return pcb != nullptr;
+}
+
+// Pull a task from the busiest CPU if it has at least two more runnable
+// tasks than this one. Called periodically from the tick and whenever
+// this CPU is about to go idle.
+bool Balance(Cpu *cpu) {
+    Cpu *busiest = nullptr;
+    for (std::uint32_t i = 0; i < nr_cpus; i++) {
+        Cpu *other = &cpus[i];
+        if (other == cpu ||
+            !__atomic_load_n(&other->online, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        if (busiest == nullptr ||
+            other->sched.NrRunning() > busiest->sched.NrRunning()) {
+            busiest = other;
+        }
+    }
+
+    if (busiest == nullptr ||
+        busiest->sched.NrRunning() <= cpu->sched.NrRunning() + 1) {
+        return false;
+    }
+    return cpu->sched.PullFrom(&busiest->sched, cpu->id);
+}
 }  // namespace task::cfs
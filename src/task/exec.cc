@@ -18,20 +18,19 @@
 
 namespace task::thread {
 
+// 把内核分配的页按物理地址映射进当前进程，并登记为匿名区域
+static void MapIdentity(void *addr, std::uint64_t size) {
+    std::uint64_t phys  = mm::Vir2Phy((std::uint64_t)addr);
+    std::uint64_t flags = PTE_PRESENT | PTE_WRITABLE | PTE_USER;
+    mm::page::MapRange(task::CurrentProc()->mm.pml4, phys, phys, size, flags);
+    mm::vma::Insert(&task::CurrentProc()->mm.vmas, phys, phys + size, flags,
+                    nullptr, 0, 0);
+}
+
 extern "C" std::uint64_t ExecProc(task::Registers *regs) {
     void *start_addr = mm::page::Alloc(0x3000);
-    mm::page::Map(task::current_proc->mm.pml4,
-                  mm::Vir2Phy((std::uint64_t)start_addr),
-                  mm::Vir2Phy((std::uint64_t)start_addr),
-                  PTE_PRESENT | PTE_WRITABLE | PTE_USER);
-    mm::page::Map(task::current_proc->mm.pml4,
-                  mm::Vir2Phy((std::uint64_t)start_addr) + 0x1000,
-                  mm::Vir2Phy((std::uint64_t)start_addr) + 0x1000,
-                  PTE_PRESENT | PTE_WRITABLE | PTE_USER);
-    mm::page::Map(task::current_proc->mm.pml4,
-                  mm::Vir2Phy((std::uint64_t)start_addr) + 0x2000,
-                  mm::Vir2Phy((std::uint64_t)start_addr) + 0x2000,
-                  PTE_PRESENT | PTE_WRITABLE | PTE_USER);
+    mm::page::SplitPages(start_addr, 0x3000 / PAGE_SIZE);
+    MapIdentity(start_addr, 0x3000);
 
     regs->rcx = reinterpret_cast<std::uint64_t>(
                     mm::Vir2Phy((std::uint64_t)start_addr)) +
@@ -39,7 +38,7 @@ extern "C" std::uint64_t ExecProc(task::Registers *regs) {
     regs->rax = 1;
     regs->ds = regs->es = 0;
 
-    task::SwitchTable(task::current_proc);
+    task::SwitchTable(task::CurrentProc());
 
     return 1;
 }
@@ -56,21 +55,25 @@ int Execve(const char *filename, const char *argv[], const char *envp[]) {
 
     if (memcmp(ehdr.e_ident, "\x7f\x45\x4c\x46", 4) != 0) {
         tty::printk("execve: not an available elf file\n");
+        close(file);
         return -1;
     }
     if (ehdr.e_type != ET_EXEC) {
         tty::printk("execve: not executable\n");
+        close(file);
         return -1;
     }
     if (ehdr.e_machine != EM_X86_64) {
         tty::printk("execve: not x86_64\n");
+        close(file);
         return -1;
     }
 
-    PTE *user_pml4 = (PTE *)mm::page::Alloc(512 * sizeof(PTE));
-    memset(user_pml4, 0, 512 * sizeof(PTE));
-
+    // 区域持有文件本身，不依赖进程之后可能关闭或覆盖的 fd
+    vfs::File *image = vfs::FdGet(file);
+    PTE *user_pml4   = mm::page::AllocTable();
     memcpy(&user_pml4[256], &mm::page::kernel_pml4[256], 256 * sizeof(PTE));
+    mm::VmaTree vmas = mm::VmaTree();
 
     for (std::uint16_t i = 0; i < ehdr.e_phnum; i++) {
         Elf64_Phdr phdr;
@@ -82,65 +85,64 @@ int Execve(const char *filename, const char *argv[], const char *envp[]) {
             std::uint64_t page_start = phdr.p_vaddr & ~0xFFF;
             std::uint64_t page_end =
                 (phdr.p_vaddr + phdr.p_memsz + 0xFFF) & ~0xFFF;
-            std::uint64_t page_count = (page_end - page_start) / 0x1000;
-
-            void *page_addr = mm::page::Alloc(page_end - page_start);
 
-            for (std::uint64_t j = 0; j <= page_count; j++) {
-                mm::page::Map(
-                    user_pml4, page_start + j * 0x1000,
-                    mm::Vir2Phy((std::uint64_t)page_addr + j * 0x1000),
-                    PTE_PRESENT | PTE_WRITABLE | PTE_USER);
-            }
-
-            lseek(file, phdr.p_offset, SEEK_SET);
-            read(file, (void *)page_addr, phdr.p_filesz);
-
-            if (i == 1) {
-                task::current_proc->mm.text_start = phdr.p_vaddr;
-                task::current_proc->mm.text_end   = phdr.p_vaddr + phdr.p_memsz;
+            // 只记录区域，页面在首次访问时从文件读入，bss 部分按需清零
+            std::uint64_t flags = PTE_PRESENT | PTE_USER;
+            if (phdr.p_flags & PF_W) flags |= PTE_WRITABLE;
+            std::uint64_t lead = phdr.p_vaddr - page_start;
+            if (!mm::vma::Insert(&vmas, page_start, page_end, flags, image,
+                                 phdr.p_offset - lead,
+                                 lead + phdr.p_filesz)) {
+                tty::printk("execve: overlapping or invalid segments\n");
+                mm::vma::Destroy(&vmas);
+                mm::page::FreeTable(user_pml4);
+                close(file);
+                return -1;
             }
         }
     }
+    close(file);
 
-    if (task::current_proc != nullptr &&
-        task::current_proc->thread != nullptr) {
-        gdt::tss->rsp0 = task::current_proc->thread->rsp0;
-        wrmsr(0x175, task::current_proc->thread->rsp0);
+    if (task::CurrentProc() != nullptr &&
+        task::CurrentProc()->thread != nullptr) {
+        task::ThisCpu()->tss->rsp0 = task::CurrentProc()->thread->rsp0;
+        wrmsr(0x175, task::CurrentProc()->thread->rsp0);
     }
 
-    task::current_proc->thread->rip =
+    task::CurrentProc()->thread->rip =
         reinterpret_cast<std::uint64_t>(ret_syscall);
-    task::current_proc->thread->rsp = reinterpret_cast<std::uint64_t>(
-        reinterpret_cast<char *>(task::current_proc) + sizeof(task::Pcb) +
+    task::CurrentProc()->thread->rsp = reinterpret_cast<std::uint64_t>(
+        reinterpret_cast<char *>(task::CurrentProc()) + sizeof(task::Pcb) +
         STACK_SIZE - sizeof(task::Registers));
 
-    task::Registers *regs = (task::Registers *)task::current_proc->thread->rsp;
+    task::Registers *regs = (task::Registers *)task::CurrentProc()->thread->rsp;
 
-    task::current_proc->mm.pml4 = user_pml4;
+    task::CurrentProc()->mm.pml4 = user_pml4;
+    mm::vma::Destroy(&task::CurrentProc()->mm.vmas);
+    task::CurrentProc()->mm.vmas = vmas;
+    mm::tlb::Invalidate(&task::CurrentProc()->mm.asid);
+    if (task::CurrentProc()->mm.owner == nullptr) {
+        mm::stat::Attach(&task::CurrentProc()->mm, task::CurrentProc());
+    }
 
-    task::current_proc->flags ^= THREAD_KERNEL;
+    task::CurrentProc()->flags ^= THREAD_KERNEL;
     uint64_t argc = 0, len = 0;
     char **user_argv =
         reinterpret_cast<char **>(mm::page::Alloc(argc * sizeof(char *)));
+    mm::page::SplitPages(user_argv, 1);
     while (argv[argc] != nullptr) {
-        len             = strlen(argv[argc]) + 1;
+        len       = strlen(argv[argc]) + 1;
+        void *str = mm::page::Alloc(len * sizeof(char));
+        mm::page::SplitPages(str, 1);
         user_argv[argc] = reinterpret_cast<char *>(
-            mm::Vir2Phy(reinterpret_cast<std::uint64_t>(
-                mm::page::Alloc(len * sizeof(char)))));
+            mm::Vir2Phy(reinterpret_cast<std::uint64_t>(str)));
         strcpy(reinterpret_cast<char *>(mm::Phy2Vir(
                    reinterpret_cast<std::uint64_t>(user_argv[argc]))),
                argv[argc]);
-        mm::page::Map(user_pml4,
-                      reinterpret_cast<std::uint64_t>(user_argv[argc]),
-                      reinterpret_cast<std::uint64_t>(user_argv[argc]),
-                      PTE_PRESENT | PTE_WRITABLE | PTE_USER);
+        MapIdentity(str, PAGE_SIZE);
         argc++;
     }
-    mm::page::Map(user_pml4,
-                  mm::Vir2Phy(reinterpret_cast<std::uint64_t>(user_argv)),
-                  mm::Vir2Phy(reinterpret_cast<std::uint64_t>(user_argv)),
-                  PTE_PRESENT | PTE_WRITABLE | PTE_USER);
+    MapIdentity(user_argv, PAGE_SIZE);
 
     regs->rdi = argc;
     regs->rsi = mm::Vir2Phy(reinterpret_cast<std::uint64_t>(user_argv));
@@ -150,8 +152,8 @@ int Execve(const char *filename, const char *argv[], const char *envp[]) {
         "movq %1, %%rsp \n"
         "pushq %2\n"
         "jmp ExecProc\n" ::"D"(regs),
-        "m"(task::current_proc->thread->rsp),
-        "m"(task::current_proc->thread->rip)
+        "m"(task::CurrentProc()->thread->rsp),
+        "m"(task::CurrentProc()->thread->rip)
         : "memory");
     return 0;
 }
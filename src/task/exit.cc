@@ -10,6 +10,7 @@
 #include "kernel/cpu.h"
 #include "kernel/mm.h"
 #include "kernel/page.h"
+#include "kernel/slab.h"
 #include "kernel/task.h"
 #include "kernel/tty.h"
 
@@ -17,9 +18,18 @@ extern "C" std::int64_t do_exit(std::int64_t code) {
     return task::thread::Exit(code);
 }
 
+// 系统调用和中断返回用户态之前调用，此时不持有任何锁
+extern "C" void kill_check_c() {
+    task::Pcb *current = task::CurrentProc();
+    if (current != nullptr &&
+        __atomic_load_n(&current->kill_pending, __ATOMIC_ACQUIRE)) {
+        task::thread::Exit(current->exit_code);
+    }
+}
+
 namespace task::thread {
 std::int64_t Exit(std::int64_t code) {
-    Kill(current_proc, code);
+    Kill(CurrentProc(), code);
 
     // 切换到下一个线程（Schedule 中会 Dequeue）
     Schedule();
@@ -27,27 +37,52 @@ std::int64_t Exit(std::int64_t code) {
     return 0;
 }
 
+// Ask a user process to exit with code. Its address space cannot be freed
+// while it may run on another CPU or sleep in the kernel, so the process
+// does it itself on the way out of its next system call. Kernel threads
+// only exit by returning from their function. Returns -1 for them.
+std::int64_t RequestExit(Pcb *proc, std::int64_t code) {
+    if (proc == nullptr || (proc->flags & THREAD_KERNEL)) return -1;
+    proc->exit_code = code;
+    __atomic_store_n(&proc->kill_pending, true, __ATOMIC_SEQ_CST);
+    // 叫醒睡着的目标，让它从等待循环里退出来
+    if (__atomic_load_n(&proc->stat, __ATOMIC_SEQ_CST) == Blocked) {
+        Wakeup(proc);
+    }
+    return 0;
+}
+
+// Tear down proc, which must be the current task. The caller schedules away
+// afterwards.
 std::int64_t Kill(Pcb *proc, std::int64_t code) {
     tty::printk("Thread %d exit with code: 0x%lx\n", proc->pid, code);
     proc->exit_code = code;
-    proc->stat      = Dead;
 
     // 释放argv内存
     if (proc->argv != 0) {
         char **argv = reinterpret_cast<char **>(proc->argv);
         // 遍历并释放每个参数字符串
         for (std::uint64_t i = 0; argv[i] != nullptr; i++) {
-            mm::page::Free(argv[i]);
+            mm::slab::Free(argv[i]);
         }
         // 释放argv数组本身
-        mm::page::Free(argv);
+        mm::slab::Free(argv);
     }
 
     // 释放用户态页表
     if (!(proc->flags & THREAD_KERNEL)) {
-        mm::page::Free(proc->mm.pml4);
+        mm::stat::Detach(&proc->mm);
+        PTE *pml4     = proc->mm.pml4;
+        proc->mm.pml4 = mm::page::kernel_pml4;
+        // 不能释放仍在 CR3 中的页表
+        if (proc == CurrentProc()) SwitchTable(proc);
+        mm::swap::Forget(&proc->mm);
+        mm::page::FreeUserSpace(pml4);
+        mm::vma::Destroy(&proc->mm.vmas);
     }
 
+    // 最后才标记：Forget 等待回收者时可能让出 CPU，Dead 任务不会再被调度
+    proc->stat = Dead;
     return 0;
 }
 
@@ -4,6 +4,7 @@
  * @author Kumosya, 2025-2026
  **/
 
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 
@@ -15,37 +16,38 @@
 
 namespace task::thread {
 
-static pid_t NewPid() { return pid_counter++; }
-
-pid_t UserFork(void) {
-    // todo
-    return 0;
+static pid_t NewPid() {
+    return __atomic_fetch_add(&pid_counter, 1, __ATOMIC_RELAXED);
 }
 
-pid_t Fork(Registers *regs, std::uint64_t flags, std::uint64_t stack_size,
-           int nice) {
+// 创建子进程控制块并复制父进程状态，不设置页表也不加入调度队列
+static Pcb *CreateChild(Registers *regs, std::uint64_t flags,
+                        std::uint64_t stack_size, int nice = 0) {
     // 分配新的进程控制块，需要包含栈空间
     // 栈在Pcb之后，分配 Pcb + STACK_SIZE 大小的内存
-    Pcb *child =
-        reinterpret_cast<Pcb *>(mm::page::Alloc(sizeof(Pcb) + stack_size));
+    Pcb *child = reinterpret_cast<Pcb *>(
+        mm::vmalloc::Alloc(sizeof(Pcb) + stack_size, GFP_ZERO));
     if (child == nullptr) {
-        return -1;
+        return nullptr;
     }
 
-    std::memset(child, 0, sizeof(Pcb) + stack_size);
-
-    // 如果current_proc为nullptr（创建第一个进程时），直接初始化
-    if (current_proc != nullptr) {
-        *child        = *current_proc;
-        child->parent = current_proc;
+    // 如果CurrentProc()为nullptr（创建第一个进程时），直接初始化
+    if (CurrentProc() != nullptr) {
+        *child        = *CurrentProc();
+        child->parent = CurrentProc();
     } else {
         // 初始化第一个进程
         child->parent = nullptr;
     }
 
-    child->pid   = NewPid();
-    child->stat  = task::Blocked;
-    child->flags = flags;
+    child->pid           = NewPid();
+    child->stat          = task::Blocked;
+    child->flags         = flags;
+    child->on_cpu        = false;
+    child->need_resched  = false;
+    child->preempt_count = 0;
+    child->kill_pending  = false;
+    child->se.on_rq      = false;
 
     // 根据 nice 值设置 CFS 权重
     std::int32_t n = nice;
@@ -56,14 +58,15 @@ pid_t Fork(Registers *regs, std::uint64_t flags, std::uint64_t stack_size,
     child->se.min_vruntime     = 0;
 
     // 创建线程控制块
-    Tcb *thread = reinterpret_cast<Tcb *>(mm::page::Alloc(sizeof(Tcb)));
+    Tcb *thread = new Tcb;
     if (thread == nullptr) {
-        mm::page::Free(child);
-        return -1;
+        mm::vmalloc::Free(child);
+        return nullptr;
     }
 
     std::memset(thread, 0, sizeof(Tcb));
     child->thread = thread;
+    child->files.HoldAll();  // 子进程复制了父进程的 fd 表
 
     // 设置内核栈指针
     thread->rsp0 =
@@ -79,7 +82,7 @@ pid_t Fork(Registers *regs, std::uint64_t flags, std::uint64_t stack_size,
         thread->rsp = reinterpret_cast<std::uint64_t>(rsp);
         thread->rip = regs->rip;
         if (flags & THREAD_NO_ARGS) {
-            child->argv = current_proc->argv;
+            child->argv = CurrentProc()->argv;
         } else {
             child->argv = regs->rcx;
         }
@@ -89,12 +92,72 @@ pid_t Fork(Registers *regs, std::uint64_t flags, std::uint64_t stack_size,
         thread->rsp = thread->rsp0;
     }
 
+    child->mm.asid  = 0;
+    child->mm.vmas  = mm::VmaTree();
+    child->mm.owner = nullptr;
+    child->mm.prev  = nullptr;
+    child->mm.next  = nullptr;
+    // 复制来的锁可能正被别的 CPU 上的回收者持有
+    child->mm.lock = SpinLock();
+    child->mm.lock.SetName("mm");
+    return child;
+}
+
+pid_t Fork(Registers *regs, std::uint64_t flags, std::uint64_t stack_size,
+           int nice) {
+    Pcb *child = CreateChild(regs, flags, stack_size, nice);
+    if (child == nullptr) {
+        return -1;
+    }
+
     // 设置页表
     child->mm.pml4 = mm::page::kernel_pml4;
-    child->stat    = task::Ready;
 
-    // 将新创建的进程添加到 CFS 调度队列
-    cfs::sched.Enqueue(child);
+    // 将新创建的进程添加到负载最轻的 CPU 的调度队列
+    WakeupNew(child);
+
+    return child->pid;
+}
+
+// fork() for user processes, called from the SYS_FORK system call with the
+// caller's syscall frame. The child shares every user page copy-on-write and
+// returns 0 to user mode through ret_from_fork.
+pid_t UserFork(Registers *regs) {
+    if (CurrentProc() == nullptr || (CurrentProc()->flags & THREAD_KERNEL)) {
+        return -1;
+    }
+
+    PTE *pml4 = mm::page::CloneUserSpace(CurrentProc()->mm.pml4);
+    if (pml4 == nullptr) {
+        return -1;
+    }
+    // 父进程的可写页刚被改为只读，丢弃旧的 TLB 项
+    mm::tlb::FlushLocal();
+
+    mm::VmaTree vmas = mm::VmaTree();
+    Pcb *child       = nullptr;
+    if (mm::vma::Clone(&vmas, &CurrentProc()->mm.vmas)) {
+        child = CreateChild(nullptr, CurrentProc()->flags, STACK_SIZE);
+    }
+    if (child == nullptr) {
+        mm::vma::Destroy(&vmas);
+        mm::page::FreeUserSpace(pml4);
+        return -1;
+    }
+    child->se.weight = CurrentProc()->se.weight;  // 继承父进程的优先级
+    child->argv      = 0;
+    child->mm.pml4   = pml4;
+    child->mm.vmas   = vmas;
+    mm::stat::Attach(&child->mm, child);
+
+    // sysenter 只压入通用寄存器，rip/rsp 在 rdx/rcx 中，由 sysexit 恢复
+    Registers *frame = reinterpret_cast<Registers *>(child->thread->rsp0 -
+                                                     sizeof(Registers));
+    std::memcpy(frame, regs, offsetof(Registers, rip));
+    child->thread->rsp = reinterpret_cast<std::uint64_t>(frame);
+    child->thread->rip = reinterpret_cast<std::uint64_t>(ret_from_fork);
+
+    WakeupNew(child);
 
     return child->pid;
 }
@@ -0,0 +1,174 @@
+/**
+ * @file futex.cc
+ * @brief Fast user-space locking: wait on and wake a user address
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+#include <errno.h>
+
+#include "kernel/cpu.h"
+#include "kernel/io.h"
+#include "kernel/mm.h"
+#include "kernel/page.h"
+#include "kernel/task.h"
+#include "kernel/timer.h"
+
+namespace task::futex {
+
+#define FUTEX_HASH_BITS 6
+#define FUTEX_BUCKETS (1 << FUTEX_HASH_BITS)
+
+// 等待者放在自己的内核栈上，键是地址空间 (页表) 加用户地址
+struct Waiter {
+    PTE *pml4;
+    std::uint64_t addr;
+    Pcb *task;
+    Waiter *prev, *next;
+    bool queued;  // 被唤醒者清除，在 bucket 的锁内读写
+};
+
+struct CACHE_ALIGNED Bucket {
+    SpinLock lock;
+    Waiter *head;
+};
+
+static Bucket buckets[FUTEX_BUCKETS];
+
+static Bucket *Hash(PTE *pml4, std::uint64_t addr) {
+    std::uint64_t key = (std::uint64_t)pml4 ^ (addr >> 2);
+    return &buckets[(key * 0x9e3779b97f4a7c15ULL) >> (64 - FUTEX_HASH_BITS)];
+}
+
+// 调用者持有 bucket 的锁
+static void Remove(Bucket *bucket, Waiter *waiter) {
+    if (waiter->prev != nullptr) {
+        waiter->prev->next = waiter->next;
+    } else {
+        bucket->head = waiter->next;
+    }
+    if (waiter->next != nullptr) waiter->next->prev = waiter->prev;
+    waiter->queued = false;
+}
+
+// Bring the page holding addr in, through the page fault handler like any
+// other kernel access to user memory. Returns false when addr is not in a
+// readable region, where a fault would not be recoverable.
+static bool FaultIn(std::uint64_t addr) {
+    Pcb *current = CurrentProc();
+    mm::Vma *vma = mm::vma::Find(&current->mm.vmas, addr);
+    if (vma == nullptr || !(vma->flags & PTE_PRESENT)) return false;
+
+    (void)*reinterpret_cast<volatile std::uint32_t *>(addr);
+    return true;
+}
+
+// Block the caller while the 32-bit word at addr still holds val, until
+// Wake is called on addr or timeout_ns (TIMER_NEVER for no limit) passes.
+// The word is read and the caller queued under the bucket lock, so a
+// waker that changes the word and then calls Wake cannot be missed.
+// Returns 0 when woken, -EAGAIN when the word differed, -ETIMEDOUT or
+// -EFAULT.
+std::int64_t Wait(std::uint64_t addr, std::uint32_t val,
+                  std::uint64_t timeout_ns) {
+    if ((addr & 3) != 0 || addr >= USER_SPACE_END) return -EINVAL;
+
+    Pcb *current   = CurrentProc();
+    Bucket *bucket = Hash(current->mm.pml4, addr);
+    Waiter waiter;
+    waiter.pml4 = current->mm.pml4;
+    waiter.addr = addr;
+    waiter.task = current;
+
+    // 页表项随时可能被回收者换成交换项，锁内不能经过用户映射读，否则缺页
+    // 处理会在持锁时睡眠。引用住物理页后经直接映射读；关着中断，回收者
+    // 等不到本 CPU 的 TLB 刷新应答，在那之前不会释放这一页
+    std::uint64_t flags;
+    std::uint64_t phys;
+    while (true) {
+        flags = bucket->lock.lock_irqsave();
+        phys  = mm::page::Translate(current->mm.pml4, addr);
+        if (phys != 0) break;
+        bucket->lock.unlock_irqrestore(flags);
+        if (!FaultIn(addr)) return -EFAULT;
+    }
+    mm::page::GetPage(phys);
+    std::uint32_t word = *reinterpret_cast<volatile std::uint32_t *>(
+        mm::Phy2Vir(phys | (addr & ~PAGE_MASK)));
+    if (word != val) {
+        bucket->lock.unlock_irqrestore(flags);
+        mm::page::PutPage(phys);
+        return -EAGAIN;
+    }
+    waiter.prev = nullptr;
+    waiter.next = bucket->head;
+    if (bucket->head != nullptr) bucket->head->prev = &waiter;
+    bucket->head  = &waiter;
+    waiter.queued = true;
+    bucket->lock.unlock_irqrestore(flags);
+    mm::page::PutPage(phys);
+
+    std::uint64_t left = timeout_ns == TIMER_NEVER
+                             ? TIMER_NEVER
+                             : (timeout_ns + 999999) / 1000000;
+    std::int64_t ret   = 0;
+    while (true) {
+        flags = bucket->lock.lock_irqsave();
+        if (!waiter.queued) {
+            bucket->lock.unlock_irqrestore(flags);
+            break;
+        }
+        if (left == 0) {
+            Remove(bucket, &waiter);
+            bucket->lock.unlock_irqrestore(flags);
+            ret = -ETIMEDOUT;
+            break;
+        }
+        current->stat = Blocked;
+        if (KillPending(current)) {
+            Remove(bucket, &waiter);
+            bucket->lock.unlock_irqrestore(flags);
+            ret = -EINTR;
+            break;
+        }
+        bucket->lock.unlock_irqrestore(flags);
+
+        if (left == TIMER_NEVER) {
+            Schedule();
+        } else {
+            left = timer::ScheduleTimeout(left);
+        }
+    }
+    current->stat = Ready;
+    return ret;
+}
+
+// Wake up to nr tasks of the caller's address space waiting on addr.
+// Returns the number woken.
+std::int64_t Wake(std::uint64_t addr, std::uint32_t nr) {
+    if ((addr & 3) != 0 || addr >= USER_SPACE_END) return -EINVAL;
+
+    PTE *pml4          = CurrentProc()->mm.pml4;
+    Bucket *bucket     = Hash(pml4, addr);
+    std::uint32_t woken = 0;
+
+    std::uint64_t flags = bucket->lock.lock_irqsave();
+    Waiter *waiter      = bucket->head;
+    while (waiter != nullptr && woken < nr) {
+        Waiter *next = waiter->next;
+        if (waiter->pml4 == pml4 && waiter->addr == addr) {
+            // 等待者拿到锁看到 queued 为假之前，waiter 一直有效
+            Pcb *task = waiter->task;
+            Remove(bucket, waiter);
+            Wakeup(task);
+            woken++;
+        }
+        waiter = next;
+    }
+    bucket->lock.unlock_irqrestore(flags);
+
+    if (woken != 0 && irq_enabled()) preempt_check_c();
+    return woken;
+}
+
+}  // namespace task::futex
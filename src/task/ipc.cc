@@ -28,10 +28,29 @@ struct MessageQueue {
 };
 
 MessageQueue msg_queues[256];
-SpinLock msg_lock;
+SpinLock msg_lock CACHE_ALIGNED;
+
+// 只给锁命名，队列本身靠零初始化
+void Init() {
+    msg_lock.SetName("msg");
+    for (int i = 0; i < 256; i++) msg_queues[i].lock.SetName("msg_queue");
+}
+
+// 被结束的等待者撤下自己在 slot 里的登记，之后对方不会再拷贝它栈上的
+// 消息。slot 已被对方清空说明消息已经交接完，返回 false
+static bool Abandon(MessageQueue *queue, Pcb **slot) {
+    Pcb *current = CurrentProc();
+
+    queue->lock.lock();
+    bool mine = *slot == current;
+    if (mine) *slot = nullptr;
+    current->stat = task::Ready;
+    queue->lock.unlock();
+    return mine;
+}
 
 int Send(Message *msg) {
-    msg->sender = current_proc;
+    msg->sender = CurrentProc();
 
     // validate destination before indexing into the array
     if (msg->dst_pid < 0 || msg->dst_pid >= 256) {
@@ -48,27 +67,63 @@ int Send(Message *msg) {
         Pcb *receiver           = queue->waiting_receiver;
         queue->waiting_receiver = nullptr;
         queue->lock.unlock();
-        receiver->stat = task::Ready;
-        cfs::sched.Enqueue(receiver);
+        Wakeup(receiver);
         return 1;
     }
 
     // Rendezvous semantics: block the sender until a receiver consumes the
     // message.
     // tty::printk("Send: pid=%d blocking for dst=%d msg=%p\n",
-    // current_proc->pid, (int)msg->dst_pid, msg);
-    current_proc->msg     = msg;
-    queue->waiting_sender = current_proc;
-    current_proc->stat    = task::Blocked;
+    // CurrentProc()->pid, (int)msg->dst_pid, msg);
+    CurrentProc()->msg     = msg;
+    queue->waiting_sender = CurrentProc();
+    CurrentProc()->stat    = task::Blocked;
     queue->lock.unlock();
-    Schedule();
-    // tty::printk("Send: pid=%d woke up\n", current_proc->pid);
+    if (!KillPending(CurrentProc())) Schedule();
+    // tty::printk("Send: pid=%d woke up\n", CurrentProc()->pid);
+
+    if (KillPending(CurrentProc()) && Abandon(queue, &queue->waiting_sender)) {
+        return -1;
+    }
+    return 1;
+}
+
+// Queue a message without blocking the sender. A waiting receiver gets it
+// at once, otherwise it is stored in the destination's ring buffer. Returns
+// 0 when the ring is full and the message was dropped.
+int Post(Message *msg) {
+    msg->sender = CurrentProc();
+    if (msg->dst_pid < 0 || msg->dst_pid >= 256) {
+        return -1;
+    }
 
+    MessageQueue *queue = &msg_queues[msg->dst_pid];
+    queue->lock.lock();
+
+    if (queue->waiting_receiver != nullptr) {
+        memcpy(reinterpret_cast<void *>(queue->waiting_receiver->msg), msg,
+               sizeof(Message));
+        Pcb *receiver           = queue->waiting_receiver;
+        queue->waiting_receiver = nullptr;
+        queue->lock.unlock();
+        Wakeup(receiver);
+        return 1;
+    }
+
+    std::uint64_t next = (queue->tail + 1) % 16;
+    if (next == queue->head) {
+        queue->lock.unlock();
+        return 0;
+    }
+    memcpy(&queue->messages[queue->tail], msg, sizeof(Message));
+    queue->tail        = next;
+    queue->has_message = true;
+    queue->lock.unlock();
     return 1;
 }
 
 int Receive(Message *msg) {
-    task::Pcb *current = current_proc;
+    task::Pcb *current = CurrentProc();
 
     MessageQueue *queue = &msg_queues[current->pid];
 
@@ -97,16 +152,18 @@ int Receive(Message *msg) {
         queue->lock.unlock();
         // tty::printk("Receive: pid=%d waking sender=%d\n", current->pid,
         // sender->pid);
-        sender->stat = task::Ready;
-        cfs::sched.Enqueue(sender);
+        Wakeup(sender);
     } else {
-        current_proc->msg  = msg;
-        current_proc->stat = task::Blocked;
+        CurrentProc()->msg  = msg;
+        CurrentProc()->stat = task::Blocked;
 
-        queue->waiting_receiver = current_proc;
+        queue->waiting_receiver = CurrentProc();
         queue->lock.unlock();
 
-        Schedule();
+        if (!KillPending(current)) Schedule();
+        if (KillPending(current) && Abandon(queue, &queue->waiting_receiver)) {
+            return -1;
+        }
     }
     return 1;
 }
@@ -16,45 +16,85 @@
 
 namespace task {
 
-SpinLock::SpinLock() : state(0) {}
+#if LOCK_STAT == true
+SpinLock::SpinLock() : word(0), stat(nullptr), since(0) {}
+#else
+SpinLock::SpinLock() : word(0) {}
+#endif
 
 SpinLock::~SpinLock() {}
 
-void SpinLock::lock() {
-    while (true) {
-        std::uint32_t expected  = 0;
-        std::uint32_t new_value = 1;
+// 持锁期间不允许抢占：被抢占的持有者可能要等另一个关中断自旋的
+// CPU 放手才能再次运行
+static inline void PreemptDisable() {
+    Pcb *current = CurrentProc();
+    if (current != nullptr) current->preempt_count++;
+}
 
-        __asm__ __volatile__("lock xchgl %1, %0\n\t"
-                             : "=m"(state), "=r"(new_value)
-                             : "m"(state), "r"(new_value)
-                             : "memory", "cc");
+static inline void PreemptEnable() {
+    Pcb *current = CurrentProc();
+    if (current != nullptr) current->preempt_count--;
+}
 
-        if (expected == 0) {
-            break;
-        }
+// Take a ticket and wait until it is served. Waiters get the lock in the
+// order they arrived, so no CPU can be starved by faster ones.
+void SpinLock::lock() {
+    PreemptDisable();
+    std::uint16_t mine = __atomic_fetch_add(&ticket.next, 1, __ATOMIC_RELAXED);
+#if LOCK_STAT == true
+    std::uint64_t start = rdtsc();
+    bool contended = __atomic_load_n(&ticket.owner, __ATOMIC_RELAXED) != mine;
+#endif
 
+    while (__atomic_load_n(&ticket.owner, __ATOMIC_ACQUIRE) != mine) {
+        // 持有者可能在等本 CPU 响应 TLB 刷新请求
+        mm::tlb::ServePending();
         __asm__ __volatile__("pause");
     }
+#if LOCK_STAT == true
+    StatAcquired(start, contended);
+#endif
 }
 
+// 只有持有者会写 owner，不需要原子的读改写
 void SpinLock::unlock() {
-    __asm__ __volatile__("movl $0, %0\n\t"
-                         : "=m"(state)
-                         : "m"(state)
-                         : "memory");
+#if LOCK_STAT == true
+    StatReleased();
+#endif
+    __atomic_store_n(&ticket.owner, ticket.owner + 1, __ATOMIC_RELEASE);
+    PreemptEnable();
 }
 
+// Take the lock only if nobody holds it or waits for it: owner and next are
+// compared and next is advanced in one 32-bit compare-and-swap.
 bool SpinLock::try_lock() {
-    std::uint32_t expected  = 0;
-    std::uint32_t new_value = 1;
+    PreemptDisable();
+    std::uint32_t free = __atomic_load_n(&ticket.owner, __ATOMIC_RELAXED);
+    std::uint32_t old  = free | free << 16;
 
-    __asm__ __volatile__("lock xchgl %1, %0\n\t"
-                         : "=m"(state), "=r"(new_value)
-                         : "m"(state), "r"(new_value)
-                         : "memory", "cc");
+    bool ok = __atomic_compare_exchange_n(&word, &old, old + (1U << 16), false,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    if (!ok) {
+        PreemptEnable();
+        return false;
+    }
+#if LOCK_STAT == true
+    StatAcquired(rdtsc(), false);
+#endif
+    return true;
+}
+
+// For locks also taken from interrupt handlers: an interrupt arriving on
+// the holder's CPU would otherwise spin on a lock that is never released.
+std::uint64_t SpinLock::lock_irqsave() {
+    std::uint64_t flags = irq_save();
+    lock();
+    return flags;
+}
 
-    return (expected == 0);
+void SpinLock::unlock_irqrestore(std::uint64_t flags) {
+    unlock();
+    irq_restore(flags);
 }
 
-}  // namespace task
\ No newline at end of file
+}  // namespace task
@@ -0,0 +1,172 @@
+/**
+ * @file lockstat.cc
+ * @brief Optional spinlock contention statistics
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+#include <cstring>
+#include <sys/lockstat.h>
+
+#include "kernel/io.h"
+#include "kernel/task.h"
+#include "kernel/tty.h"
+
+namespace task {
+
+#if LOCK_STAT == true
+
+#define LOCKSTAT_CLASSES 64  // 最多区分的锁名，其余的锁计入未命名的一项
+
+// 同名锁的累计统计，时间单位都是 TSC 周期
+struct LockClass {
+    const char *name;  // 为空表示未命名的锁
+    std::uint64_t acquired;
+    std::uint64_t contended;  // 需要等待才获得的次数
+    std::uint64_t wait_total;
+    std::uint64_t wait_max;
+    std::uint64_t hold_total;
+    std::uint64_t hold_max;
+};
+
+static LockClass classes[LOCKSTAT_CLASSES];  // 第 0 项收集未命名的锁
+static std::uint32_t nr_classes = 1;
+static SpinLock class_lock;
+
+// 同一项可能同时被多把同名锁的持有者更新，计数都用原子操作
+static void Add(std::uint64_t *counter, std::uint64_t value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static void Max(std::uint64_t *max, std::uint64_t value) {
+    std::uint64_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > old &&
+           !__atomic_compare_exchange_n(max, &old, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Account this lock to the class called name, creating the class if it is
+// new. Locks named after the table is full stay in the unnamed class.
+void SpinLock::SetName(const char *name) {
+    class_lock.lock();
+    std::uint32_t i = 1;
+    while (i < nr_classes && strcmp(classes[i].name, name) != 0) i++;
+    if (i == nr_classes && nr_classes < LOCKSTAT_CLASSES) {
+        classes[i].name = name;
+        nr_classes++;
+    }
+    if (i < nr_classes) stat = &classes[i];
+    class_lock.unlock();
+}
+
+// start 是取号的时刻，只有取号时锁已被占用才计入等待时间
+void SpinLock::StatAcquired(std::uint64_t start, bool contended) {
+    LockClass *cls    = stat != nullptr ? stat : &classes[0];
+    std::uint64_t now = rdtsc();
+
+    since = now;
+    Add(&cls->acquired, 1);
+    if (contended) {
+        Add(&cls->contended, 1);
+        Add(&cls->wait_total, now - start);
+        Max(&cls->wait_max, now - start);
+    }
+}
+
+void SpinLock::StatReleased() {
+    LockClass *cls     = stat != nullptr ? stat : &classes[0];
+    std::uint64_t hold = rdtsc() - since;
+
+    Add(&cls->hold_total, hold);
+    Max(&cls->hold_max, hold);
+}
+
+// Fill order with the classes that were ever taken, longest total wait
+// first: those are the locks worth splitting. Returns how many there are.
+static std::uint32_t Sort(std::uint32_t *order) {
+    std::uint32_t nr  = 0;
+    std::uint32_t top = __atomic_load_n(&nr_classes, __ATOMIC_ACQUIRE);
+    for (std::uint32_t i = 0; i < top; i++) {
+        if (__atomic_load_n(&classes[i].acquired, __ATOMIC_RELAXED) == 0) {
+            continue;
+        }
+        std::uint64_t wait = classes[i].wait_total;
+        std::uint32_t b    = nr++;
+        for (; b > 0 && classes[order[b - 1]].wait_total < wait; b--) {
+            order[b] = order[b - 1];
+        }
+        order[b] = i;
+    }
+    return nr;
+}
+
+static const char *Name(const LockClass *cls) {
+    return cls->name != nullptr ? cls->name : "(unnamed)";
+}
+
+// Print the top classes to the kernel console, which is the serial port
+// unless the kernel was built with OUTPUT_TO_SERIAL=false.
+void lockstat::Dump(std::uint32_t top) {
+    std::uint32_t order[LOCKSTAT_CLASSES];
+    std::uint32_t nr = Sort(order);
+
+    tty::printk("Lock stat: %d classes, cycles at %d kHz\n", nr,
+                timer::TscKhz());
+    tty::printk("  %-24s %10s %10s %12s %10s %12s %10s\n", "name", "acq",
+                "cont", "wait", "wait-max", "hold", "hold-max");
+    for (std::uint32_t i = 0; i < nr && i < top; i++) {
+        const LockClass *cls = &classes[order[i]];
+        tty::printk("  %-24s %10d %10d %12d %10d %12d %10d\n", Name(cls),
+                    cls->acquired, cls->contended, cls->wait_total,
+                    cls->wait_max, cls->hold_total, cls->hold_max);
+    }
+}
+
+static bool Fill(std::int64_t index, struct lockstat_class *info) {
+    if (index == LOCKSTAT_DUMP) {
+        lockstat::Dump(LOCKSTAT_CLASSES);
+        return true;
+    }
+
+    std::uint32_t order[LOCKSTAT_CLASSES];
+    std::uint32_t nr = Sort(order);
+    if (index < 0 || index >= (std::int64_t)nr) return false;
+
+    const LockClass *cls = &classes[order[index]];
+    strncpy(info->name, Name(cls), LOCKSTAT_NAME_LEN - 1);
+    info->acquired   = cls->acquired;
+    info->contended  = cls->contended;
+    info->wait_total = cls->wait_total;
+    info->wait_max   = cls->wait_max;
+    info->hold_total = cls->hold_total;
+    info->hold_max   = cls->hold_max;
+    info->tsc_khz    = timer::TscKhz();
+    return true;
+}
+
+#else
+
+void lockstat::Dump(std::uint32_t top) { (void)top; }
+
+static bool Fill(std::int64_t index, struct lockstat_class *info) {
+    (void)index;
+    (void)info;
+    return false;
+}
+
+#endif  // LOCK_STAT
+
+// Handle a SYS_TASK_LOCKSTAT request: num[0] is the index of the class in
+// order of total wait, or LOCKSTAT_DUMP. The reply has 0 or -1 in num[0]
+// and the record from num[1] on.
+void lockstat::Query(ipc::Message *msg) {
+    std::int64_t index = msg->num[0];
+    void *buf          = &msg->num[1];
+    memset(buf, 0, sizeof(msg->data) - sizeof(msg->num[0]));
+
+    bool ok     = Fill(index, reinterpret_cast<struct lockstat_class *>(buf));
+    msg->num[0] = ok ? 0 : -1;
+}
+
+}  // namespace task
@@ -0,0 +1,81 @@
+/**
+ * @file mutex.cc
+ * @brief Sleeping mutex with adaptive spinning
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+
+#include "kernel/cpu.h"
+#include "kernel/io.h"
+#include "kernel/kassert.h"
+#include "kernel/task.h"
+#include "kernel/tty.h"
+
+namespace task {
+
+Mutex::Mutex() : owner(nullptr) {}
+
+Mutex::~Mutex() {}
+
+// 只比较各 CPU 的 current，不解引用 task：持有者可能已经放锁并退出
+static bool OnCpu(Pcb *task) {
+    for (std::uint32_t i = 0; i < nr_cpus; i++) {
+        if (__atomic_load_n(&cpus[i].current, __ATOMIC_RELAXED) == task) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Mutex::try_lock() {
+    Pcb *expected = nullptr;
+    return __atomic_compare_exchange_n(&owner, &expected, CurrentProc(), false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+// Take the mutex. Spin while the owner runs on another CPU, sleep once it
+// is off the CPU or we are asked to give up ours. Waiters are exclusive,
+// so each unlock wakes one of them. The caller must be able to sleep, even
+// when the mutex happens to be free.
+void Mutex::lock() {
+    KASSERT(MaySleep());
+    Pcb *current = CurrentProc();
+    if (try_lock()) return;
+
+    while (!current->need_resched) {
+        Pcb *holder = __atomic_load_n(&owner, __ATOMIC_RELAXED);
+        if (holder == nullptr) {
+            if (try_lock()) return;
+            continue;
+        }
+        if (holder == current) {
+            tty::Panic("mutex: PID %d takes a mutex it holds\n", current->pid);
+        }
+        if (!OnCpu(holder)) break;
+        asm volatile("pause");
+    }
+
+    WaitEntry wait;
+    while (true) {
+        waiters.Prepare(&wait, true);
+        if (try_lock()) break;
+        Schedule();
+    }
+    waiters.Finish(&wait);
+}
+
+// The exchange orders the release before the look at the wait queue, and
+// a waiter queues itself before its last try_lock, so either it sees the
+// mutex free or we see it waiting.
+void Mutex::unlock() {
+    Pcb *current = CurrentProc();
+    Pcb *holder  = __atomic_exchange_n(&owner, nullptr, __ATOMIC_SEQ_CST);
+    if (holder != current) {
+        tty::Panic("mutex: PID %d releases a mutex held by PID %d\n",
+                   current->pid, holder != nullptr ? holder->pid : -1);
+    }
+    if (!waiters.Empty()) waiters.WakeOne();
+}
+
+}  // namespace task
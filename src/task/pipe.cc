@@ -34,8 +34,7 @@ std::int64_t PipeCreate(int pipefd[2]) {
     pipe->reader      = nullptr;
     pipe->writer      = nullptr;
     pipe->is_closed   = false;
-    pipe->readable    = new Sem(0);
-    pipe->writable    = new Sem(4096);
+    pipe->lock.SetName("pipe");
 
     pipefd[0] = id * 2;
     pipefd[1] = id * 2 + 1;
@@ -54,14 +53,17 @@ std::int64_t PipeRead(int fd, void *buf, std::uint64_t size) {
     }
 
     Pipe *pipe = &pipe_table[pipe_id];
+    WaitEntry wait;
 
     pipe->lock.lock();
 
     while (pipe->buffer_size == 0 && !pipe->is_closed) {
+        pipe->readable.Prepare(&wait, true);
         pipe->lock.unlock();
-        pipe->readable->wait();
+        Schedule();
         pipe->lock.lock();
     }
+    pipe->readable.Finish(&wait);
 
     if (pipe->buffer_size == 0) {
         pipe->lock.unlock();
@@ -77,10 +79,13 @@ std::int64_t PipeRead(int fd, void *buf, std::uint64_t size) {
     }
 
     pipe->buffer_size -= read_size;
+    bool more = pipe->buffer_size > 0;
 
     pipe->lock.unlock();
 
-    pipe->writable->signal();
+    // 读者都是独占等待者，读剩的数据交给下一个读者
+    pipe->writable.WakeOne();
+    if (more) pipe->readable.WakeOne();
 
     return read_size;
 }
@@ -96,14 +101,17 @@ std::int64_t PipeWrite(int fd, const void *buf, std::uint64_t size) {
     }
 
     Pipe *pipe = &pipe_table[pipe_id];
+    WaitEntry wait;
 
     pipe->lock.lock();
 
     while (pipe->buffer_size == 4096 && !pipe->is_closed) {
+        pipe->writable.Prepare(&wait, true);
         pipe->lock.unlock();
-        pipe->writable->wait();
+        Schedule();
         pipe->lock.lock();
     }
+    pipe->writable.Finish(&wait);
 
     if (pipe->is_closed) {
         pipe->lock.unlock();
@@ -119,10 +127,12 @@ std::int64_t PipeWrite(int fd, const void *buf, std::uint64_t size) {
     }
 
     pipe->buffer_size += write_size;
+    bool room = pipe->buffer_size < 4096;
 
     pipe->lock.unlock();
 
-    pipe->readable->signal();
+    pipe->readable.WakeOne();
+    if (room) pipe->writable.WakeOne();
 
     return write_size;
 }
@@ -145,8 +155,8 @@ void PipeClose(int fd) {
 
     pipe->lock.unlock();
 
-    pipe->readable->signal();
-    pipe->writable->signal();
+    pipe->readable.WakeAll();
+    pipe->writable.WakeAll();
 }
 
 }  // namespace task::ipc
@@ -76,18 +76,16 @@ static void rb_print_node(task::Pcb *node, int depth, Pcb **visited,
 
 void Rq::RbPrintTree() {
     tty::printk("\n=== RBTree ===\n");
-    tty::printk("root=%d, leftmost=%d\n",
-                sched.rb_root ? sched.rb_root->pid : -1,
-                sched.leftmost ? sched.leftmost->pid : -1);
-    tty::printk("nr_running=%d, min_vruntime=%d\n", sched.nr_running,
-                sched.min_vruntime);
+    tty::printk("root=%d, leftmost=%d\n", rb_root ? rb_root->pid : -1,
+                leftmost ? leftmost->pid : -1);
+    tty::printk("nr_running=%d, min_vruntime=%d\n", nr_running, min_vruntime);
 
-    if (sched.rb_root) {
+    if (rb_root) {
         tty::printk("Tree: ");
         // 防止指针环导致的无限递归，分配访问记录数组
         task::Pcb *visited[256];
         int visited_count = 0;
-        rb_print_node(sched.rb_root, 0, visited, visited_count, 256);
+        rb_print_node(rb_root, 0, visited, visited_count, 256);
         tty::printk("\n");
     }
     tty::printk("=============\n\n");
@@ -113,7 +111,7 @@ void Rq::RbLeftRotate(task::Pcb *x) {
     y->se.rb_parent = x->se.rb_parent;
 
     if (x->se.rb_parent == nullptr) {
-        sched.rb_root = y;
+        rb_root = y;
     } else if (x == x->se.rb_parent->se.rb_left) {
         x->se.rb_parent->se.rb_left = y;
     } else {
@@ -148,7 +146,7 @@ void Rq::RbRightRotate(task::Pcb *y) {
     x->se.rb_parent = y->se.rb_parent;
 
     if (y->se.rb_parent == nullptr) {
-        sched.rb_root = x;
+        rb_root = x;
     } else if (y == y->se.rb_parent->se.rb_right) {
         y->se.rb_parent->se.rb_right = x;
     } else {
@@ -228,20 +226,19 @@ void Rq::RbInsertColorFixup(task::Pcb *node) {
         }
     }
 
-    if (sched.rb_root) {
-        RbSetBlack(sched.rb_root);
+    if (rb_root) {
+        RbSetBlack(rb_root);
     }
 
-    // tty::printk("[InsertFixup] done, root=%d\n", sched.rb_root ?
-    // sched.rb_root->pid : -1);
+    // tty::printk("[InsertFixup] done, root=%d\n", rb_root ?
+    // rb_root->pid : -1);
 }
 
 void Rq::RbEraseColorFixup(task::Pcb *node, task::Pcb *parent) {
     // tty::printk("[EraseFixup] node=%d, parent=%d start\n",
     //             node ? node->pid : -1, parent ? parent->pid : -1);
 
-    while (node != sched.rb_root && parent &&
-           (node == nullptr || !RbIsRed(node))) {
+    while (node != rb_root && parent && (node == nullptr || !RbIsRed(node))) {
         if (node == parent->se.rb_left) {
             task::Pcb *sibling = parent->se.rb_right;
             if (!sibling) break;
@@ -285,7 +282,7 @@ void Rq::RbEraseColorFixup(task::Pcb *node, task::Pcb *parent) {
                 RbSetBlack(sibling->se.rb_right);
                 RbSetRed(parent);
                 RbLeftRotate(parent);
-                node = sched.rb_root;
+                node = rb_root;
                 break;
             }
         } else {
@@ -331,7 +328,7 @@ void Rq::RbEraseColorFixup(task::Pcb *node, task::Pcb *parent) {
                 RbSetBlack(sibling->se.rb_left);
                 RbSetRed(parent);
                 RbRightRotate(parent);
-                node = sched.rb_root;
+                node = rb_root;
                 break;
             }
         }
@@ -360,7 +357,7 @@ void Rq::RbInsert(task::Pcb *node) {
     RbInitNode(node);
 
     task::Pcb *y = nullptr;
-    task::Pcb *x = sched.rb_root;
+    task::Pcb *x = rb_root;
 
     while (x != nullptr) {
         y = x;
@@ -374,7 +371,7 @@ void Rq::RbInsert(task::Pcb *node) {
     node->se.rb_parent = y;
 
     if (y == nullptr) {
-        sched.rb_root = node;
+        rb_root = node;
         RbSetBlack(node);  // 根节点设为黑色
     } else if (node->se.vruntime < y->se.vruntime) {
         y->se.rb_left = node;
@@ -383,21 +380,21 @@ void Rq::RbInsert(task::Pcb *node) {
     }
 
     if (node->se.rb_parent == nullptr) {
-        sched.leftmost = node;
-        // tty::printk("leftmost: %d\n", sched.leftmost->pid);
+        leftmost = node;
+        // tty::printk("leftmost: %d\n", leftmost->pid);
     } else if (node->se.rb_parent->se.rb_parent != nullptr) {
         RbInsertColorFixup(node);
     }
 
-    // 每次插入后重新计算全局leftmost
-    task::Pcb *leftmost = sched.rb_root;
-    if (leftmost) {
-        while (leftmost->se.rb_left) {
-            leftmost = leftmost->se.rb_left;
+    // 每次插入后重新计算本队列的leftmost
+    task::Pcb *first = rb_root;
+    if (first) {
+        while (first->se.rb_left) {
+            first = first->se.rb_left;
         }
-        sched.leftmost     = leftmost;
-        sched.min_vruntime = leftmost->se.vruntime;  // 更新min_vruntime
-        // tty::printk("leftmost: %d\n", sched.leftmost->pid);
+        leftmost     = first;
+        min_vruntime = first->se.vruntime;  // 更新min_vruntime
+        // tty::printk("leftmost: %d\n", leftmost->pid);
     }
 
     // RbPrintTree();
@@ -408,7 +405,7 @@ void Rq::RbReplaceNode(task::Pcb *u, task::Pcb *v) {
     // -1);
 
     if (u->se.rb_parent == nullptr) {
-        sched.rb_root = v;
+        rb_root = v;
     } else if (u == u->se.rb_parent->se.rb_left) {
         u->se.rb_parent->se.rb_left = v;
     } else {
@@ -428,8 +425,8 @@ void Rq::RbErase(task::Pcb *node) {
 
     // tty::printk("[RbErase] start: node=%d, rb_root=%d, nr_running=%d\n",
     //             node->pid,
-    //             sched.rb_root ? sched.rb_root->pid : -1,
-    //             sched.nr_running);
+    //             rb_root ? rb_root->pid : -1,
+    //             nr_running);
 
     task::Pcb *y        = node;
     task::Pcb *x        = nullptr;
@@ -485,35 +482,35 @@ void Rq::RbErase(task::Pcb *node) {
     }
 
     // tty::printk("[RbErase] after replace: rb_root=%d\n",
-    //             sched.rb_root ? sched.rb_root->pid : -1);
+    //             rb_root ? rb_root->pid : -1);
 
     if (x && !y_original_red) {
         RbEraseColorFixup(x, x_parent);
     }
 
-    if (sched.rb_root) {
-        task::Pcb *leftmost = sched.rb_root;
+    if (rb_root) {
+        task::Pcb *first = rb_root;
         // tty::printk("[RbErase] finding leftmost from root=%d\n",
-        // leftmost->pid);
-        while (leftmost->se.rb_left) {
-            leftmost = leftmost->se.rb_left;
+        // first->pid);
+        while (first->se.rb_left) {
+            first = first->se.rb_left;
         }
-        sched.leftmost = leftmost;
-        // tty::printk("[RbErase] leftmost=%d\n", leftmost->pid);
+        leftmost = first;
+        // tty::printk("[RbErase] leftmost=%d\n", first->pid);
     } else {
         // tty::printk("[RbErase] WARNING: rb_root is nullptr!\n");
-        sched.leftmost = nullptr;
+        leftmost = nullptr;
     }
 
-    if (sched.leftmost) {
-        sched.min_vruntime = sched.leftmost->se.vruntime;
+    if (leftmost) {
+        min_vruntime = leftmost->se.vruntime;
     } else {
-        sched.min_vruntime = 0;
+        min_vruntime = 0;
     }
 
     // tty::printk("[RbErase] done: rb_root=%d, leftmost=%d\n",
-    //             sched.rb_root ? sched.rb_root->pid : -1,
-    //             sched.leftmost ? sched.leftmost->pid : -1);
+    //             rb_root ? rb_root->pid : -1,
+    //             leftmost ? leftmost->pid : -1);
 }
 
 }  // namespace task::cfs
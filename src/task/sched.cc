@@ -9,7 +9,9 @@
 #include "kernel/cpu.h"
 #include "kernel/io.h"
 #include "kernel/kassert.h"
+#include "kernel/smp.h"
 #include "kernel/task.h"
+#include "kernel/timer.h"
 #include "kernel/tty.h"
 
 namespace task {
@@ -19,86 +21,184 @@ SpinLock run_queue_lock;
 
 void SchedInit() { run_queue_head = nullptr; }
 
-void Schedule() {
-    Pcb *prev = current_proc;
-    Pcb *next = nullptr;
+Cpu cpus[MAX_CPUS];
+std::uint32_t nr_cpus;
 
-    // Update runqueue first: dequeue / enqueue the previous task so
-    // the tree reflects its Ready state before picking the next task.
-    if (prev->stat == Dead) {
-        cfs::sched.Dequeue(prev);
+// Program the next timer interrupt for the end of the running task's
+// slice, or for the next timer on this CPU's wheel if that comes first.
+// The idle task with nothing else to run needs no tick for itself.
+static void ArmTimer(Cpu *cpu, Pcb *current) {
+    if (current == cpu->idle && cpu->sched.NrRunning() <= 1) {
+        timer::Arm(TIMER_NEVER);
     } else {
-        if (prev->stat != Blocked) {
-            prev->stat = Ready;
-            cfs::sched.Dequeue(prev);
-            cfs::sched.Enqueue(prev);
-        } else {
-            cfs::sched.Dequeue(prev);
+        timer::Arm(cpu->sched.SliceLeft());
+    }
+}
+
+// A CPU without a tick does not balance by itself, so a CPU with more
+// than one task waiting interrupts an idle one, which pulls a task as it
+// reschedules.
+static void KickIdle(Cpu *cpu) {
+    if (cpu->sched.NrRunning() <= 2) return;
+
+    for (std::uint32_t i = 0; i < nr_cpus; i++) {
+        Cpu *other = &cpus[i];
+        if (other != cpu && __atomic_load_n(&other->online, __ATOMIC_ACQUIRE) &&
+            other->current == other->idle && other->sched.NrRunning() <= 1) {
+            smp::SendIpi(other->apic_id, VECTOR_RESCHED);
+            return;
         }
     }
+}
 
-    // Now pick the next task from the up-to-date runqueue and print state
-    next = cfs::sched.PickNextTask();
-    // tty::printk("[%d -> %d]", prev->pid, next ? next->pid : -1);
-    // task::cfs::RbPrintTree();
+// Switch this CPU to the leftmost task of its run queue. Interrupts stay
+// disabled from updating the queue until the new task has been switched
+// in, so the tick cannot reenter on the same CPU. preempt is set when the
+// current task did not ask to give up the CPU.
+static void DoSchedule(bool preempt) {
+    std::uint64_t flags = irq_save();
+    Cpu *cpu            = ThisCpu();
+    Pcb *prev           = cpu->current;
+    prev->need_resched  = false;
+
+    // Update runqueue first: dequeue / enqueue the previous task so
+    // the tree reflects its state before picking the next task.
+    cpu->sched.PutPrev(prev, preempt);
+    Pcb *next = cpu->sched.PickNextTask();
 
-    cfs::sched.lock.lock();
+    // 本 CPU 只剩 idle 可运行时，先尝试从最忙的 CPU 拉一个任务过来
+    if (next == cpu->idle && cfs::Balance(cpu)) {
+        next = cpu->sched.PickNextTask();
+    }
 
     if (next == nullptr) {
         tty::Panic("No runnable task found!\n");
     }
 
-    if (prev->stat == Dead) {
-        cfs::sched.lock.unlock();
+    ArmTimer(cpu, next);
+    if (prev == next) {
+        irq_restore(flags);
+        return;
+    }
 
-        // 用户进程退出后，恢复内核页表
-        if (prev->mm.pml4 != 0 && (next->flags & THREAD_KERNEL)) {
-            SwitchTable(next);
-        }
+    // 内核线程共用内核页表，只有切入或切出用户进程时才切换 CR3。
+    // 已退出的用户进程在 Kill 中已换回内核页表
+    if (!(prev->flags & THREAD_KERNEL) || !(next->flags & THREAD_KERNEL)) {
+        SwitchTable(next);
+    }
 
-        current_proc = next;
-        SwitchContext(prev, next);
-    } else {
-        // if (prev->stat == Blocked) {
-        //     tty::printk("Schedule: prev=%d is blocked, skip enqueue,
-        //     next=%d\n", prev->pid, next ? next->pid : -1);
-        // }
+    next->on_cpu = true;
+    cpu->current = next;
+    SwitchContext(prev, next);
 
-        if (prev == next) {
-            cfs::sched.lock.unlock();
-            return;
+    irq_restore(flags);
+}
+
+void Schedule() { DoSchedule(false); }
+
+// Switch away from the current task if a wakeup or the end of its slice
+// asked for it and it holds no spinlock. Called on the way out of every
+// IRQ handler and system call, and after a wakeup in task context.
+extern "C" void preempt_check_c() {
+    Pcb *current = CurrentProc();
+    if (current != nullptr && current->need_resched &&
+        current->preempt_count == 0) {
+        DoSchedule(true);
+    }
+}
+
+// Put pcb on the run queue of cpu and preempt the task running there if
+// the newcomer is owed the CPU: another CPU is interrupted, this one
+// switches at once unless it is in an interrupt handler, whose exit path
+// will do it.
+static void Activate(Cpu *cpu, Pcb *pcb, std::uint32_t flags) {
+    pcb->stat = Ready;
+    if (!cpu->sched.Enqueue(pcb, flags)) return;
+
+    if (cpu != ThisCpu()) {
+        smp::SendIpi(cpu->apic_id, VECTOR_RESCHED);
+    } else if (irq_enabled()) {
+        preempt_check_c();
+    }
+}
+
+// Make a blocked task runnable on the CPU whose queue it left.
+void Wakeup(Pcb *pcb) { Activate(&cpus[pcb->cpu], pcb, ENQUEUE_WAKEUP); }
+
+// Place a new task on the online CPU with the fewest runnable tasks.
+void WakeupNew(Pcb *pcb) {
+    Cpu *target = ThisCpu();
+    for (std::uint32_t i = 0; i < nr_cpus; i++) {
+        Cpu *cpu = &cpus[i];
+        if (__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE) &&
+            cpu->sched.NrRunning() < target->sched.NrRunning()) {
+            target = cpu;
         }
+    }
+    pcb->cpu = target->id;
+    Activate(target, pcb, ENQUEUE_NEW);
+}
 
-        current_proc = next;
-        cfs::sched.lock.unlock();
-
-        if (!(prev->flags & THREAD_KERNEL) || !(next->flags & THREAD_KERNEL)) {
-            if (!(next->flags & THREAD_KERNEL) && next->mm.pml4) {
-                // mm::page::UpdateKernelPml4(next->mm.pml4);
-                SwitchTable(next);
-                // tty::printk("Switch to user page table: 0x%x\n",
-                // mm::Vir2Phy((std::uint64_t)next->mm.pml4));
-            } else if (!(prev->flags & THREAD_KERNEL) &&
-                       (next->flags & THREAD_KERNEL)) {
-                // tty::printk("Switch to kernel page table\n");
-                SwitchTable(next);
-            }
+// Per-CPU timer interrupt: charge the running task, run expired timers,
+// balance the run queues every BALANCE_TICKS and mark the task for
+// preemption once its slice is used up. The switch itself happens on the
+// way out of the interrupt.
+void Tick() {
+    Cpu *cpu     = ThisCpu();
+    Pcb *current = cpu->current;
+    if (current == nullptr) return;
+
+    cpu->sched.UpdateCurr();
+    timer::Run();
+
+    std::uint64_t now = timer::GetTicks();
+    if (now >= cpu->next_balance) {
+        cpu->next_balance = now + BALANCE_TICKS;
+        cfs::Balance(cpu);
+        KickIdle(cpu);
+    }
+
+    if (cpu->sched.NeedsSchedule()) current->need_resched = true;
+    ArmTimer(cpu, current);
+}
+
+// Body of every CPU's idle task: initialise deferred page descriptors and
+// pre-zero pages while there is work, and halt until the next interrupt
+// once nothing else is runnable here. The check and the hlt run with
+// interrupts disabled so a wakeup in between cannot be slept through.
+void Idle() {
+    Cpu *cpu = ThisCpu();
+    while (true) {
+        if (mm::page::InitDeferred() || mm::page::RefillZeroPool()) continue;
+
+        asm volatile("cli");
+        if (cpu->sched.NrRunning() <= 1) {
+            asm volatile("sti; hlt");
+        } else {
+            asm volatile("sti");
+            Schedule();
         }
-        SwitchContext(prev, next);
     }
 }
 
 extern "C" void __switch_to(Pcb *prev, Pcb *next) {
-    gdt::tss->rsp0 = next->thread->rsp0;
+    ThisCpu()->tss->rsp0 = next->thread->rsp0;
 
+    // GS 基址指向本 CPU 的数据，用户态不能改动 gs，这里只切换 fs
     __asm__ __volatile__("movw	%%fs,	%0 \n\t" : "=a"(prev->thread->fs));
-    __asm__ __volatile__("movw	%%gs,	%0 \n\t" : "=a"(prev->thread->gs));
-
     __asm__ __volatile__("movw	%0,	%%fs \n\t" ::"a"(next->thread->fs));
-    __asm__ __volatile__("movw	%0,	%%gs \n\t" ::"a"(next->thread->gs));
+
+    // prev 的上下文已保存，从此其他 CPU 可以把它拉走运行
+    __atomic_store_n(&prev->on_cpu, false, __ATOMIC_RELEASE);
 
     __asm__ __volatile__("sti");
     wrmsr(0x175, next->thread->rsp0);
 }
 
+// 其他 CPU 唤醒了本 CPU 运行队列中的任务，在中断返回前重新调度
+extern "C" void resched_ipi_handler_c() {
+    smp::Eoi();
+    CurrentProc()->need_resched = true;
+}
+
 }  // namespace task
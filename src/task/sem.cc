@@ -16,52 +16,32 @@
 
 namespace task {
 
-Sem::Sem(std::int32_t value) : value(value), wait_queue(nullptr) {}
+Sem::Sem(std::int32_t value) : value(value) { lock.SetName("sem"); }
 
 Sem::~Sem() {}
 
+// Take one unit, blocking while there is none. Waiters are exclusive, so
+// each signal wakes exactly one of them.
 void Sem::wait() {
-    lock.lock();
+    WaitEntry wait;
 
-    if (value > 0) {
-        value--;
+    lock.lock();
+    while (value <= 0) {
+        waiters.Prepare(&wait, true);
         lock.unlock();
-        return;
+        Schedule();
+        lock.lock();
     }
-
-    Pcb *current  = current_proc;
-    current->stat = Blocked;
-    cfs::sched.Dequeue(current);
-
-    Pcb *tail = wait_queue;
-    /*if (tail == nullptr) {
-        wait_queue = current;
-        current->next = nullptr;
-    } else {
-        while (tail->next != nullptr) {
-            tail = tail->next;
-        }
-        tail->next = current;
-        current->next = nullptr;
-    }*/
-
+    value--;
     lock.unlock();
-    Schedule();
+    waiters.Finish(&wait);
 }
 
 void Sem::signal() {
     lock.lock();
-
-    /*if (wait_queue != nullptr) {
-        Pcb *pcb = wait_queue;
-        wait_queue = pcb->next;
-        pcb->stat = Ready;
-        cfs::Enqueue(pcb);
-    } else {
-        value++;
-    }*/
-
+    value++;
     lock.unlock();
+    waiters.WakeOne();
 }
 
 std::int32_t Sem::get_value() const { return value; }
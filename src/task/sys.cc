@@ -21,12 +21,13 @@ int Service(int argc, char *argv[]) {
 
         if (ipc::Receive(&msg)) {
             switch (msg.type) {
+                // 发送者或目标可能正在别的 CPU 上运行，只能让它自己退出
                 case SYS_TASK_EXIT:
-                    thread::Kill(msg.sender, msg.num[0]);
+                    thread::RequestExit(msg.sender, msg.num[0]);
                     break;
                 case SYS_TASK_KILL:
-                    thread::Kill(reinterpret_cast<Pcb *>(msg.num[0]),
-                                 msg.num[1]);
+                    thread::RequestExit(reinterpret_cast<Pcb *>(msg.num[0]),
+                                        msg.num[1]);
                     break;
                 case SYS_TASK_EXECVE:
                     tty::printk("Execve request from PID %d: %x %x %s\n",
@@ -38,6 +39,12 @@ int Service(int argc, char *argv[]) {
                                    const_cast<const char **>(
                                        reinterpret_cast<char **>(msg.num[2])));
                     break;
+                case SYS_TASK_LOCKSTAT:
+                    lockstat::Query(&msg);
+                    msg.dst_pid = msg.sender->pid;
+                    msg.sender  = CurrentProc();
+                    ipc::Send(&msg);
+                    break;
                 default:
                     tty::printk("Unknown message type: %d\n", msg.type);
                     break;
@@ -14,6 +14,7 @@
 #include "kernel/mm.h"
 #include "kernel/page.h"
 #include "kernel/task.h"
+#include "kernel/timer.h"
 #include "kernel/tty.h"
 
 extern "C" std::uint64_t SyscallMain(task::Registers *regs) {
@@ -29,12 +30,29 @@ extern "C" std::uint64_t SyscallMain(task::Registers *regs) {
         task::ipc::Message ipc_msg;
         ipc_msg.type = regs->rdi;
         int ret      = task::ipc::Receive(&ipc_msg);
+        if (ret < 0) return static_cast<std::uint64_t>(ret);
         memcpy(reinterpret_cast<void *>(regs->r8), ipc_msg.data,
                sizeof(ipc_msg.data));
         if (regs->rdi && reinterpret_cast<pid_t *>(regs->rdi) != nullptr) {
             *reinterpret_cast<pid_t *>(regs->rdi) = ipc_msg.sender->pid;
         }
         return static_cast<std::uint64_t>(ret);
+    } else if (regs->rax == SYS_FORK) {
+        return static_cast<std::uint64_t>(task::thread::UserFork(regs));
+    } else if (regs->rax == SYS_TASK_EXIT) {
+        // 只标记自己，返回用户态前由 kill_check_c 退出
+        task::Pcb *current = task::CurrentProc();
+        current->exit_code = static_cast<std::int64_t>(regs->rdi);
+        __atomic_store_n(&current->kill_pending, true, __ATOMIC_RELEASE);
+        return 0;
+    } else if (regs->rax == SYS_TASK_SLEEP) {
+        // rdi 为纳秒数，按毫秒向上取整；没有信号打断，剩余时间总是 0
+        timer::Sleep((regs->rdi + 999999) / 1000000);
+        return 0;
+    } else if (regs->rax == SYS_FUTEX_WAIT) {
+        return task::futex::Wait(regs->rdi, regs->rsi, regs->r8);
+    } else if (regs->rax == SYS_FUTEX_WAKE) {
+        return task::futex::Wake(regs->rdi, regs->rsi);
     }
     return -1;
 }
@@ -13,14 +13,21 @@
 #include "kernel/mm.h"
 #include "kernel/multiboot2.h"
 #include "kernel/page.h"
+#include "kernel/slab.h"
 #include "kernel/task.h"
 #include "kernel/tty.h"
 #include "kernel/vfs.h"
 
 namespace task {
 
-Pcb *current_proc = nullptr;
-Pcb *idle         = nullptr;
+static mm::slab::Cache *tcb_cache = nullptr;
+
+void *Tcb::operator new(std::size_t size) {
+    if (tcb_cache == nullptr) return mm::slab::Alloc(size);
+    return tcb_cache->Alloc();
+}
+
+void Tcb::operator delete(void *ptr) { mm::slab::Free(ptr); }
 
 namespace thread {
 
@@ -54,7 +61,7 @@ static std::uint64_t ParseArgs(const char *arg, char ***argv) {
 
     // 分配argv数组
     *argv =
-        reinterpret_cast<char **>(mm::page::Alloc((argc + 1) * sizeof(char *)));
+        reinterpret_cast<char **>(mm::slab::Alloc((argc + 1) * sizeof(char *)));
     if (*argv == nullptr) {
         argc = 0;
         return 0;
@@ -72,7 +79,7 @@ static std::uint64_t ParseArgs(const char *arg, char ***argv) {
                 // 结束当前参数
                 size_t len = ptr - arg_start;
                 (*argv)[arg_index] =
-                    reinterpret_cast<char *>(mm::page::Alloc(len + 1));
+                    reinterpret_cast<char *>(mm::slab::Alloc(len + 1));
                 if ((*argv)[arg_index] != nullptr) {
                     std::memcpy((*argv)[arg_index], arg_start, len);
                     (*argv)[arg_index][len] = '\0';
@@ -91,7 +98,7 @@ static std::uint64_t ParseArgs(const char *arg, char ***argv) {
     // 处理最后一个参数
     if (in_arg && arg_index < argc) {
         size_t len         = ptr - arg_start;
-        (*argv)[arg_index] = reinterpret_cast<char *>(mm::page::Alloc(len + 1));
+        (*argv)[arg_index] = reinterpret_cast<char *>(mm::slab::Alloc(len + 1));
         if ((*argv)[arg_index] != nullptr) {
             std::memcpy((*argv)[arg_index], arg_start, len);
             (*argv)[arg_index][len] = '\0';
@@ -149,25 +156,27 @@ pid_t KernelThread(std::int64_t *fn, const char *arg, std::int32_t nice,
     return pid;
 }
 
-void InitIdle() {
+// Create the idle task of a CPU. The BSP's idle task is the context that
+// runs KernelMain, the idle task of an AP starts on its stack through the
+// trampoline. Either way it is already running, so it starts as current.
+void InitIdle(Cpu *cpu) {
     // 分配新的进程控制块，需要包含栈空间
-    idle = reinterpret_cast<Pcb *>(mm::page::Alloc(sizeof(Pcb) + STACK_SIZE));
+    Pcb *idle = reinterpret_cast<Pcb *>(
+        mm::vmalloc::Alloc(sizeof(Pcb) + STACK_SIZE, GFP_ZERO));
     if (!idle) {
         tty::Panic("Failed to allocate memory for idle process.\n");
     }
 
-    std::memset(idle, 0, sizeof(Pcb) + STACK_SIZE);
-
-    // 初始化第一个进程
     idle->parent = nullptr;
 
-    idle->pid  = pid_counter++;
+    // 所有 idle 任务共用 pid 0
+    idle->pid  = cpu->id == 0 ? pid_counter++ : 0;
     idle->stat = task::Blocked;
 
     // 创建线程控制块
-    Tcb *thread = reinterpret_cast<Tcb *>(mm::page::Alloc(sizeof(Tcb)));
+    Tcb *thread = new Tcb;
     if (thread == nullptr) {
-        mm::page::Free(idle);
+        mm::vmalloc::Free(idle);
         tty::Panic("Failed to allocate memory for idle thread.\n");
     }
 
@@ -182,28 +191,36 @@ void InitIdle() {
     thread->rsp = thread->rsp0;
 
     idle->mm.pml4 = mm::page::kernel_pml4;
+    idle->mm.cpu  = cpu->id;
 
     idle->stat                = task::Ready;
-    idle->flags               = THREAD_KERNEL;
+    idle->flags               = THREAD_KERNEL | THREAD_IDLE;
+    idle->cpu                 = cpu->id;
+    idle->on_cpu              = true;
     idle->se.weight           = cfs::Nice2Weight(IDLE_NICE);
     idle->se.vruntime         = 0;
     idle->se.sum_exec_runtime = 0;
+    idle->se.exec_start       = timer::Nanos();
     idle->se.min_vruntime     = 0;
 
-    // 将 idle 进程添加到 CFS 调度队列
-    cfs::sched.Enqueue(idle);
+    // 将 idle 进程添加到本 CPU 的 CFS 调度队列
+    cpu->sched.lock.SetName("runqueue");
+    cpu->sched.Enqueue(idle);
 
-    current_proc = idle;
-    // tty::printk("Set first process (PID: %d) as current_proc\n", idle->pid);
+    cpu->idle    = idle;
+    cpu->current = idle;
 }
 
 void Init() {
     pid_counter = 0;
     wrmsr(0x174, KERNEL_CS);
+    ipc::Init();
+
+    tcb_cache = mm::slab::CreateCache("tcb", sizeof(Tcb), nullptr);
 
-    InitIdle();
+    InitIdle(&cpus[0]);
 
-    wrmsr(0x175, current_proc->thread->rsp0);
+    wrmsr(0x175, cpus[0].idle->thread->rsp0);
     // 初始化系统调用
     wrmsr(0x176, reinterpret_cast<std::uint64_t>(enter_syscall));
 
@@ -7,19 +7,20 @@
 
 #include "kernel/cpu.h"
 #include "kernel/io.h"
+#include "kernel/smp.h"
 #include "kernel/task.h"
 #include "kernel/tty.h"
 
+// The PIT drives the tick on the BSP only until the local APIC timers have
+// been calibrated; IRQ 0 stays masked after that.
 extern "C" void pit_handler_c() {
     timer::pit_ticks++;
 
-    if (task::current_proc) {
-        task::current_proc->time_used += TIMER_PERIOD;
-        task::cfs::sched.UpdateClock(TIMER_PERIOD);
-    }
-
     outb(PIC1_CMD, 0x20);
-    if (task::cfs::sched.NeedsSchedule()) {
-        task::Schedule();
-    }
-}
\ No newline at end of file
+    task::Tick();
+}
+
+extern "C" void apic_timer_handler_c() {
+    smp::Eoi();
+    task::Tick();
+}
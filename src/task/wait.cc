@@ -0,0 +1,103 @@
+/**
+ * @file wait.cc
+ * @brief Wait queues
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+
+#include "kernel/cpu.h"
+#include "kernel/io.h"
+#include "kernel/task.h"
+
+namespace task {
+
+WaitQueue::WaitQueue() : head(nullptr), tail(nullptr) {
+    lock.SetName("wait_queue");
+}
+
+WaitQueue::~WaitQueue() {}
+
+// 调用者持有 lock
+void WaitQueue::Remove(WaitEntry *entry) {
+    if (entry->prev != nullptr) {
+        entry->prev->next = entry->next;
+    } else {
+        head = entry->next;
+    }
+    if (entry->next != nullptr) {
+        entry->next->prev = entry->prev;
+    } else {
+        tail = entry->prev;
+    }
+    entry->prev   = nullptr;
+    entry->next   = nullptr;
+    entry->queued = false;
+}
+
+// Queue the current task, unless a previous round left it queued, and mark
+// it Blocked. Exclusive waiters queue at the tail, behind the others, so a
+// wakeup reaches every non-exclusive waiter first.
+void WaitQueue::Prepare(WaitEntry *entry, bool exclusive) {
+    Pcb *current = CurrentProc();
+
+    std::uint64_t flags = lock.lock_irqsave();
+    if (!entry->queued) {
+        entry->task      = current;
+        entry->exclusive = exclusive;
+        entry->queued    = true;
+        if (exclusive) {
+            entry->prev = tail;
+            entry->next = nullptr;
+            if (tail != nullptr) tail->next = entry;
+            tail = entry;
+            if (head == nullptr) head = entry;
+        } else {
+            entry->prev = nullptr;
+            entry->next = head;
+            if (head != nullptr) head->prev = entry;
+            head = entry;
+            if (tail == nullptr) tail = entry;
+        }
+    }
+    current->stat = Blocked;
+    lock.unlock_irqrestore(flags);
+}
+
+// Mark the current task runnable again and take it off the queue if no
+// wakeup did. The entry may go out of scope after this returns.
+void WaitQueue::Finish(WaitEntry *entry) {
+    CurrentProc()->stat = Ready;
+
+    std::uint64_t flags = lock.lock_irqsave();
+    if (entry->queued) Remove(entry);
+    lock.unlock_irqrestore(flags);
+}
+
+// Wake every non-exclusive waiter and nr_exclusive exclusive ones, or all
+// of them if nr_exclusive is 0. Woken waiters leave the queue, so a second
+// wakeup goes to someone else. Returns the number of tasks woken.
+std::uint32_t WaitQueue::Wake(std::uint32_t nr_exclusive) {
+    std::uint32_t woken = 0;
+
+    std::uint64_t flags = lock.lock_irqsave();
+    WaitEntry *entry = head;
+    while (entry != nullptr) {
+        WaitEntry *next = entry->next;
+        bool exclusive  = entry->exclusive;
+        Pcb *task       = entry->task;
+        // 等待者在 Finish 中要拿 lock，释放前 entry 一直有效
+        Remove(entry);
+        Wakeup(task);
+        woken++;
+        if (exclusive && nr_exclusive != 0 && --nr_exclusive == 0) break;
+        entry = next;
+    }
+    lock.unlock_irqrestore(flags);
+
+    // 在任务上下文中唤醒时，被唤醒者若应抢占就在这里切换
+    if (woken != 0 && irq_enabled()) preempt_check_c();
+    return woken;
+}
+
+}  // namespace task
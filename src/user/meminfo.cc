@@ -0,0 +1,87 @@
+/**
+ * @file meminfo.cc
+ * @brief Print the memory statistics of the memory management service
+ * @author Kumosya, 2025-2026
+ **/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sys/meminfo.h>
+
+// 页数换算成 KiB
+static unsigned long KiB(std::uint64_t pages) { return pages * 4; }
+
+static void ShowSummary() {
+    struct meminfo info;
+    if (meminfo(MEMINFO_SUMMARY, 0, &info, sizeof(info)) != 0) {
+        std::puts("meminfo: memory service did not answer");
+        return;
+    }
+    std::printf("MemTotal:      %10lu KiB\n", KiB(info.total_pages));
+    std::printf("MemFree:       %10lu KiB\n", KiB(info.free_pages));
+    std::printf("Deferred:      %10lu KiB\n", KiB(info.deferred_pages));
+    std::printf("PageTables:    %10lu KiB\n", KiB(info.table_pages));
+    std::printf("Slab:          %10lu KiB\n", KiB(info.slab_pages));
+    std::printf("Vmalloc:       %10lu KiB\n", KiB(info.vmalloc_pages));
+    std::printf("ZeroPool:      %10lu KiB\n", KiB(info.zero_pages));
+    std::printf("Reclaimable:   %10lu KiB\n", KiB(info.lru_pages));
+    std::printf("SwapTotal:     %10lu KiB\n", KiB(info.swap_pages));
+    std::printf("SwapFree:      %10lu KiB\n", KiB(info.swap_free));
+    std::printf("Fragmentation: %10lu.%lu%%\n", info.frag_index / 10,
+                info.frag_index % 10);
+}
+
+static void ShowOrders() {
+    struct meminfo_order order;
+    std::printf("\norder  free blocks  used pages  frag\n");
+    for (long i = 0; meminfo(MEMINFO_ORDER, i, &order, sizeof(order)) == 0;
+         i++) {
+        std::printf("%5lu  %11lu  %10lu  %3lu.%lu%%\n", order.order,
+                    order.free_blocks, order.used_pages, order.frag_index / 10,
+                    order.frag_index % 10);
+    }
+}
+
+static void ShowSlabs() {
+    struct meminfo_slab slab;
+    std::printf("\ncache                     size   active    total  slabs\n");
+    for (long i = 0; meminfo(MEMINFO_SLAB, i, &slab, sizeof(slab)) == 0; i++) {
+        std::printf("%-24s %5lu %8lu %8lu %6lu\n", slab.name, slab.object_size,
+                    slab.active_objects, slab.total_objects, slab.slabs);
+    }
+}
+
+static void ShowProcs() {
+    struct meminfo_proc proc;
+    std::printf("\n  pid       rss      swap    tables      virt  vmas\n");
+    for (long i = 0; meminfo(MEMINFO_PROC, i, &proc, sizeof(proc)) == 0; i++) {
+        std::printf("%5ld %5lu KiB %5lu KiB %5lu KiB %5lu KiB %5lu\n",
+                    proc.pid, KiB(proc.rss), KiB(proc.swapped),
+                    KiB(proc.table_pages), KiB(proc.vm_pages), proc.nr_vmas);
+    }
+}
+
+static void ShowSites() {
+    struct meminfo_site site;
+    if (meminfo(MEMINFO_SITE, 0, &site, sizeof(site)) != 0) return;
+
+    std::printf("\n              site     pages   blocks   oldest\n");
+    for (long i = 0; meminfo(MEMINFO_SITE, i, &site, sizeof(site)) == 0; i++) {
+        std::printf("0x%16lx  %8lu %8lu %6lu ms\n", site.rip, site.pages,
+                    site.blocks, site.age_ms);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bool all = argc > 1 && std::strcmp(argv[1], "-a") == 0;
+
+    ShowSummary();
+    if (all) {
+        ShowOrders();
+        ShowSlabs();
+        ShowSites();
+    }
+    ShowProcs();
+    return 0;
+}
@@ -20,6 +20,9 @@ int main(int argc, char *argv[]) {
         } else if (std::strcmp(buf, "sh") == 0) {
             char *argv[2] = {"sh", nullptr};
             execv("/bin/sh", argv);
+        } else if (std::strcmp(buf, "meminfo") == 0) {
+            char *argv[3] = {"meminfo", "-a", nullptr};
+            execv("/bin/meminfo", argv);
         } else {
             std::printf("sh: %s: command not found.\n", buf);
         }